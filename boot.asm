@@ -1,7 +1,23 @@
 [BITS 16]   
 [ORG 0x7C00]
 
+KERNEL_LOAD_SEG equ 0x1000      ; sectors land at 0x10000 first
+KERNEL_BASE equ 0x400000        ; and are copied to 4 MiB once in protected mode
+KERNEL_MAX_SECTORS equ 1024     ; 512 KiB, what fits below the stack at 0x90000
+CHUNK_SECTORS equ 64            ; 32 KiB per read, never across a 64 KiB boundary
+E820_MAP equ 0x8000             ; entry count, then 24-byte entries, for _start()
+E820_MAX equ 32
+
 start:
+    cli
+    xor ax, ax
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+    mov sp, 0x7C00
+    sti
+    mov [boot_drive], dl
+
     mov ax, 0x0003
     int 0x10
     mov si, hello_msg
@@ -11,16 +27,88 @@ start:
     mov si, loading_msg
     call print_string
 
-    mov ah, 0x02
-    mov al, 25
-    mov ch, 0
-    mov cl, 2
-    mov dh, 0
-    ;mov dl, 0x80
-    mov bx, 0x8000
+    ; extended reads need a hard disk and a BIOS with the LBA extensions
+    cmp byte [boot_drive], 0x80
+    jb disk_error
+    mov ah, 0x41
+    mov bx, 0x55AA
+    mov dl, [boot_drive]
     int 0x13
-
     jc disk_error
+    cmp bx, 0xAA55
+    jne disk_error
+    test cx, 1
+    jz disk_error
+
+    ; the build stamps the kernel length in sectors into kernel_sectors
+    mov cx, [kernel_sectors]
+    test cx, cx
+    jz disk_error
+    cmp cx, KERNEL_MAX_SECTORS
+    ja disk_error
+
+read_loop:
+    mov ax, CHUNK_SECTORS
+    cmp cx, ax
+    jae read_chunk
+    mov ax, cx
+read_chunk:
+    mov [dap_count], ax
+    push cx
+    mov si, dap
+    mov ah, 0x42
+    mov dl, [boot_drive]
+    int 0x13
+    pop cx
+    jc disk_error
+    mov ax, [dap_count]
+    add [dap_lba], ax
+    add word [dap_segment], CHUNK_SECTORS * 512 / 16
+    sub cx, ax
+    jnz read_loop
+
+    ; BIOS memory map for the frame allocator; no map leaves a count of 0
+    mov di, E820_MAP + 4
+    xor ebx, ebx
+    xor bp, bp
+e820_loop:
+    mov eax, 0xE820
+    mov edx, 0x534D4150
+    mov ecx, 24
+    mov dword [di + 20], 1      ; valid, for BIOSes that only fill 20 bytes
+    int 0x15
+    jc e820_done
+    cmp eax, 0x534D4150
+    jne e820_done
+    inc bp
+    add di, 24
+    test ebx, ebx
+    jz e820_done
+    cmp bp, E820_MAX
+    jb e820_loop
+e820_done:
+    mov [E820_MAP], bp
+    mov word [E820_MAP + 2], 0
+
+    ; A20 through the BIOS, or the fast gate if that is not supported
+    mov ax, 0x2401
+    int 0x15
+    jnc a20_done
+    in al, 0x92
+    or al, 2
+    and al, 0xFE
+    out 0x92, al
+a20_done:
+
+    ; still off if a store at FFFF:0510 (1 MiB + 0x500) wraps onto 0000:0500;
+    ; the frame allocator needs the memory above 1 MiB
+    mov ax, 0xFFFF
+    mov fs, ax
+    mov ax, [0x0500]
+    not ax
+    mov [fs:0x0510], ax
+    cmp ax, [0x0500]
+    je a20_error
 
     mov si, success_msg
     call print_string
@@ -36,8 +124,13 @@ start:
     ;enter 32-bit mode
     jmp CODE_SEG:protected_mode_start
 
+a20_error:
+    mov si, a20_msg
+    jmp print_error
+
 disk_error:
     mov si, error_msg
+print_error:
     call print_string
     jmp $
 
@@ -51,7 +144,18 @@ protected_mode_start:
     mov gs, ax
 
     mov esp, 0x90000
-    jmp 0x8000
+
+    mov esi, KERNEL_LOAD_SEG * 16
+    mov edi, KERNEL_BASE
+    movzx ecx, word [kernel_sectors]
+    shl ecx, 7
+    cld
+    rep movsd
+
+    ; _start(map), with no return address to go back to
+    push dword E820_MAP
+    push dword 0
+    jmp KERNEL_BASE
 
 
 [BITS 16]
@@ -67,37 +171,6 @@ print_string:
 done:
     ret
 
-[BITS 32]
-clear_screen:
-    pusha
-    mov edx, 0xB8000
-    mov ecx, 80 * 25
-    mov ax, 0x0F20
-
-clear_loop:
-    mov [edx], ax
-    add edx, 2
-    loop clear_loop
-    popa
-    ret
-
-print_string_pm:
-    pusha
-    mov edx, 0xB8000
-
-print_string_pm_loop:
-    lodsb
-    or al, al
-    jz print_string_pm_done
-    mov ah, 0x0F
-    mov [edx], ax
-    add edx, 2
-    jmp print_string_pm_loop
-
-print_string_pm_done:
-    popa
-    ret
-
 ; GDT stuff
 
 gdt_start:
@@ -131,10 +204,25 @@ DATA_SEG equ gdt_data - gdt_start
 
 
 hello_msg db 'AcornOS Lives!!!!!', 13, 10, 0
-protected_msg db 'Protected Mode is active', 0
 loading_msg db 'Loading kernel', 13,10,0
 success_msg db 'Kernel loaded! Switching to protected mode', 13,10,0
 error_msg db 'Disk error', 13, 10, 0
-
-times 510-($-$$) db 0
+a20_msg db 'No A20', 13, 10, 0
+
+; disk address packet for int 0x13 AH=0x42
+dap:
+    db 0x10
+    db 0
+dap_count:
+    dw 0
+    dw 0
+dap_segment:
+    dw KERNEL_LOAD_SEG
+dap_lba:
+    dq 1
+
+boot_drive db 0
+
+times 508-($-$$) db 0
+kernel_sectors dw 0
 dw 0xAA55
\ No newline at end of file
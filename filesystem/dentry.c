@@ -0,0 +1,147 @@
+/* Libraries */
+#include "dentry.h"
+#include "lfn.h"
+
+/* Function Declarations */
+static uint32_t dentry_hash(uint16_t parent, const char* name);
+static void dentry_unhash(int slot);
+
+/* Global Variables */
+static struct fat12_dentry dentries[DENTRY_CACHE_SIZE];
+static int16_t hash_heads[DENTRY_HASH_SIZE];
+static uint32_t use_clock = 0;
+static int hash_ready = 0;
+static struct dentry_stats stats;
+
+/* Entries are keyed by the first cluster of the directory holding them and
+   the name a path used to reach them, long or short and compared without
+   regard to case. They remember where the short entry sits in that
+   directory plus the attributes and first cluster needed to keep walking
+   a path. Only subdirectories are cached; the root has its own index. */
+static uint32_t dentry_hash(uint16_t parent, const char* name) {
+    return (lfn_hash(name) ^ (parent * 16777619u)) & (DENTRY_HASH_SIZE - 1);
+}
+
+static void dentry_unhash(int slot) {
+    int16_t* link = &hash_heads[dentry_hash(dentries[slot].parent, dentries[slot].name)];
+    while (*link >= 0) {
+        if (*link == slot) {
+            *link = dentries[slot].hash_next;
+            break;
+        }
+        link = &dentries[*link].hash_next;
+    }
+    dentries[slot].valid = 0;
+}
+
+struct fat12_dentry* dentry_lookup(uint16_t parent, const char* name) {
+    if (!hash_ready) {
+        dentry_invalidate_all();
+    }
+    int slot = hash_heads[dentry_hash(parent, name)];
+    while (slot >= 0) {
+        struct fat12_dentry* dentry = &dentries[slot];
+        if (dentry->parent == parent && lfn_name_equal(dentry->name, name)) {
+            dentry->last_used = ++use_clock;
+            stats.hits++;
+            return dentry;
+        }
+        slot = dentry->hash_next;
+    }
+    stats.misses++;
+    return NULL;
+}
+
+/* Replaces the least recently used entry once the cache is full. Names
+   longer than DENTRY_NAME_MAX are left to the directory scan. */
+void dentry_insert(uint16_t parent, const char* name, uint16_t index, uint8_t attributes, uint16_t cluster) {
+    int length = 0;
+    while (name[length] != '\0') {
+        length++;
+    }
+    if (length > DENTRY_NAME_MAX) {
+        return;
+    }
+    if (!hash_ready) {
+        dentry_invalidate_all();
+    }
+    int victim = 0;
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        if (!dentries[i].valid) {
+            victim = i;
+            break;
+        }
+        if (dentries[i].last_used < dentries[victim].last_used) {
+            victim = i;
+        }
+    }
+    if (dentries[victim].valid) {
+        dentry_unhash(victim);
+        stats.evictions++;
+    }
+
+    struct fat12_dentry* dentry = &dentries[victim];
+    dentry->valid = 1;
+    dentry->parent = parent;
+    dentry->index = index;
+    dentry->attributes = attributes;
+    dentry->cluster = cluster;
+    for (int i = 0; i <= length; i++) {
+        dentry->name[i] = name[i];
+    }
+    dentry->last_used = ++use_clock;
+    uint32_t bucket = dentry_hash(parent, name);
+    dentry->hash_next = hash_heads[bucket];
+    hash_heads[bucket] = victim;
+}
+
+/* Called for every directory entry written, so cached entries follow
+   changes to the on-disk entry and disappear once the slot no longer
+   holds a live short entry. */
+void dentry_update(uint16_t parent, uint16_t index, int live, uint8_t attributes, uint16_t cluster) {
+    if (!hash_ready) {
+        return;
+    }
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        struct fat12_dentry* dentry = &dentries[i];
+        if (!dentry->valid || dentry->parent != parent || dentry->index != index) {
+            continue;
+        }
+        if (!live) {
+            dentry_unhash(i);
+        } else {
+            dentry->attributes = attributes;
+            dentry->cluster = cluster;
+        }
+    }
+}
+
+/* Drops everything cached under a directory that is being removed, so a
+   later directory reusing its cluster starts out empty. */
+void dentry_invalidate_dir(uint16_t parent) {
+    if (!hash_ready) {
+        return;
+    }
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        if (dentries[i].valid && dentries[i].parent == parent) {
+            dentry_unhash(i);
+        }
+    }
+}
+
+void dentry_invalidate_all() {
+    for (int i = 0; i < DENTRY_HASH_SIZE; i++) {
+        hash_heads[i] = -1;
+    }
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        dentries[i].valid = 0;
+        dentries[i].hash_next = -1;
+    }
+    hash_ready = 1;
+}
+
+void dentry_get_stats(struct dentry_stats* out) {
+    out->hits = stats.hits;
+    out->misses = stats.misses;
+    out->evictions = stats.evictions;
+}
@@ -0,0 +1,37 @@
+#ifndef DENTRY_H
+#define DENTRY_H
+
+#include "../kernel/kernel.h"
+
+/* Definitions */
+#define DENTRY_CACHE_SIZE 64
+#define DENTRY_HASH_SIZE 64
+#define DENTRY_NAME_MAX 40
+
+/* Struct Creation */
+struct fat12_dentry {
+    uint8_t valid;
+    uint8_t attributes;
+    uint16_t parent;
+    uint16_t index;
+    uint16_t cluster;
+    char name[DENTRY_NAME_MAX + 1];
+    int16_t hash_next;
+    uint32_t last_used;
+};
+
+struct dentry_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+};
+
+/* Function Declarations */
+struct fat12_dentry* dentry_lookup(uint16_t parent, const char* name);
+void dentry_insert(uint16_t parent, const char* name, uint16_t index, uint8_t attributes, uint16_t cluster);
+void dentry_update(uint16_t parent, uint16_t index, int live, uint8_t attributes, uint16_t cluster);
+void dentry_invalidate_dir(uint16_t parent);
+void dentry_invalidate_all();
+void dentry_get_stats(struct dentry_stats* out);
+
+#endif
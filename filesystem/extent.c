@@ -0,0 +1,161 @@
+/* Libraries */
+#include "extent.h"
+#include "fat12.h"
+
+/* Function Declarations */
+static void extent_extend(struct extent_map* map, uint32_t file_cluster);
+static int extent_search(struct extent_map* map, uint32_t file_cluster);
+
+/* Global Variables */
+static struct extent_map maps[EXTENT_CACHE_MAPS];
+static uint32_t use_clock = 0;
+
+/* Maps are keyed by a chain's first cluster and start out empty; extents
+   are appended as reads reach further into the file. */
+struct extent_map* extent_get(uint16_t first_cluster) {
+    struct extent_map* victim = &maps[0];
+    if (first_cluster < 2 || first_cluster >= FAT12_BAD_CLUSTER) {
+        return NULL;
+    }
+    for (int i = 0; i < EXTENT_CACHE_MAPS; i++) {
+        if (maps[i].valid && maps[i].first_cluster == first_cluster) {
+            maps[i].last_used = ++use_clock;
+            return &maps[i];
+        }
+        if (!maps[i].valid) {
+            victim = &maps[i];
+        } else if (victim->valid && maps[i].last_used < victim->last_used) {
+            victim = &maps[i];
+        }
+    }
+    victim->first_cluster = first_cluster;
+    victim->count = 0;
+    victim->mapped = 0;
+    victim->complete = 0;
+    victim->valid = 1;
+    victim->last_used = ++use_clock;
+    return victim;
+}
+
+/* Walks the FAT from the end of the last extent until file_cluster is
+   mapped, the chain ends, or the extent table is full. */
+static void extent_extend(struct extent_map* map, uint32_t file_cluster) {
+    uint16_t cluster;
+    if (map->count == 0) {
+        cluster = map->first_cluster;
+    } else {
+        struct fat12_extent* last = &map->extents[map->count - 1];
+        cluster = fat12_get_next_cluster(last->start + last->length - 1);
+    }
+
+    while (map->mapped <= file_cluster) {
+        if (cluster < 2 || cluster >= FAT12_BAD_CLUSTER) {
+            map->complete = 1;
+            return;
+        }
+        struct fat12_extent* last = map->count ? &map->extents[map->count - 1] : NULL;
+        if (last && cluster == last->start + last->length) {
+            last->length++;
+        } else {
+            if (map->count == EXTENT_MAX_RUNS) {
+                return;
+            }
+            last = &map->extents[map->count++];
+            last->file_cluster = map->mapped;
+            last->start = cluster;
+            last->length = 1;
+        }
+        map->mapped++;
+        cluster = fat12_get_next_cluster(cluster);
+    }
+    // keep growing the final extent so one lookup can describe the whole run
+    struct fat12_extent* last = &map->extents[map->count - 1];
+    while (cluster == last->start + last->length) {
+        last->length++;
+        map->mapped++;
+        cluster = fat12_get_next_cluster(cluster);
+    }
+    if (cluster < 2 || cluster >= FAT12_BAD_CLUSTER) {
+        map->complete = 1;
+    }
+}
+
+static int extent_search(struct extent_map* map, uint32_t file_cluster) {
+    int low = 0;
+    int high = map->count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        struct fat12_extent* ext = &map->extents[mid];
+        if (file_cluster < ext->file_cluster) {
+            high = mid - 1;
+        } else if (file_cluster >= ext->file_cluster + ext->length) {
+            low = mid + 1;
+        } else {
+            return mid;
+        }
+    }
+    return -1;
+}
+
+/* Resolves the file_cluster-th cluster of the chain and how many clusters
+   from there on are physically contiguous. Chains too fragmented for the
+   table fall back to walking the FAT from the last mapped cluster. */
+int extent_lookup(struct extent_map* map, uint32_t file_cluster, uint16_t* cluster, uint32_t* run_length) {
+    if (map == NULL) {
+        return -1;
+    }
+    if (file_cluster >= map->mapped && !map->complete) {
+        extent_extend(map, file_cluster);
+    }
+    if (file_cluster < map->mapped) {
+        struct fat12_extent* ext = &map->extents[extent_search(map, file_cluster)];
+        uint32_t offset = file_cluster - ext->file_cluster;
+        *cluster = ext->start + offset;
+        *run_length = ext->length - offset;
+        return 0;
+    }
+    if (map->complete || map->count == 0) {
+        return -1;
+    }
+
+    struct fat12_extent* last = &map->extents[map->count - 1];
+    uint16_t current = last->start + last->length - 1;
+    for (uint32_t i = map->mapped - 1; i < file_cluster; i++) {
+        current = fat12_get_next_cluster(current);
+        if (current < 2 || current >= FAT12_BAD_CLUSTER) {
+            return -1;
+        }
+    }
+    uint32_t length = 1;
+    uint16_t next = fat12_get_next_cluster(current);
+    while (next == current + length) {
+        length++;
+        next = fat12_get_next_cluster(next);
+    }
+    *cluster = current;
+    *run_length = length;
+    return 0;
+}
+
+/* Called whenever a FAT entry changes; any map that has already resolved
+   that cluster is dropped and rebuilt on next use. */
+void extent_invalidate(uint16_t cluster) {
+    for (int i = 0; i < EXTENT_CACHE_MAPS; i++) {
+        struct extent_map* map = &maps[i];
+        if (!map->valid) {
+            continue;
+        }
+        for (int j = 0; j < map->count; j++) {
+            if (cluster >= map->extents[j].start && cluster < map->extents[j].start + map->extents[j].length) {
+                map->valid = 0;
+                break;
+            }
+        }
+    }
+}
+
+void extent_invalidate_all() {
+    for (int i = 0; i < EXTENT_CACHE_MAPS; i++) {
+        maps[i].valid = 0;
+    }
+}
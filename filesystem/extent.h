@@ -0,0 +1,33 @@
+#ifndef EXTENT_H
+#define EXTENT_H
+
+#include "../kernel/kernel.h"
+
+/* Definitions */
+#define EXTENT_MAX_RUNS 32
+#define EXTENT_CACHE_MAPS 8
+
+/* Struct Creation */
+struct fat12_extent {
+    uint32_t file_cluster;
+    uint16_t start;
+    uint16_t length;
+};
+
+struct extent_map {
+    uint16_t first_cluster;
+    uint16_t count;
+    uint32_t mapped;
+    uint8_t valid;
+    uint8_t complete;
+    uint32_t last_used;
+    struct fat12_extent extents[EXTENT_MAX_RUNS];
+};
+
+/* Function Declarations */
+struct extent_map* extent_get(uint16_t first_cluster);
+int extent_lookup(struct extent_map* map, uint32_t file_cluster, uint16_t* cluster, uint32_t* run_length);
+void extent_invalidate(uint16_t cluster);
+void extent_invalidate_all();
+
+#endif
@@ -1,112 +1,483 @@
 /* Libraries */
 #include "fat12.h"
+#include "extent.h"
+#include "dentry.h"
+#include "lfn.h"
+#include "journal.h"
 #include "../kernel/vga.h"
+#include "../kernel/block.h"
+#include "../kernel/bcache.h"
+#include "../kernel/mem.h"
+#include "../kernel/heap.h"
+
+/* Struct Creation */
+struct dir_cursor {
+    uint16_t dir;
+    uint32_t index;
+    const uint8_t* data;
+    uint8_t buffer[SECTOR_SIZE];
+};
+
+struct meta_sector {
+    uint32_t sector;
+    uint8_t used;
+    uint8_t unlogged;
+    uint8_t data[SECTOR_SIZE];
+};
 
 /* Function Declarations */
-static void str_to_fat_name(const char* filename, char* fat_name);
-static int fat_name_compare(const char* fat_name, const char* filename);
-static void* memset(void* dest, int val, int n);
+static int fat12_blank_sector(const uint8_t* sector);
+static int fat12_parse_bpb(const uint8_t* sector);
+static int fat_copy_valid(const uint8_t* fat);
+static int fat12_format(uint32_t sectors);
+static int fat12_load();
+static uint32_t cluster_to_sector(uint16_t cluster);
+static uint16_t fat_unpack(uint16_t cluster);
+static void fat_pack(uint16_t cluster, uint16_t next);
+static void fat12_decode();
+static void fat12_pack_sector(uint32_t sector);
+static int fat12_write_dir_entry(int index);
+static void mark_dirty(uint32_t* bitmap, uint32_t index);
+static int test_dirty(uint32_t* bitmap, uint32_t index);
+static uint32_t bit_scan_forward(uint32_t word);
+static void fat12_build_free_map();
+static void fat12_release_freed();
+static int fat12_next_free(uint32_t from);
+static void fat12_free_chain(uint16_t cluster);
+static int fat12_open_entry(struct fat12_file* file, const char* path, int flags);
+static int entry_in_use(uint16_t dir, int index, int flags);
+static int file_cluster_at(struct fat12_file* file, uint32_t index, uint16_t* cluster, uint32_t* run_length);
+static uint32_t file_grow(struct fat12_file* file, uint32_t clusters_needed);
+static int file_read(struct fat12_file* file, void* buffer, uint32_t size);
+static void file_readahead(struct fat12_file* file);
+static int file_write(struct fat12_file* file, const void* buffer, uint32_t size);
+static int file_close(struct fat12_file* file);
+static struct fat12_file* fat12_get_handle(int fd);
+static int fat12_write_sectors(uint32_t sector, uint32_t count, void* buffer);
+static uint32_t dir_index_hash(const uint8_t* fat_name);
+static void dir_index_build();
+static void dir_index_insert(int index);
+static void dir_index_remove(int index);
+static const char* root_long_name(int index);
+static void root_name_set(int index, const char* name);
+static void root_name_clear(int index);
+static int fat_name_equal(const uint8_t* a, const uint8_t* b);
+static int root_find(const struct lfn_name* name);
+static int subdir_locate(uint16_t dir, uint32_t index, uint32_t* sector, uint32_t* offset);
+static int dir_entry_read(uint16_t dir, uint32_t index, struct fat12_dir_entry* entry);
+static int dir_entry_write(uint16_t dir, uint32_t index, struct fat12_dir_entry* entry);
+static void dir_open(struct dir_cursor* cursor, uint16_t dir);
+static struct fat12_dir_entry* dir_next(struct dir_cursor* cursor);
+static int dir_scan(uint16_t dir, const struct lfn_name* name);
+static int zero_cluster(uint16_t cluster);
+static int subdir_grow(uint16_t dir, uint32_t slots);
+static int dir_alloc_slots(uint16_t dir, uint32_t count);
+static int subdir_empty(uint16_t dir);
+static int dir_find(uint16_t dir, const struct lfn_name* name, uint8_t* attributes, uint16_t* cluster);
+static int dir_pick_alias(uint16_t dir, const struct lfn_name* name, struct lfn_name* alias);
+static int dir_create(uint16_t dir, const struct lfn_name* name, uint8_t attributes, uint16_t cluster);
+static void dir_remove_lfn(uint16_t dir, int index, const struct fat12_dir_entry* short_entry);
+static int dir_list(uint16_t dir, struct fat12_dir_entry* entries, int max_entries);
+static int dir_read(uint16_t dir, struct fat12_dirent* entries, int max_entries);
+static const char* path_next(const char* path, char* component);
+static int path_is_end(const char* path);
+static int is_dot(const char* component);
+static int is_dotdot(const char* component);
+static int path_step(uint16_t* dir, const char* component);
+static int path_walk(const char* path, uint16_t* dir, struct lfn_name* last);
+static int meta_find(uint32_t sector);
+static int meta_free_slots();
+static int meta_read_sector(uint32_t sector, void* buffer);
+static const uint8_t* meta_view(uint32_t sector, uint8_t* buffer);
+static int meta_write_sector(uint32_t sector, const void* buffer);
+static void meta_forget(uint16_t cluster);
+static int journal_apply(uint32_t sector, const void* data);
+static int journal_mount();
+static void journal_create();
+static void journal_reserve();
+static int fat12_commit();
+static int fat12_checkpoint();
+
+/* Definitions */
+#define FAT12_MAX_CLUSTERS 4084
+#define FAT_BUFFER_SECTORS 12
+#define ROOT_DIR_BUFFER_SECTORS 32
+#define ROOT_DIR_MAX_ENTRIES (ROOT_DIR_BUFFER_SECTORS * SECTOR_SIZE / 32)
+#define DIR_INDEX_BUCKETS 256
+#define ROOT_NAME_POOL (ROOT_DIR_MAX_ENTRIES * 14)
+#define ROOT_NAME_NONE 0xFFFF
+#define META_STAGE_MAX 16
+#define META_STAGE_RESERVE 6
+#define JOURNAL_NAME "JOURNAL.SYS"
 
 /* Global Variables */
 static struct fat12_boot_sector boot_sector;
-static uint8_t fat_table[SECTOR_SIZE * 2];
+static uint8_t fat_table[SECTOR_SIZE * FAT_BUFFER_SECTORS];
+static uint16_t fat_entries[SECTOR_SIZE * FAT_BUFFER_SECTORS * 2 / 3];
+static uint32_t fat_entry_count = 0;
+static int fat_decoded = 1;
 static uint32_t fat_start_sector;
 static uint32_t root_dir_start_sector;
 static uint32_t data_start_sector;
-static uint8_t root_directory[SECTOR_SIZE * 14];
+static uint32_t total_sectors;
+static uint32_t fat_sectors;
+static uint32_t root_dir_sectors;
+static uint32_t cluster_sectors = 1;
+static uint32_t cluster_size = SECTOR_SIZE;
+static uint8_t root_directory[SECTOR_SIZE * ROOT_DIR_BUFFER_SECTORS];
+static uint32_t fat_dirty[(FAT_BUFFER_SECTORS + 31) / 32];
+static uint32_t dir_dirty[(ROOT_DIR_BUFFER_SECTORS + 31) / 32];
+static uint32_t fat_unlogged[(FAT_BUFFER_SECTORS + 31) / 32];
+static uint32_t dir_unlogged[(ROOT_DIR_BUFFER_SECTORS + 31) / 32];
+static struct meta_sector meta_stage[META_STAGE_MAX];
+static int journaling = 0;
+static int journaling_wanted = 1;
+static uint16_t journal_cluster = 0;
+static uint32_t free_map[(FAT12_ENTRIES + 2 + 31) / 32];
+static uint32_t free_pending[(FAT12_ENTRIES + 2 + 31) / 32];
+static uint32_t cluster_limit = 0;
+static uint32_t alloc_cursor = 2;
+static int16_t dir_index_head[DIR_INDEX_BUCKETS];
+static int16_t dir_index_next[ROOT_DIR_MAX_ENTRIES];
+static int16_t long_index_head[DIR_INDEX_BUCKETS];
+static int16_t long_index_next[ROOT_DIR_MAX_ENTRIES];
+static char root_names[ROOT_NAME_POOL];
+static uint16_t root_name_offset[ROOT_DIR_MAX_ENTRIES];
+static uint32_t root_name_used = 0;
 static int fs_initialized = 0;
+static struct block_device* fs_device = NULL;
+static int fs_mapped = 0;
+static struct fat12_file open_files[FAT12_MAX_OPEN];
+static uint32_t readahead_window = FAT12_READAHEAD_DEFAULT;
+static uint16_t cwd_cluster = 0;
+static char cwd_path[FAT12_MAX_PATH] = "/";
+static struct kmem_cache* sector_cache = NULL;
+
+static void mark_dirty(uint32_t* bitmap, uint32_t index) {
+    bitmap[index / 32] |= 1u << (index % 32);
+}
+
+static int test_dirty(uint32_t* bitmap, uint32_t index) {
+    return (bitmap[index / 32] >> (index % 32)) & 1;
+}
+
+static uint32_t bit_scan_forward(uint32_t word) {
+    uint32_t index;
+    __asm__("bsf %1, %0" : "=r"(index) : "rm"(word));
+    return index;
+}
+
+int fat12_init(struct block_device* dev, int io_mode){
+    uint8_t sector_buffer[SECTOR_SIZE];
+
+    fs_initialized = 0;
+    fs_device = dev;
+    if (fs_device == NULL) {
+        return -1;
+    }
+    // partial-sector buffers for file I/O, off the stack of deep callers
+    if (sector_cache == NULL) {
+        sector_cache = kmem_cache_create("sector", SECTOR_SIZE, SECTOR_SIZE);
+    }
+    block_set_mode(fs_device, io_mode);
+    bcache_invalidate(fs_device);
+    // a device already in memory gains nothing from the cache but copies
+    fs_mapped = block_map(fs_device, 0, 1) != NULL;
+    memset(fat_dirty, 0, sizeof(fat_dirty));
+    memset(dir_dirty, 0, sizeof(dir_dirty));
+    memset(fat_unlogged, 0, sizeof(fat_unlogged));
+    memset(dir_unlogged, 0, sizeof(dir_unlogged));
+    memset(meta_stage, 0, sizeof(meta_stage));
+    memset(open_files, 0, sizeof(open_files));
+    journaling = 0;
+    journal_cluster = 0;
+    journal_close();
+    extent_invalidate_all();
+    dentry_invalidate_all();
+    cwd_cluster = 0;
+    cwd_path[0] = '/';
+    cwd_path[1] = '\0';
+
+    if (block_read(fs_device, 0, 1, sector_buffer) != 0) {
+        return -1;
+    }
+    if (fat12_blank_sector(sector_buffer)) {
+        if (fat12_format(fs_device->sector_count) != 0) {
+            return -1;
+        }
+    } else if (fat12_parse_bpb(sector_buffer) != 0 || fat12_load() != 0) {
+        return -1;
+    } else {
+        fat12_decode();
+    }
+    dir_index_build();
+    if (journal_mount() != 0) {
+        return -1;
+    }
+    fat12_build_free_map();
+    if (journal_cluster == 0 && journaling_wanted) {
+        journal_create();
+    }
+    journaling = journaling_wanted && journal_is_open();
+    fs_initialized = 1;
+    return 0;
+}
+
+static int fat12_blank_sector(const uint8_t* sector) {
+    for (int i = 0; i < SECTOR_SIZE; i++) {
+        if (sector[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Accepts the BPB layouts mkfs.fat produces for FAT12 and derives the
+   volume geometry from it. The volume must fit the device, have fewer than
+   4085 clusters and fit the static FAT and root directory buffers. */
+static int fat12_parse_bpb(const uint8_t* sector) {
+    memcpy(&boot_sector, sector, sizeof(struct fat12_boot_sector));
+    if (sector[510] != 0x55 || sector[511] != 0xAA) {
+        return -1;
+    }
+    uint32_t spc = boot_sector.sectors_per_cluster;
+    if (boot_sector.bytes_per_sector != SECTOR_SIZE || spc == 0 || (spc & (spc - 1)) != 0) {
+        return -1;
+    }
+    if (boot_sector.reserved_sectors == 0 || boot_sector.fat_count == 0 || boot_sector.sectors_per_fat == 0) {
+        return -1;
+    }
+    if (boot_sector.root_entries == 0 || boot_sector.root_entries > ROOT_DIR_MAX_ENTRIES ||
+        boot_sector.media_descriptor < 0xF0) {
+        return -1;
+    }
+    total_sectors = boot_sector.total_sectors ? boot_sector.total_sectors : boot_sector.large_sectors;
+    if (total_sectors > fs_device->sector_count) {
+        return -1;
+    }
 
-static void* memcpy(void* dest, const void* src, int n) {
-    char* d = (char*)dest;
-    const char* s = (const char*)src;
-    for (int i = 0; i < n; i++) {
-        d[i] = s[i];
+    fat_start_sector = boot_sector.reserved_sectors;
+    root_dir_start_sector = fat_start_sector + (boot_sector.fat_count * boot_sector.sectors_per_fat);
+    root_dir_sectors = (boot_sector.root_entries * sizeof(struct fat12_dir_entry) + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    data_start_sector = root_dir_start_sector + root_dir_sectors;
+    if (data_start_sector >= total_sectors) {
+        return -1;
     }
-    return dest;
+    uint32_t clusters = (total_sectors - data_start_sector) / spc;
+    if (clusters == 0 || clusters > FAT12_MAX_CLUSTERS) {
+        return -1;
+    }
+    // only the part of the FAT that maps real clusters is kept in memory
+    fat_sectors = (((clusters + 2) * 3 + 1) / 2 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (fat_sectors > boot_sector.sectors_per_fat) {
+        return -1;
+    }
+    fat_entry_count = fat_sectors * SECTOR_SIZE * 2 / 3;
+    cluster_sectors = spc;
+    cluster_size = spc * SECTOR_SIZE;
+    return 0;
+}
+
+static int fat_copy_valid(const uint8_t* fat) {
+    return fat[0] == boot_sector.media_descriptor && (fat[1] & 0x0F) == 0x0F;
 }
 
-static void* memset(void* dest, int val, int n) {
-    char* d = (char*)dest;
-    for (int i = 0; i < n; i++) {
-        d[i] = val;
+/* The first FAT copy whose reserved entries carry the media descriptor is
+   used. Sectors where the other copies disagree with it are marked dirty
+   so the next sync brings every copy back in line. */
+static int fat12_load() {
+    uint8_t sector_buffer[SECTOR_SIZE];
+    int chosen = -1;
+
+    for (int i = 0; i < boot_sector.fat_count && chosen < 0; i++) {
+        uint32_t copy_start = fat_start_sector + i * boot_sector.sectors_per_fat;
+        if (block_read(fs_device, copy_start, fat_sectors, fat_table) == 0 && fat_copy_valid(fat_table)) {
+            chosen = i;
+        }
+    }
+    if (chosen < 0) {
+        return -1;
+    }
+    for (int i = 0; i < boot_sector.fat_count; i++) {
+        if (i == chosen) {
+            continue;
+        }
+        uint32_t copy_start = fat_start_sector + i * boot_sector.sectors_per_fat;
+        for (uint32_t j = 0; j < fat_sectors; j++) {
+            if (block_read(fs_device, copy_start + j, 1, sector_buffer) != 0 ||
+                memcmp(sector_buffer, fat_table + j * SECTOR_SIZE, SECTOR_SIZE) != 0) {
+                mark_dirty(fat_dirty, j);
+            }
+        }
     }
-    return dest;
+
+    memset(root_directory, 0, sizeof(root_directory));
+    return block_read(fs_device, root_dir_start_sector, root_dir_sectors, root_directory);
 }
 
-int fat12_init(){
+/* Lays out an empty volume over the whole device: a single-sector cluster
+   on anything floppy-sized, doubled until the cluster count fits FAT12. */
+static int fat12_format(uint32_t sectors) {
+    uint8_t sector_buffer[SECTOR_SIZE];
+    uint32_t spc = 1;
+
+    while (sectors / spc > FAT12_MAX_CLUSTERS && spc < 128) {
+        spc *= 2;
+    }
+    memset(&boot_sector, 0, sizeof(boot_sector));
+    boot_sector.jump[0] = 0xEB;
+    boot_sector.jump[1] = 0x3C;
+    boot_sector.jump[2] = 0x90;
+    memcpy(boot_sector.oem_name, "ACORNOS ", 8);
     boot_sector.bytes_per_sector = SECTOR_SIZE;
-    boot_sector.sectors_per_cluster = 1;
+    boot_sector.sectors_per_cluster = spc;
     boot_sector.reserved_sectors = 1;
     boot_sector.fat_count = 2;
-    boot_sector.root_entries = 224;
-    boot_sector.total_sectors = 2880;
-    boot_sector.media_descriptor = 0xF0;
-    boot_sector.sectors_per_fat = 9;
+    boot_sector.root_entries = sectors <= 2880 ? 224 : 512;
+    if (sectors < 0x10000) {
+        boot_sector.total_sectors = sectors;
+    } else {
+        boot_sector.large_sectors = sectors;
+    }
+    boot_sector.media_descriptor = sectors == 2880 ? 0xF0 : 0xF8;
+    boot_sector.sectors_per_fat = (((sectors / spc + 2) * 3 + 1) / 2 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    boot_sector.sectors_per_track = 18;
+    boot_sector.heads = 2;
+    boot_sector.boot_signature = 0x29;
+    memcpy(boot_sector.volume_label, "NO NAME    ", 11);
+    memcpy(boot_sector.fs_type, "FAT12   ", 8);
 
-    fat_start_sector = boot_sector.reserved_sectors;
-    root_dir_start_sector = fat_start_sector + (boot_sector.fat_count * boot_sector.sectors_per_fat);
-    data_start_sector = root_dir_start_sector + ((boot_sector.root_entries * 32) / boot_sector.bytes_per_sector);
+    memset(sector_buffer, 0, SECTOR_SIZE);
+    memcpy(sector_buffer, &boot_sector, sizeof(struct fat12_boot_sector));
+    sector_buffer[510] = 0x55;
+    sector_buffer[511] = 0xAA;
+    if (fat12_parse_bpb(sector_buffer) != 0 || block_write(fs_device, 0, 1, sector_buffer) != 0) {
+        return -1;
+    }
 
-    memset(fat_table, 0, SECTOR_SIZE * 2);
-    fat_table[0] = 0xF0;
+    memset(sector_buffer, 0, SECTOR_SIZE);
+    for (uint32_t sector = fat_start_sector; sector < data_start_sector; sector++) {
+        if (block_write(fs_device, sector, 1, sector_buffer) != 0) {
+            return -1;
+        }
+    }
+    memset(root_directory, 0, sizeof(root_directory));
+    memset(fat_table, 0, sizeof(fat_table));
+    fat_table[0] = boot_sector.media_descriptor;
     fat_table[1] = 0xFF;
     fat_table[2] = 0xFF;
-
-    memset(root_directory, 0, sizeof(root_directory));
-    
-    //test stuff
-    struct fat12_dir_entry* test_entry = (struct fat12_dir_entry*)root_directory;
-    memcpy(test_entry->filename, "TEST    ", 8);
-    memcpy(test_entry->extension, "TXT", 3);
-    test_entry->attributes = FAT12_ATTR_ARCHIVE;
-    test_entry->cluster_low = 2;
-    test_entry->file_size = 13;
-    fat12_set_next_cluster(2, FAT12_EOF_CLUSTER);
-    
-    fs_initialized = 1;
-    return 0;
+    fat12_decode();
+    mark_dirty(fat_dirty, 0);
+    return fat12_sync();
 }
 
 int fat12_read_sector(uint32_t sector, void* buffer) {
-    if (sector >= root_dir_start_sector && 
-        sector < root_dir_start_sector + ((boot_sector.root_entries * 32) / SECTOR_SIZE)) {
+    if (sector >= root_dir_start_sector && sector < root_dir_start_sector + root_dir_sectors) {
         uint32_t offset = (sector - root_dir_start_sector) * SECTOR_SIZE;
         memcpy(buffer, root_directory + offset, SECTOR_SIZE);
         return 0;
     }
+    if (fs_mapped) {
+        return block_read(fs_device, sector, 1, buffer);
+    }
+    if (fs_device != NULL) {
+        return bcache_read(fs_device, sector, buffer);
+    }
     memset(buffer, 0, SECTOR_SIZE);
     return 0;
 }
 
+int fat12_read_sectors(uint32_t sector, uint32_t count, void* buffer) {
+    if (fs_mapped && sector >= data_start_sector) {
+        return block_read(fs_device, sector, count, buffer);
+    }
+    if (fs_device != NULL && sector >= data_start_sector) {
+        return bcache_read_sectors(fs_device, sector, count, buffer);
+    }
+    uint8_t* data = (uint8_t*)buffer;
+    for (uint32_t i = 0; i < count; i++) {
+        if (fat12_read_sector(sector + i, data + i * SECTOR_SIZE) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Returns sector in place, without copying it, when the volume is on a
+   memory-backed device, or NULL when it is not. The root directory, the
+   first FAT and staged metadata come from their in-memory copies, which
+   are newer than the device's; a FAT sector is repacked from the decoded
+   entries first. The pointer is only good until the next write to the
+   volume and must not be written through. */
+const void* fat12_map_sector(uint32_t sector) {
+    if (!fs_initialized || sector >= total_sectors) {
+        return NULL;
+    }
+    if (sector >= root_dir_start_sector && sector < root_dir_start_sector + root_dir_sectors) {
+        return root_directory + (sector - root_dir_start_sector) * SECTOR_SIZE;
+    }
+    if (sector >= fat_start_sector && sector < fat_start_sector + fat_sectors) {
+        if (fat_decoded) {
+            fat12_pack_sector(sector - fat_start_sector);
+        }
+        return fat_table + (sector - fat_start_sector) * SECTOR_SIZE;
+    }
+    int slot = meta_find(sector);
+    if (slot >= 0) {
+        return meta_stage[slot].data;
+    }
+    return fs_mapped ? block_map(fs_device, sector, 1) : NULL;
+}
+
 int fat12_write_sector(uint32_t sector, void* buffer){
-    if (sector >= root_dir_start_sector && 
-        sector < root_dir_start_sector + ((boot_sector.root_entries * 32) / SECTOR_SIZE)) {
+    if (sector >= root_dir_start_sector && sector < root_dir_start_sector + root_dir_sectors) {
         uint32_t offset = (sector - root_dir_start_sector) * SECTOR_SIZE;
         memcpy(root_directory + offset, buffer, SECTOR_SIZE);
-        return 0;
+    }
+    if (fs_mapped) {
+        return block_write(fs_device, sector, 1, buffer);
+    }
+    if (fs_device != NULL) {
+        return bcache_write(fs_device, sector, buffer);
     }
     return 0;
 }
 
-uint16_t fat12_get_next_cluster(uint16_t cluster){
-    if (cluster >= FAT12_ENTRIES){
-        return FAT12_EOF_CLUSTER;
+static int fat12_write_sectors(uint32_t sector, uint32_t count, void* buffer) {
+    if (fs_mapped && sector >= data_start_sector) {
+        return block_write(fs_device, sector, count, buffer);
+    }
+    if (fs_device != NULL && sector >= data_start_sector) {
+        return bcache_write_sectors(fs_device, sector, count, buffer);
+    }
+    uint8_t* data = (uint8_t*)buffer;
+    for (uint32_t i = 0; i < count; i++) {
+        if (fat12_write_sector(sector + i, data + i * SECTOR_SIZE) != 0) {
+            return -1;
+        }
     }
+    return 0;
+}
+
+/* Directory edits happen in root_directory; the sector holding the changed
+   entry is remembered, logged by the next commit and written home by the
+   next checkpoint. */
+static int fat12_write_dir_entry(int index) {
+    uint32_t sector = (index * sizeof(struct fat12_dir_entry)) / SECTOR_SIZE;
+    mark_dirty(dir_dirty, sector);
+    mark_dirty(dir_unlogged, sector);
+    return 0;
+}
 
+static uint16_t fat_unpack(uint16_t cluster) {
     uint32_t fat_offset = cluster + (cluster/2);
-    uint16_t nxt_cluster;
     if (cluster % 2 == 0){
-        nxt_cluster = fat_table[fat_offset] | ((fat_table[fat_offset+1] & 0x0f) << 8);
-    } else {
-        nxt_cluster = (fat_table[fat_offset] >> 4) | (fat_table[fat_offset+1] << 4);
+        return fat_table[fat_offset] | ((fat_table[fat_offset+1] & 0x0f) << 8);
     }
-    return nxt_cluster;
+    return (fat_table[fat_offset] >> 4) | (fat_table[fat_offset+1] << 4);
 }
 
-int fat12_set_next_cluster(uint16_t cluster, uint16_t next){
-    if (cluster >= FAT12_ENTRIES){
-        return -1;
-    }
+static void fat_pack(uint16_t cluster, uint16_t next) {
     uint32_t fat_offset = cluster + (cluster/2);
     if (cluster % 2 == 0){
         fat_table[fat_offset] = next & 0xFF;
@@ -115,287 +486,1709 @@ int fat12_set_next_cluster(uint16_t cluster, uint16_t next){
         fat_table[fat_offset] = (fat_table[fat_offset] & 0x0F) | ((next & 0x0F) << 4);
         fat_table[fat_offset + 1] = (next >> 4) & 0xFF;
     }
-    return 0;
 }
 
-uint16_t fat12_find_free_cluster() {
-    for (uint16_t cluster = 2; cluster < FAT12_ENTRIES; cluster++) {
-        if (fat12_get_next_cluster(cluster) == FAT12_FREE_CLUSTER) {
-            return cluster;
-        }
+/* While fat_decoded is set the FAT lives in fat_entries, one uint16_t per
+   cluster, and fat_table is only brought up to date sector by sector as
+   dirty sectors are flushed. */
+static void fat12_decode() {
+    for (uint32_t cluster = 0; cluster < fat_entry_count; cluster++) {
+        fat_entries[cluster] = fat_unpack(cluster);
     }
-    return 0;
 }
 
-static void str_to_fat_name(const char* filename, char* fat_name) {
-    int i = 0, j = 0;
-    
-    for (int k = 0; k < 11; k++) {
-        fat_name[k] = ' ';
+/* Repacks every entry with a byte in the given FAT sector, including the
+   ones straddling its edges. */
+static void fat12_pack_sector(uint32_t sector) {
+    uint32_t first = sector * SECTOR_SIZE * 2 / 3;
+    uint32_t last = ((sector + 1) * SECTOR_SIZE * 2 + 2) / 3;
+    for (uint32_t cluster = first; cluster <= last && cluster < fat_entry_count; cluster++) {
+        fat_pack(cluster, fat_entries[cluster]);
     }
-    
-    while (filename[i] && filename[i] != '.' && j < 8) {
-        if (filename[i] >= 'a' && filename[i] <= 'z') {
-            fat_name[j] = filename[i] - 'a' + 'A';
-        } else {
-            fat_name[j] = filename[i];
+}
+
+void fat12_set_decoded_fat(int enabled) {
+    if (enabled && !fat_decoded) {
+        fat12_decode();
+    } else if (!enabled && fat_decoded) {
+        for (uint32_t sector = 0; sector < fat_sectors; sector++) {
+            fat12_pack_sector(sector);
         }
-        i++;
-        j++;
     }
-    
-    if (filename[i] == '.') {
-        i++;
+    fat_decoded = enabled;
+}
+
+uint16_t fat12_get_next_cluster(uint16_t cluster){
+    if (cluster >= FAT12_ENTRIES){
+        return FAT12_EOF_CLUSTER;
+    }
+    if (cluster >= fat_entry_count) {
+        return FAT12_BAD_CLUSTER;
+    }
+    if (fat_decoded) {
+        return fat_entries[cluster];
+    }
+    return fat_unpack(cluster);
+}
+
+int fat12_set_next_cluster(uint16_t cluster, uint16_t next){
+    if (cluster >= FAT12_ENTRIES || cluster >= fat_entry_count){
+        return -1;
     }
-    
-    j = 8;
-    while (filename[i] && j < 11) {
-        if (filename[i] >= 'a' && filename[i] <= 'z') {
-            fat_name[j] = filename[i] - 'a' + 'A';
+    uint32_t fat_offset = cluster + (cluster/2);
+    // a 12-bit entry can straddle two FAT sectors
+    mark_dirty(fat_dirty, fat_offset / SECTOR_SIZE);
+    mark_dirty(fat_dirty, (fat_offset + 1) / SECTOR_SIZE);
+    mark_dirty(fat_unlogged, fat_offset / SECTOR_SIZE);
+    mark_dirty(fat_unlogged, (fat_offset + 1) / SECTOR_SIZE);
+    extent_invalidate(cluster);
+    if (cluster < cluster_limit) {
+        if (next == FAT12_FREE_CLUSTER) {
+            free_pending[cluster / 32] |= 1u << (cluster % 32);
         } else {
-            fat_name[j] = filename[i];
+            free_map[cluster / 32] &= ~(1u << (cluster % 32));
+            free_pending[cluster / 32] &= ~(1u << (cluster % 32));
         }
-        i++;
-        j++;
     }
+    if (fat_decoded) {
+        fat_entries[cluster] = next & 0xFFF;
+    } else {
+        fat_pack(cluster, next);
+    }
+    return 0;
 }
 
-static int fat_name_compare(const char* fat_name, const char* filename) {
-    char converted_name[11];
-    str_to_fat_name(filename, converted_name);
-    
-    for (int i = 0; i < 11; i++) {
-        if (fat_name[i] != converted_name[i]) {
-            return 0; 
+/* One bit per cluster, set while the cluster is free. Clusters past the end
+   of the data area or of the in-memory FAT are never marked free. */
+static void fat12_build_free_map() {
+    uint32_t data_clusters = (total_sectors - data_start_sector) / cluster_sectors;
+    cluster_limit = data_clusters + 2;
+    if (cluster_limit > FAT12_ENTRIES) {
+        cluster_limit = FAT12_ENTRIES;
+    }
+    if (cluster_limit > fat_entry_count) {
+        cluster_limit = fat_entry_count;
+    }
+    memset(free_map, 0, sizeof(free_map));
+    memset(free_pending, 0, sizeof(free_pending));
+    for (uint32_t cluster = 2; cluster < cluster_limit; cluster++) {
+        if (fat12_get_next_cluster(cluster) == FAT12_FREE_CLUSTER) {
+            free_map[cluster / 32] |= 1u << (cluster % 32);
         }
     }
-    return 1; 
+    alloc_cursor = 2;
 }
 
-int fat12_create_file(const char* name, uint8_t attributes) {
-    if (!fs_initialized) {
-        return -1;
+/* A freed cluster is only handed out again once the update that freed it
+   is committed. Until then the committed directory entries may still
+   point at it, and new data written there ahead of the commit record
+   would show up in the old file after a crash. */
+static void fat12_release_freed() {
+    for (uint32_t i = 0; i < (cluster_limit + 31) / 32; i++) {
+        free_map[i] |= free_pending[i];
+        free_pending[i] = 0;
     }
-    struct fat12_dir_entry* entries = (struct fat12_dir_entry*)root_directory;
-    for (int i = 0; i < boot_sector.root_entries; i++) {
-        if (entries[i].filename[0] == 0x00 || entries[i].filename[0] == 0xE5) {
-            memset(&entries[i], 0, sizeof(struct fat12_dir_entry));
-            str_to_fat_name(name, entries[i].filename);
-            entries[i].attributes = attributes;
-            entries[i].cluster_low = 0;
-            entries[i].file_size = 0;
-            for (uint32_t sector = 0; sector < (boot_sector.root_entries*32)/SECTOR_SIZE; sector++) {
-                fat12_write_sector(root_dir_start_sector + sector, 
-                                   root_directory + sector * SECTOR_SIZE);
-            }
-            return 0;
+}
+
+static int fat12_next_free(uint32_t from) {
+    while (from < cluster_limit) {
+        uint32_t word = free_map[from / 32] & (0xFFFFFFFF << (from % 32));
+        if (word) {
+            uint32_t cluster = (from & ~31) + bit_scan_forward(word);
+            return cluster < cluster_limit ? (int)cluster : -1;
         }
+        from = (from | 31) + 1;
     }
     return -1;
 }
 
-int fat12_delete_file(const char* name) {
-    if (!fs_initialized) {
-        return -1;
+/* Next-fit: the search resumes where the previous allocation ended and
+   wraps around once. */
+uint16_t fat12_find_free_cluster() {
+    int cluster = fat12_next_free(alloc_cursor);
+    if (cluster < 0) {
+        cluster = fat12_next_free(2);
     }
-    struct fat12_dir_entry* entries = (struct fat12_dir_entry*)root_directory;
-    for (int i = 0; i < boot_sector.root_entries; i++) {
-        if (fat_name_compare(entries[i].filename, name)) {
-            entries[i].filename[0] = 0xE5;
-            uint16_t cluster = entries[i].cluster_low;
-            while (cluster >= 2 && cluster < 0xFF8) {
-                uint16_t next = fat12_get_next_cluster(cluster);
-                fat12_set_next_cluster(cluster, FAT12_FREE_CLUSTER);
-                cluster = next;
-            }
-            return 0;
-        }
+    if (cluster < 0) {
+        return 0;
     }
-    return -1; 
+    alloc_cursor = cluster + 1;
+    return cluster;
 }
 
-int fat12_read_file(const char* name, void* buffer, uint32_t size) {
-    if (!fs_initialized) {
-        return -1;
+uint32_t fat12_cluster_size() {
+    return cluster_size;
+}
+
+uint32_t fat12_free_clusters() {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < (cluster_limit + 31) / 32; i++) {
+        uint32_t word = free_map[i];
+        while (word) {
+            word &= word - 1;
+            count++;
+        }
     }
-    struct fat12_dir_entry entry;
-    uint8_t sector_buffer[SECTOR_SIZE];
-    
-    for (uint32_t sector = 0; sector < (boot_sector.root_entries*32)/SECTOR_SIZE; sector++) {
-        fat12_read_sector(root_dir_start_sector + sector, sector_buffer);
-        
-        struct fat12_dir_entry* dir_entry = (struct fat12_dir_entry*)sector_buffer;
-        for (int i = 0; i < SECTOR_SIZE/sizeof(struct fat12_dir_entry); i++) {
-            if (fat_name_compare(dir_entry[i].filename, name)) {
-                memcpy(&entry, &dir_entry[i], sizeof(struct fat12_dir_entry));
-                goto found;
+    return count;
+}
+
+/* Finds a run of up to count free clusters, preferring the first run long
+   enough to satisfy the whole request and otherwise returning the longest
+   one seen. The clusters are not marked used. */
+uint16_t fat12_find_free_run(uint32_t count, uint32_t* run_length) {
+    uint32_t best_start = 0;
+    uint32_t best_length = 0;
+    uint32_t pos = alloc_cursor;
+    int wrapped = 0;
+
+    *run_length = 0;
+    while (1) {
+        int start = fat12_next_free(pos);
+        if (start < 0) {
+            if (wrapped || alloc_cursor <= 2) {
+                break;
             }
+            wrapped = 1;
+            pos = 2;
+            continue;
         }
-    }
-    return -1;
-    
-found:
-    if (entry.cluster_low == 0) {
-        return 0; 
-    }
-    if (fat_name_compare(entry.filename, "test.txt")) {
-        const char* test_data = "Hello, World!";
-        int len = 13;
-        if (len > size) len = size;
-        memcpy(buffer, test_data, len);
-        return len;
-    }
-    
-    uint16_t current_cluster = entry.cluster_low;
-    uint32_t bytes_read = 0;
-    uint8_t* data = (uint8_t*)buffer;
-    
-    while (current_cluster >= 2 && current_cluster < 0xFF8 && bytes_read < size) {
-        uint32_t bytes_in_cluster = size - bytes_read;
-        if (bytes_in_cluster > SECTOR_SIZE) {
-            bytes_in_cluster = SECTOR_SIZE;
-        }
-        
-        uint32_t sector = data_start_sector + (current_cluster - 2);
-        uint8_t sector_buffer[SECTOR_SIZE];
-        if (fat12_read_sector(sector, sector_buffer) != 0) {
-            return -1;
+        if (wrapped && (uint32_t)start >= alloc_cursor) {
+            break;
+        }
+        uint32_t length = 1;
+        while (length < count && start + length < cluster_limit &&
+               ((free_map[(start + length) / 32] >> ((start + length) % 32)) & 1)) {
+            length++;
+        }
+        if (length > best_length) {
+            best_start = start;
+            best_length = length;
+            if (length == count) {
+                break;
+            }
         }
-        memcpy(data + bytes_read, sector_buffer, bytes_in_cluster);
-        bytes_read += bytes_in_cluster;
-        current_cluster = fat12_get_next_cluster(current_cluster);
+        pos = start + length;
     }
-    
-    return bytes_read;
+    if (best_length > 0) {
+        alloc_cursor = best_start + best_length;
+    }
+    *run_length = best_length;
+    return best_start;
 }
 
-int fat12_write_file(const char* name, void* buffer, uint32_t size) {
-    if (!fs_initialized) {
-        return -1;
+static void fat12_free_chain(uint16_t cluster) {
+    while (cluster >= 2 && cluster < 0xFF8) {
+        uint16_t next = fat12_get_next_cluster(cluster);
+        fat12_set_next_cluster(cluster, FAT12_FREE_CLUSTER);
+        cluster = next;
+    }
+}
+
+/* Name index over the root directory: buckets hold the first entry index
+   of a chain linked through dir_index_next, keyed on the 11-byte on-disk
+   name so a lookup converts the query once. */
+static uint32_t dir_index_hash(const uint8_t* fat_name) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 11; i++) {
+        hash = (hash ^ fat_name[i]) * 16777619u;
     }
-    
+    return hash & (DIR_INDEX_BUCKETS - 1);
+}
+
+static void dir_index_insert(int index) {
     struct fat12_dir_entry* entries = (struct fat12_dir_entry*)root_directory;
-    struct fat12_dir_entry* target_entry = NULL;
-    int entry_index = -1;
-    for (int i = 0; i < boot_sector.root_entries; i++) {
-        if (fat_name_compare(entries[i].filename, name)) {
-            target_entry = &entries[i];
-            entry_index = i;
+    uint32_t bucket = dir_index_hash((const uint8_t*)&entries[index]);
+    dir_index_next[index] = dir_index_head[bucket];
+    dir_index_head[bucket] = index;
+}
+
+static void dir_index_remove(int index) {
+    struct fat12_dir_entry* entries = (struct fat12_dir_entry*)root_directory;
+    int16_t* link = &dir_index_head[dir_index_hash((const uint8_t*)&entries[index])];
+    while (*link >= 0) {
+        if (*link == index) {
+            *link = dir_index_next[index];
             break;
         }
+        link = &dir_index_next[*link];
     }
-    if (target_entry == NULL) {
-        if (fat12_create_file(name, FAT12_ATTR_ARCHIVE) != 0) {
-            return -1;
-        }
-        for (int i = 0; i < boot_sector.root_entries; i++) {
-            if (fat_name_compare(entries[i].filename, name)) {
-                target_entry = &entries[i];
-                entry_index = i;
-                break;
-            }
-        }
+    dir_index_next[index] = -1;
+}
+
+/* Long names of root entries are decoded once and kept in root_names, with
+   a second index hashed on the case-folded long name. Every character comes
+   from an LFN slot, so ROOT_NAME_POOL always fits once compacted. */
+static const char* root_long_name(int index) {
+    return root_name_offset[index] == ROOT_NAME_NONE ? NULL : root_names + root_name_offset[index];
+}
+
+static void root_name_set(int index, const char* name) {
+    uint32_t length = 0;
+    while (name[length] != '\0') {
+        length++;
     }
-    
-    if (target_entry == NULL) {
-        return -1;
+    if (root_name_used + length + 1 > ROOT_NAME_POOL) {
+        dir_index_build();
+        return;
     }
-    if (target_entry->cluster_low == 0) {
-        uint16_t first_cluster = fat12_find_free_cluster();
-        if (first_cluster == 0) {
-            return -1;
+    memcpy(root_names + root_name_used, name, length + 1);
+    root_name_offset[index] = root_name_used;
+    root_name_used += length + 1;
+    uint32_t bucket = lfn_hash(name) & (DIR_INDEX_BUCKETS - 1);
+    long_index_next[index] = long_index_head[bucket];
+    long_index_head[bucket] = index;
+}
+
+static void root_name_clear(int index) {
+    const char* name = root_long_name(index);
+    if (name == NULL) {
+        return;
+    }
+    int16_t* link = &long_index_head[lfn_hash(name) & (DIR_INDEX_BUCKETS - 1)];
+    while (*link >= 0) {
+        if (*link == index) {
+            *link = long_index_next[index];
+            break;
         }
-        fat12_set_next_cluster(first_cluster, FAT12_EOF_CLUSTER);
-        target_entry->cluster_low = first_cluster;
+        link = &long_index_next[*link];
     }
-    
-    uint16_t current_cluster = target_entry->cluster_low;
-    uint32_t bytes_written = 0;
-    uint8_t* data = (uint8_t*)buffer;
-    
-    while (bytes_written < size) {
-        uint32_t bytes_in_cluster = size - bytes_written;
-        if (bytes_in_cluster > SECTOR_SIZE) {
-            bytes_in_cluster = SECTOR_SIZE;
+    long_index_next[index] = -1;
+    root_name_offset[index] = ROOT_NAME_NONE;
+}
+
+static void dir_index_build() {
+    struct fat12_dir_entry* entries = (struct fat12_dir_entry*)root_directory;
+    struct lfn_state state;
+
+    for (int i = 0; i < DIR_INDEX_BUCKETS; i++) {
+        dir_index_head[i] = -1;
+        long_index_head[i] = -1;
+    }
+    root_name_used = 0;
+    lfn_reset(&state);
+    for (int i = 0; i < boot_sector.root_entries; i++) {
+        dir_index_next[i] = -1;
+        long_index_next[i] = -1;
+        root_name_offset[i] = ROOT_NAME_NONE;
+        if (entries[i].filename[0] == 0x00 || entries[i].filename[0] == 0xE5) {
+            lfn_reset(&state);
+            continue;
         }
-        
-        uint32_t sector = data_start_sector + (current_cluster - 2);
-        if (fat12_write_sector(sector, data + bytes_written) != 0) {
-            return -1;
+        if (entries[i].attributes == LFN_ATTRIBUTES) {
+            lfn_feed(&state, &entries[i]);
+            continue;
         }
-        
-        bytes_written += bytes_in_cluster;
-        if (bytes_written < size) {
-            uint16_t next_cluster = fat12_get_next_cluster(current_cluster);
-            if (next_cluster >= 0xFF8) {
-                uint16_t new_cluster = fat12_find_free_cluster();
-                if (new_cluster == 0) {
-                    target_entry->file_size = bytes_written;
-                    break;
-                }
-                fat12_set_next_cluster(current_cluster, new_cluster);
-                fat12_set_next_cluster(new_cluster, FAT12_EOF_CLUSTER);
-                next_cluster = new_cluster;
-            }
-            
-            current_cluster = next_cluster;
+        dir_index_insert(i);
+        const char* long_name = lfn_finish(&state, &entries[i]);
+        if (long_name != NULL) {
+            root_name_set(i, long_name);
         }
     }
-    target_entry->file_size = size;
-    for (uint32_t sector = 0; sector < (boot_sector.root_entries*32)/SECTOR_SIZE; sector++) {
-        fat12_write_sector(root_dir_start_sector + sector, 
-                           root_directory + sector * SECTOR_SIZE);
-    }
-    fat12_sync();
-    return bytes_written;
 }
 
-int fat12_list_directory(struct fat12_dir_entry* entries, int max_entries) {
-    if (!fs_initialized) {
-        return -1;
-    }
-    uint8_t sector_buffer[SECTOR_SIZE];
-    int entries_found = 0;
-    
-    for (uint32_t sector = 0; sector < (boot_sector.root_entries*32)/SECTOR_SIZE; sector++) {
-        if (fat12_read_sector(root_dir_start_sector + sector, sector_buffer) != 0) {
-            return -1;
+static int fat_name_equal(const uint8_t* a, const uint8_t* b) {
+    for (int i = 0; i < 11; i++) {
+        if (a[i] != b[i]) {
+            return 0;
         }
-        struct fat12_dir_entry* dir_entry = (struct fat12_dir_entry*)sector_buffer;
-        for (int i = 0; i < SECTOR_SIZE/sizeof(struct fat12_dir_entry); i++) {
-            if (entries_found >= max_entries) {
-                return entries_found;
-            }
-            if (dir_entry[i].filename[0] == 0x00) {
-                continue;
+    }
+    return 1;
+}
+
+static int root_find(const struct lfn_name* name) {
+    struct fat12_dir_entry* entries = (struct fat12_dir_entry*)root_directory;
+    int index;
+
+    if (name->has_short) {
+        index = dir_index_head[dir_index_hash(name->short_name)];
+        while (index >= 0) {
+            // the 11-byte name spans the filename and extension fields
+            if (fat_name_equal((const uint8_t*)&entries[index], name->short_name)) {
+                return index;
             }
-            if (dir_entry[i].filename[0] == 0xE5) {
-                continue;
+            index = dir_index_next[index];
+        }
+    }
+    if (name->needs_lfn) {
+        index = long_index_head[lfn_hash(name->name) & (DIR_INDEX_BUCKETS - 1)];
+        while (index >= 0) {
+            if (lfn_name_equal(root_long_name(index), name->name)) {
+                return index;
             }
-
-            memcpy(&entries[entries_found], &dir_entry[i], sizeof(struct fat12_dir_entry));
-            entries_found++;
+            index = long_index_next[index];
         }
     }
-    
-    return entries_found;
+    return -1;
+}
+
+/* While journaling, subdirectory sectors are edited in meta_stage rather
+   than in the buffer cache, which could write them home before the commit
+   logging them. A checkpoint writes them home and empties the table. */
+static int meta_find(uint32_t sector) {
+    for (int i = 0; i < META_STAGE_MAX; i++) {
+        if (meta_stage[i].used && meta_stage[i].sector == sector) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int meta_free_slots() {
+    int count = 0;
+    for (int i = 0; i < META_STAGE_MAX; i++) {
+        if (!meta_stage[i].used) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int meta_read_sector(uint32_t sector, void* buffer) {
+    int slot = meta_find(sector);
+    if (slot < 0) {
+        return fat12_read_sector(sector, buffer);
+    }
+    memcpy(buffer, meta_stage[slot].data, SECTOR_SIZE);
+    return 0;
+}
+
+/* Like meta_read_sector() but, on a memory-backed device, returns the
+   sector in place instead of copying it into buffer. */
+static const uint8_t* meta_view(uint32_t sector, uint8_t* buffer) {
+    if (fs_mapped && meta_find(sector) < 0) {
+        return (const uint8_t*)block_map(fs_device, sector, 1);
+    }
+    return meta_read_sector(sector, buffer) == 0 ? buffer : NULL;
+}
+
+static int meta_write_sector(uint32_t sector, const void* buffer) {
+    if (!journaling) {
+        return fat12_write_sector(sector, (void*)buffer);
+    }
+    int slot = meta_find(sector);
+    if (slot < 0) {
+        // journal_reserve() keeps this from happening mid-update
+        if (meta_free_slots() == 0 && fat12_checkpoint() != 0) {
+            return -1;
+        }
+        slot = 0;
+        while (meta_stage[slot].used) {
+            slot++;
+        }
+        meta_stage[slot].used = 1;
+        meta_stage[slot].sector = sector;
+    }
+    memcpy(meta_stage[slot].data, buffer, SECTOR_SIZE);
+    meta_stage[slot].unlogged = 1;
+    return 0;
+}
+
+/* Drops staged sectors of a directory cluster given back before anything
+   logged it. */
+static void meta_forget(uint16_t cluster) {
+    uint32_t first = cluster_to_sector(cluster);
+    for (int i = 0; i < META_STAGE_MAX; i++) {
+        if (meta_stage[i].sector >= first && meta_stage[i].sector < first + cluster_sectors) {
+            meta_stage[i].used = 0;
+        }
+    }
+}
+
+/* Directories are addressed by their first cluster, with 0 standing for
+   the root. Subdirectory entries live in their cluster chain and are
+   edited in place through the buffer cache, or the staging table above. */
+static int subdir_locate(uint16_t dir, uint32_t index, uint32_t* sector, uint32_t* offset) {
+    uint32_t byte = index * sizeof(struct fat12_dir_entry);
+    uint16_t cluster;
+    uint32_t run_length;
+    if (extent_lookup(extent_get(dir), byte / cluster_size, &cluster, &run_length) != 0) {
+        return -1;
+    }
+    *sector = cluster_to_sector(cluster) + (byte % cluster_size) / SECTOR_SIZE;
+    *offset = byte % SECTOR_SIZE;
+    return 0;
+}
+
+static int dir_entry_read(uint16_t dir, uint32_t index, struct fat12_dir_entry* entry) {
+    uint8_t sector_buffer[SECTOR_SIZE];
+    const uint8_t* data;
+    uint32_t sector, offset;
+
+    if (dir == 0) {
+        if (index >= boot_sector.root_entries) {
+            return -1;
+        }
+        memcpy(entry, root_directory + index * sizeof(struct fat12_dir_entry), sizeof(struct fat12_dir_entry));
+        return 0;
+    }
+    if (subdir_locate(dir, index, &sector, &offset) != 0 || (data = meta_view(sector, sector_buffer)) == NULL) {
+        return -1;
+    }
+    memcpy(entry, data + offset, sizeof(struct fat12_dir_entry));
+    return 0;
+}
+
+static int dir_entry_write(uint16_t dir, uint32_t index, struct fat12_dir_entry* entry) {
+    uint8_t sector_buffer[SECTOR_SIZE];
+    uint32_t sector, offset;
+
+    if (dir == 0) {
+        if (index >= boot_sector.root_entries) {
+            return -1;
+        }
+        memcpy(root_directory + index * sizeof(struct fat12_dir_entry), entry, sizeof(struct fat12_dir_entry));
+        return fat12_write_dir_entry(index);
+    }
+    if (subdir_locate(dir, index, &sector, &offset) != 0 || meta_read_sector(sector, sector_buffer) != 0) {
+        return -1;
+    }
+    memcpy(sector_buffer + offset, entry, sizeof(struct fat12_dir_entry));
+    int live = entry->filename[0] != 0x00 && entry->filename[0] != 0xE5 && entry->attributes != LFN_ATTRIBUTES;
+    dentry_update(dir, index, live, entry->attributes, entry->cluster_low);
+    return meta_write_sector(sector, sector_buffer);
+}
+
+/* Steps through a directory one entry at a time, reading subdirectories a
+   sector at a time. The returned entry is only valid until the next call
+   and must not be modified. */
+static void dir_open(struct dir_cursor* cursor, uint16_t dir) {
+    cursor->dir = dir;
+    cursor->index = 0;
+}
+
+static struct fat12_dir_entry* dir_next(struct dir_cursor* cursor) {
+    uint32_t per_sector = SECTOR_SIZE / sizeof(struct fat12_dir_entry);
+    uint32_t index = cursor->index;
+    uint32_t sector, offset;
+
+    if (cursor->dir == 0) {
+        if (index >= boot_sector.root_entries) {
+            return NULL;
+        }
+        cursor->index++;
+        return (struct fat12_dir_entry*)root_directory + index;
+    }
+    if (index % per_sector == 0 &&
+        (subdir_locate(cursor->dir, index, &sector, &offset) != 0 ||
+         (cursor->data = meta_view(sector, cursor->buffer)) == NULL)) {
+        return NULL;
+    }
+    cursor->index++;
+    return (struct fat12_dir_entry*)cursor->data + index % per_sector;
+}
+
+/* Scans a subdirectory for name in its long or short form and returns the
+   index of the short entry. */
+static int dir_scan(uint16_t dir, const struct lfn_name* name) {
+    struct dir_cursor cursor;
+    struct lfn_state state;
+    struct fat12_dir_entry* entry;
+
+    dir_open(&cursor, dir);
+    lfn_reset(&state);
+    while ((entry = dir_next(&cursor)) != NULL) {
+        if (entry->filename[0] == 0x00) {
+            break;
+        }
+        if (entry->filename[0] == 0xE5) {
+            lfn_reset(&state);
+            continue;
+        }
+        if (entry->attributes == LFN_ATTRIBUTES) {
+            lfn_feed(&state, entry);
+            continue;
+        }
+        const char* long_name = lfn_finish(&state, entry);
+        if ((name->has_short && fat_name_equal((const uint8_t*)entry, name->short_name)) ||
+            (name->needs_lfn && long_name != NULL && lfn_name_equal(long_name, name->name))) {
+            return cursor.index - 1;
+        }
+    }
+    return -1;
+}
+
+static int zero_cluster(uint16_t cluster) {
+    uint8_t zeros[SECTOR_SIZE];
+    memset(zeros, 0, SECTOR_SIZE);
+    for (uint32_t i = 0; i < cluster_sectors; i++) {
+        if (fat12_write_sector(cluster_to_sector(cluster) + i, zeros) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Appends a zeroed cluster to a full subdirectory holding slots entries. */
+static int subdir_grow(uint16_t dir, uint32_t slots) {
+    uint16_t last;
+    uint32_t run_length;
+    uint32_t clusters = slots * sizeof(struct fat12_dir_entry) / cluster_size;
+    if (clusters == 0 || extent_lookup(extent_get(dir), clusters - 1, &last, &run_length) != 0 ||
+        fat12_get_next_cluster(last) < FAT12_EOF_CLUSTER) {
+        return -1;
+    }
+    uint16_t cluster = fat12_find_free_cluster();
+    if (cluster == 0) {
+        return -1;
+    }
+    fat12_set_next_cluster(cluster, FAT12_EOF_CLUSTER);
+    if (zero_cluster(cluster) != 0) {
+        fat12_set_next_cluster(cluster, FAT12_FREE_CLUSTER);
+        return -1;
+    }
+    fat12_set_next_cluster(last, cluster);
+    return 0;
+}
+
+/* Finds count consecutive free slots, growing a subdirectory when its
+   chain runs out. The root has a fixed size. */
+static int dir_alloc_slots(uint16_t dir, uint32_t count) {
+    struct dir_cursor cursor;
+    struct fat12_dir_entry* entry;
+    uint32_t run_start = 0;
+    uint32_t run_length = 0;
+
+    dir_open(&cursor, dir);
+    while ((entry = dir_next(&cursor)) != NULL) {
+        if (entry->filename[0] != 0x00 && entry->filename[0] != 0xE5) {
+            run_length = 0;
+            continue;
+        }
+        if (run_length++ == 0) {
+            run_start = cursor.index - 1;
+        }
+        if (run_length == count) {
+            return run_start;
+        }
+    }
+    if (dir == 0) {
+        return -1;
+    }
+    uint32_t slots = cursor.index;
+    if (run_length == 0) {
+        run_start = slots;
+    }
+    while (run_length < count) {
+        if (subdir_grow(dir, slots) != 0) {
+            return -1;
+        }
+        slots += cluster_size / sizeof(struct fat12_dir_entry);
+        run_length += cluster_size / sizeof(struct fat12_dir_entry);
+    }
+    return run_start;
+}
+
+/* The root is searched through its name indexes, subdirectories through
+   the dentry cache, scanning the directory only on a miss. */
+static int dir_find(uint16_t dir, const struct lfn_name* name, uint8_t* attributes, uint16_t* cluster) {
+    struct fat12_dir_entry entry;
+    int index;
+
+    if (dir == 0) {
+        index = root_find(name);
+    } else {
+        struct fat12_dentry* dentry = dentry_lookup(dir, name->name);
+        if (dentry != NULL) {
+            if (attributes != NULL) {
+                *attributes = dentry->attributes;
+            }
+            if (cluster != NULL) {
+                *cluster = dentry->cluster;
+            }
+            return dentry->index;
+        }
+        index = dir_scan(dir, name);
+    }
+    if (index < 0 || dir_entry_read(dir, index, &entry) != 0) {
+        return -1;
+    }
+    if (dir != 0) {
+        dentry_insert(dir, name->name, index, entry.attributes, entry.cluster_low);
+    }
+    if (attributes != NULL) {
+        *attributes = entry.attributes;
+    }
+    if (cluster != NULL) {
+        *cluster = entry.cluster_low;
+    }
+    return index;
+}
+
+/* Picks the short name stored under a long one: the name itself when only
+   its case needs the LFN, otherwise the first free alias. */
+static int dir_pick_alias(uint16_t dir, const struct lfn_name* name, struct lfn_name* alias) {
+    alias->name[0] = '\0';
+    alias->length = 0;
+    alias->has_short = 1;
+    alias->needs_lfn = 0;
+    if (name->has_short) {
+        memcpy(alias->short_name, name->short_name, 11);
+        return 0;
+    }
+    for (uint32_t n = 1; n < LFN_ALIAS_TRIES; n++) {
+        lfn_make_alias(name, n, alias->short_name);
+        if ((dir == 0 ? root_find(alias) : dir_scan(dir, alias)) < 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int dir_create(uint16_t dir, const struct lfn_name* name, uint8_t attributes, uint16_t cluster) {
+    struct fat12_dir_entry entry;
+    struct lfn_name alias;
+    const uint8_t* short_name = name->short_name;
+    uint32_t lfn_count = lfn_entry_count(name);
+
+    if (dir_find(dir, name, NULL, NULL) >= 0) {
+        return -1;
+    }
+    if (name->needs_lfn) {
+        if (dir_pick_alias(dir, name, &alias) != 0) {
+            return -1;
+        }
+        short_name = alias.short_name;
+    }
+    int first = dir_alloc_slots(dir, lfn_count + 1);
+    if (first < 0) {
+        return -1;
+    }
+
+    // the slot holding the end of the name comes first on disk
+    uint8_t checksum = lfn_checksum(short_name);
+    for (uint32_t i = 0; i < lfn_count; i++) {
+        lfn_pack(name, lfn_count - i, checksum, &entry);
+        if (dir_entry_write(dir, first + i, &entry) != 0) {
+            return -1;
+        }
+    }
+    int index = first + lfn_count;
+    memset(&entry, 0, sizeof(struct fat12_dir_entry));
+    memcpy(&entry, short_name, 11);
+    entry.reserved = name->needs_lfn ? 0 : name->case_flags;
+    entry.attributes = attributes;
+    entry.cluster_low = cluster;
+    if (dir_entry_write(dir, index, &entry) != 0) {
+        return -1;
+    }
+    if (dir == 0) {
+        dir_index_insert(index);
+        if (name->needs_lfn) {
+            root_name_set(index, name->name);
+        }
+    } else {
+        dentry_insert(dir, name->name, index, attributes, cluster);
+    }
+    return index;
+}
+
+/* Marks the LFN slots in front of a short entry free along with it. Must
+   run before the short entry itself is marked, as the checksum covers its
+   first byte. */
+static void dir_remove_lfn(uint16_t dir, int index, const struct fat12_dir_entry* short_entry) {
+    struct fat12_dir_entry entry;
+    uint8_t checksum = lfn_checksum((const uint8_t*)short_entry);
+    uint8_t sequence = 1;
+
+    while (--index >= 0 && dir_entry_read(dir, index, &entry) == 0 && entry.attributes == LFN_ATTRIBUTES &&
+           (entry.filename[0] & LFN_SEQUENCE_MASK) == sequence && ((uint8_t*)&entry)[13] == checksum) {
+        int last = entry.filename[0] & LFN_LAST_ENTRY;
+        entry.filename[0] = 0xE5;
+        dir_entry_write(dir, index, &entry);
+        if (last) {
+            break;
+        }
+        sequence++;
+    }
+}
+
+/* Splits the next component off path into component, returning the rest
+   of the path or NULL once nothing is left. Components too long for a
+   name come back empty. */
+static const char* path_next(const char* path, char* component) {
+    int length = 0;
+    while (*path == '/') {
+        path++;
+    }
+    if (*path == '\0') {
+        return NULL;
+    }
+    while (*path != '\0' && *path != '/') {
+        if (length < FAT12_NAME_MAX) {
+            component[length] = *path;
+        }
+        length++;
+        path++;
+    }
+    component[length <= FAT12_NAME_MAX ? length : 0] = '\0';
+    return path;
+}
+
+static int path_is_end(const char* path) {
+    while (*path == '/') {
+        path++;
+    }
+    return *path == '\0';
+}
+
+static int is_dot(const char* component) {
+    return component[0] == '.' && component[1] == '\0';
+}
+
+static int is_dotdot(const char* component) {
+    return component[0] == '.' && component[1] == '.' && component[2] == '\0';
+}
+
+static int path_step(uint16_t* dir, const char* component) {
+    struct lfn_name name;
+    uint8_t attributes;
+    uint16_t cluster;
+
+    if (is_dot(component) || (is_dotdot(component) && *dir == 0)) {
+        return 0;
+    }
+    if (lfn_parse(component, &name) != 0 || dir_find(*dir, &name, &attributes, &cluster) < 0 ||
+        !(attributes & FAT12_ATTR_DIRECTORY)) {
+        return -1;
+    }
+    *dir = cluster;
+    return 0;
+}
+
+/* Resolves path from the root or the current directory into *dir. With
+   last given, the final component is not followed but parsed into last
+   for the caller to look up or create inside *dir. */
+static int path_walk(const char* path, uint16_t* dir, struct lfn_name* last) {
+    char component[FAT12_NAME_MAX + 1];
+    const char* rest = path;
+
+    *dir = path[0] == '/' ? 0 : cwd_cluster;
+    while ((rest = path_next(rest, component)) != NULL) {
+        if (component[0] == '\0') {
+            return -1;
+        }
+        if (last != NULL && path_is_end(rest)) {
+            if (is_dot(component) || is_dotdot(component)) {
+                return -1;
+            }
+            return lfn_parse(component, last);
+        }
+        if (path_step(dir, component) != 0) {
+            return -1;
+        }
+    }
+    return last == NULL ? 0 : -1;
+}
+
+static int subdir_empty(uint16_t dir) {
+    struct dir_cursor cursor;
+    struct fat12_dir_entry* entry;
+
+    dir_open(&cursor, dir);
+    while ((entry = dir_next(&cursor)) != NULL && entry->filename[0] != 0x00) {
+        if (entry->filename[0] != 0xE5 && entry->filename[0] != '.' && entry->attributes != LFN_ATTRIBUTES) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int dir_list(uint16_t dir, struct fat12_dir_entry* entries, int max_entries) {
+    struct dir_cursor cursor;
+    struct fat12_dir_entry* entry;
+    int entries_found = 0;
+
+    dir_open(&cursor, dir);
+    while (entries_found < max_entries && (entry = dir_next(&cursor)) != NULL) {
+        if (entry->filename[0] == 0x00) {
+            if (dir != 0) {
+                break;
+            }
+            continue;
+        }
+        if (entry->filename[0] == 0xE5 || entry->attributes == LFN_ATTRIBUTES) {
+            continue;
+        }
+        memcpy(&entries[entries_found], entry, sizeof(struct fat12_dir_entry));
+        entries_found++;
+    }
+    return entries_found;
+}
+
+/* Like dir_list but with display names: long names where present, taken
+   from root_names for the root so they are not reassembled each time. */
+static int dir_read(uint16_t dir, struct fat12_dirent* entries, int max_entries) {
+    struct dir_cursor cursor;
+    struct lfn_state state;
+    struct fat12_dir_entry* entry;
+    int entries_found = 0;
+
+    dir_open(&cursor, dir);
+    lfn_reset(&state);
+    while (entries_found < max_entries && (entry = dir_next(&cursor)) != NULL) {
+        if (entry->filename[0] == 0x00) {
+            if (dir != 0) {
+                break;
+            }
+            continue;
+        }
+        if (entry->filename[0] == 0xE5) {
+            lfn_reset(&state);
+            continue;
+        }
+        if (entry->attributes == LFN_ATTRIBUTES) {
+            if (dir != 0) {
+                lfn_feed(&state, entry);
+            }
+            continue;
+        }
+
+        struct fat12_dirent* out = &entries[entries_found++];
+        const char* long_name = dir == 0 ? root_long_name(cursor.index - 1) : lfn_finish(&state, entry);
+        if (long_name != NULL) {
+            int i = 0;
+            while (long_name[i] != '\0' && i < FAT12_NAME_MAX) {
+                out->name[i] = long_name[i];
+                i++;
+            }
+            out->name[i] = '\0';
+        } else {
+            lfn_short_display(entry, out->name);
+        }
+        out->attributes = entry->attributes;
+        out->cluster = entry->cluster_low;
+        out->size = entry->file_size;
+    }
+    return entries_found;
+}
+
+int fat12_create_file(const char* path, uint8_t attributes) {
+    struct lfn_name name;
+    uint16_t dir;
+    if (!fs_initialized || path_walk(path, &dir, &name) != 0) {
+        return -1;
+    }
+    journal_reserve();
+    return dir_create(dir, &name, attributes, 0) >= 0 ? 0 : -1;
+}
+
+/* Directories can only be removed once empty, and never while they are
+   the current directory. Removing one ends in a full sync, so the log no
+   longer holds sectors of a cluster that may next be used for file data. */
+int fat12_delete_file(const char* path) {
+    struct fat12_dir_entry entry;
+    struct lfn_name name;
+    uint16_t dir;
+
+    if (!fs_initialized || path_walk(path, &dir, &name) != 0) {
+        return -1;
+    }
+    int i = dir_find(dir, &name, NULL, NULL);
+    if (i < 0 || dir_entry_read(dir, i, &entry) != 0 ||
+        (entry.cluster_low != 0 && entry.cluster_low == journal_cluster)) {
+        return -1;
+    }
+    for (int fd = 0; fd < FAT12_MAX_OPEN; fd++) {
+        if (open_files[fd].used && open_files[fd].dir_cluster == dir && open_files[fd].entry_index == i) {
+            return -1;
+        }
+    }
+    if (entry.attributes & FAT12_ATTR_DIRECTORY) {
+        if (entry.cluster_low == cwd_cluster || !subdir_empty(entry.cluster_low)) {
+            return -1;
+        }
+        dentry_invalidate_dir(entry.cluster_low);
+    }
+    journal_reserve();
+    if (dir == 0) {
+        dir_index_remove(i);
+        root_name_clear(i);
+    }
+    dir_remove_lfn(dir, i, &entry);
+    entry.filename[0] = 0xE5;
+    fat12_free_chain(entry.cluster_low);
+    dir_entry_write(dir, i, &entry);
+    if (entry.attributes & FAT12_ATTR_DIRECTORY) {
+        return fat12_sync();
+    }
+    return fat12_commit();
+}
+
+int fat12_mkdir(const char* path) {
+    struct fat12_dir_entry entry;
+    struct lfn_name name;
+    uint16_t dir;
+
+    if (!fs_initialized || path_walk(path, &dir, &name) != 0 || dir_find(dir, &name, NULL, NULL) >= 0) {
+        return -1;
+    }
+    journal_reserve();
+    uint16_t cluster = fat12_find_free_cluster();
+    if (cluster == 0) {
+        return -1;
+    }
+    fat12_set_next_cluster(cluster, FAT12_EOF_CLUSTER);
+    dentry_invalidate_dir(cluster);
+    if (zero_cluster(cluster) != 0) {
+        fat12_set_next_cluster(cluster, FAT12_FREE_CLUSTER);
+        return -1;
+    }
+
+    memset(&entry, 0, sizeof(struct fat12_dir_entry));
+    memcpy(&entry, ".          ", 11);
+    entry.attributes = FAT12_ATTR_DIRECTORY;
+    entry.cluster_low = cluster;
+    dir_entry_write(cluster, 0, &entry);
+    memcpy(&entry, "..         ", 11);
+    entry.cluster_low = dir;
+    dir_entry_write(cluster, 1, &entry);
+
+    if (dir_create(dir, &name, FAT12_ATTR_DIRECTORY, cluster) < 0) {
+        meta_forget(cluster);
+        fat12_free_chain(cluster);
+        return -1;
+    }
+    return fat12_commit();
+}
+
+/* cwd_path is kept normalised, so "." and ".." are folded into it here
+   rather than stored. */
+int fat12_chdir(const char* path) {
+    char new_path[FAT12_MAX_PATH];
+    char component[FAT12_NAME_MAX + 1];
+    const char* rest = path;
+    uint16_t dir;
+    int length = 0;
+
+    if (!fs_initialized || path_walk(path, &dir, NULL) != 0) {
+        return -1;
+    }
+    if (path[0] != '/') {
+        while (cwd_path[length] != '\0') {
+            new_path[length] = cwd_path[length];
+            length++;
+        }
+    }
+    if (length == 0) {
+        new_path[length++] = '/';
+    }
+    while ((rest = path_next(rest, component)) != NULL) {
+        if (is_dot(component)) {
+            continue;
+        }
+        if (is_dotdot(component)) {
+            while (length > 1 && new_path[length - 1] != '/') {
+                length--;
+            }
+            if (length > 1) {
+                length--;
+            }
+            continue;
+        }
+        if (length > 1) {
+            new_path[length++] = '/';
+        }
+        for (int i = 0; component[i] != '\0'; i++) {
+            if (length >= FAT12_MAX_PATH - 1) {
+                return -1;
+            }
+            new_path[length++] = component[i];
+        }
+    }
+    new_path[length] = '\0';
+    memcpy(cwd_path, new_path, length + 1);
+    cwd_cluster = dir;
+    return 0;
+}
+
+const char* fat12_getcwd() {
+    return cwd_path;
+}
+
+int fat12_read_file(const char* path, void* buffer, uint32_t size) {
+    if (!fs_initialized) {
+        return -1;
+    }
+    struct fat12_file file;
+    if (fat12_open_entry(&file, path, FAT12_O_READ) != 0) {
+        return -1;
+    }
+    return file_read(&file, buffer, size);
+}
+
+int fat12_write_file(const char* path, void* buffer, uint32_t size) {
+    if (!fs_initialized) {
+        return -1;
+    }
+    struct fat12_file file;
+    if (fat12_open_entry(&file, path, FAT12_O_WRITE | FAT12_O_CREATE | FAT12_O_TRUNC) != 0) {
+        return -1;
+    }
+    int bytes_written = file_write(&file, buffer, size);
+    if (file_close(&file) != 0) {
+        return -1;
+    }
+    return bytes_written;
+}
+
+static uint32_t cluster_to_sector(uint16_t cluster) {
+    return data_start_sector + (cluster - 2) * cluster_sectors;
+}
+
+/* Handles keep the cluster run holding the last offset they touched, so
+   sequential access never goes back to the FAT and a seek only costs an
+   extent-map search. */
+static int file_cluster_at(struct fat12_file* file, uint32_t index, uint16_t* cluster, uint32_t* run_length) {
+    if (file->run_length == 0 || index < file->run_index || index >= file->run_index + file->run_length) {
+        uint16_t start;
+        uint32_t length;
+        if (extent_lookup(extent_get(file->first_cluster), index, &start, &length) != 0) {
+            return -1;
+        }
+        file->run_index = index;
+        file->run_cluster = start;
+        file->run_length = length;
+    }
+    *cluster = file->run_cluster + (index - file->run_index);
+    *run_length = file->run_length - (index - file->run_index);
+    return 0;
+}
+
+/* Extends the chain to clusters_needed clusters, reusing any clusters
+   already linked past the last one in use and otherwise appending
+   contiguous free runs after the current tail. */
+static uint32_t file_grow(struct fat12_file* file, uint32_t clusters_needed) {
+    while (file->clusters < clusters_needed) {
+        uint16_t last = 0;
+        uint32_t run;
+        if (file->clusters > 0) {
+            if (file_cluster_at(file, file->clusters - 1, &last, &run) != 0) {
+                break;
+            }
+            uint16_t next = fat12_get_next_cluster(last);
+            if (next >= 2 && next < 0xFF8) {
+                file->clusters++;
+                continue;
+            }
+        }
+        uint16_t start = fat12_find_free_run(clusters_needed - file->clusters, &run);
+        if (run == 0) {
+            break;
+        }
+        for (uint32_t i = 0; i < run; i++) {
+            fat12_set_next_cluster(start + i, i + 1 < run ? start + i + 1 : FAT12_EOF_CLUSTER);
+        }
+        if (last) {
+            fat12_set_next_cluster(last, start);
+        } else {
+            file->first_cluster = start;
+        }
+        file->clusters += run;
+        file->run_length = 0;
+    }
+    return file->clusters;
+}
+
+/* Keeps up to readahead_window clusters past the reader's position queued
+   in the block cache, topping the window up once half of it is consumed. */
+static void file_readahead(struct fat12_file* file) {
+    uint32_t next = file->offset / cluster_size;
+    uint32_t end = next + readahead_window;
+    uint32_t clusters = (file->size + cluster_size - 1) / cluster_size;
+
+    if (fs_device == NULL || readahead_window == 0) {
+        return;
+    }
+    if (end > clusters) {
+        end = clusters;
+    }
+    if (fs_mapped) {
+        return;
+    }
+    if (file->ra_index < next) {
+        file->ra_index = next;
+    }
+    if (file->ra_index >= end || file->ra_index - next > readahead_window / 2) {
+        return;
+    }
+    while (file->ra_index < end) {
+        uint16_t start;
+        uint32_t length;
+        if (extent_lookup(extent_get(file->first_cluster), file->ra_index, &start, &length) != 0) {
+            return;
+        }
+        if (length > end - file->ra_index) {
+            length = end - file->ra_index;
+        }
+        int issued = bcache_prefetch(fs_device, cluster_to_sector(start), length * cluster_sectors);
+        if (issued < (int)cluster_sectors) {
+            return;
+        }
+        file->ra_index += issued / cluster_sectors;
+    }
+}
+
+static int file_read(struct fat12_file* file, void* buffer, uint32_t size) {
+    uint8_t* data = (uint8_t*)buffer;
+    uint32_t bytes_read = 0;
+    int sequential = file->offset == file->ra_next;
+
+    if (!sequential) {
+        file->ra_index = 0;
+    }
+    if (file->offset >= file->size) {
+        return 0;
+    }
+    if (size > file->size - file->offset) {
+        size = file->size - file->offset;
+    }
+    // whole sectors go straight to the caller, one request per contiguous run
+    while (bytes_read < size) {
+        uint16_t cluster;
+        uint32_t run_length;
+        uint32_t within = file->offset % SECTOR_SIZE;
+        uint32_t file_sector = file->offset / SECTOR_SIZE;
+        if (file_cluster_at(file, file_sector / cluster_sectors, &cluster, &run_length) != 0) {
+            break;
+        }
+        uint32_t sector = cluster_to_sector(cluster) + file_sector % cluster_sectors;
+        uint32_t run_sectors = run_length * cluster_sectors - file_sector % cluster_sectors;
+        uint32_t chunk;
+        if (within == 0 && size - bytes_read >= SECTOR_SIZE) {
+            uint32_t count = (size - bytes_read) / SECTOR_SIZE;
+            if (count > run_sectors) {
+                count = run_sectors;
+            }
+            if (fat12_read_sectors(sector, count, data + bytes_read) != 0) {
+                return -1;
+            }
+            chunk = count * SECTOR_SIZE;
+        } else {
+            uint8_t* sector_buffer = NULL;
+            const uint8_t* src = fs_mapped ? (const uint8_t*)block_map(fs_device, sector, 1) : NULL;
+            if (src == NULL) {
+                sector_buffer = kmem_cache_alloc(sector_cache);
+                if (sector_buffer == NULL || fat12_read_sector(sector, sector_buffer) != 0) {
+                    kmem_cache_free(sector_cache, sector_buffer);
+                    return -1;
+                }
+                src = sector_buffer;
+            }
+            chunk = SECTOR_SIZE - within;
+            if (chunk > size - bytes_read) {
+                chunk = size - bytes_read;
+            }
+            memcpy(data + bytes_read, src + within, chunk);
+            kmem_cache_free(sector_cache, sector_buffer);
+        }
+        bytes_read += chunk;
+        file->offset += chunk;
+    }
+    file->ra_next = file->offset;
+    if (sequential) {
+        file_readahead(file);
+    }
+    return bytes_read;
+}
+
+static int file_write(struct fat12_file* file, const void* buffer, uint32_t size) {
+    const uint8_t* data = (const uint8_t*)buffer;
+    uint32_t bytes_written = 0;
+
+    if (file->flags & FAT12_O_APPEND) {
+        file->offset = file->size;
+    }
+    if (file->offset > file->size) {
+        uint8_t* zeros = kmem_cache_alloc(sector_cache);
+        uint32_t target = file->offset;
+        if (zeros == NULL) {
+            return -1;
+        }
+        memset(zeros, 0, SECTOR_SIZE);
+        file->offset = file->size;
+        while (file->offset < target) {
+            uint32_t gap = target - file->offset;
+            if (file_write(file, zeros, gap < SECTOR_SIZE ? gap : SECTOR_SIZE) <= 0) {
+                kmem_cache_free(sector_cache, zeros);
+                return -1;
+            }
+        }
+        kmem_cache_free(sector_cache, zeros);
+    }
+    uint32_t clusters_needed = (file->offset + size + cluster_size - 1) / cluster_size;
+    uint32_t clusters = file_grow(file, clusters_needed);
+    if (clusters < clusters_needed) {
+        if (clusters * cluster_size <= file->offset) {
+            return -1;
+        }
+        size = clusters * cluster_size - file->offset;
+    }
+
+    while (bytes_written < size) {
+        uint16_t cluster;
+        uint32_t run_length;
+        uint32_t within = file->offset % SECTOR_SIZE;
+        uint32_t file_sector = file->offset / SECTOR_SIZE;
+        if (file_cluster_at(file, file_sector / cluster_sectors, &cluster, &run_length) != 0) {
+            return -1;
+        }
+        uint32_t sector = cluster_to_sector(cluster) + file_sector % cluster_sectors;
+        uint32_t run_sectors = run_length * cluster_sectors - file_sector % cluster_sectors;
+        uint32_t chunk;
+        if (within == 0 && size - bytes_written >= SECTOR_SIZE) {
+            uint32_t count = (size - bytes_written) / SECTOR_SIZE;
+            if (count > run_sectors) {
+                count = run_sectors;
+            }
+            if (fat12_write_sectors(sector, count, (void*)(data + bytes_written)) != 0) {
+                return -1;
+            }
+            chunk = count * SECTOR_SIZE;
+        } else {
+            // partial sector: merge with what is already on disk unless the
+            // sector lies wholly past the end of the file
+            uint8_t* sector_buffer = kmem_cache_alloc(sector_cache);
+            if (sector_buffer == NULL) {
+                return -1;
+            }
+            if (file->offset - within >= file->size) {
+                memset(sector_buffer, 0, SECTOR_SIZE);
+            } else if (fat12_read_sector(sector, sector_buffer) != 0) {
+                kmem_cache_free(sector_cache, sector_buffer);
+                return -1;
+            }
+            chunk = SECTOR_SIZE - within;
+            if (chunk > size - bytes_written) {
+                chunk = size - bytes_written;
+            }
+            memcpy(sector_buffer + within, data + bytes_written, chunk);
+            int status = fat12_write_sector(sector, sector_buffer);
+            kmem_cache_free(sector_cache, sector_buffer);
+            if (status != 0) {
+                return -1;
+            }
+        }
+        bytes_written += chunk;
+        file->offset += chunk;
+        if (file->offset > file->size) {
+            file->size = file->offset;
+        }
+    }
+    file->modified = 1;
+    return bytes_written;
+}
+
+/* Handles cache the chain of their file, so an entry may be open for
+   reading by any number of them or for writing by one alone. */
+static int entry_in_use(uint16_t dir, int index, int flags) {
+    for (int fd = 0; fd < FAT12_MAX_OPEN; fd++) {
+        struct fat12_file* other = &open_files[fd];
+        if (other->used && other->dir_cluster == dir && other->entry_index == index &&
+            ((flags & (FAT12_O_WRITE | FAT12_O_TRUNC)) || (other->flags & (FAT12_O_WRITE | FAT12_O_TRUNC)))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int fat12_open_entry(struct fat12_file* file, const char* path, int flags) {
+    struct fat12_dir_entry entry;
+    struct lfn_name name;
+    uint16_t dir;
+
+    if (path_walk(path, &dir, &name) != 0) {
+        return -1;
+    }
+    if (flags & (FAT12_O_WRITE | FAT12_O_CREATE)) {
+        journal_reserve();
+    }
+    int index = dir_find(dir, &name, NULL, NULL);
+    if (index < 0 && (flags & FAT12_O_CREATE)) {
+        index = dir_create(dir, &name, FAT12_ATTR_ARCHIVE, 0);
+    }
+    if (index < 0 || dir_entry_read(dir, index, &entry) != 0) {
+        return -1;
+    }
+    if ((entry.attributes & FAT12_ATTR_DIRECTORY) ||
+        ((flags & FAT12_O_WRITE) && (entry.attributes & FAT12_ATTR_READ_ONLY)) ||
+        entry_in_use(dir, index, flags)) {
+        return -1;
+    }
+
+    file->used = 1;
+    file->flags = flags;
+    file->dir_cluster = dir;
+    file->entry_index = index;
+    file->first_cluster = entry.cluster_low;
+    file->size = entry.file_size;
+    file->offset = 0;
+    file->clusters = (file->size + cluster_size - 1) / cluster_size;
+    if (file->clusters == 0 && file->first_cluster != 0) {
+        file->clusters = 1;
+    }
+    file->run_length = 0;
+    file->ra_next = 0;
+    file->ra_index = 0;
+    file->modified = 0;
+    if ((flags & FAT12_O_TRUNC) && (flags & FAT12_O_WRITE)) {
+        fat12_free_chain(file->first_cluster);
+        file->first_cluster = 0;
+        file->size = 0;
+        file->clusters = 0;
+        file->modified = 1;
+    }
+    return 0;
+}
+
+static int file_close(struct fat12_file* file) {
+    file->used = 0;
+    if (!file->modified) {
+        return 0;
+    }
+    struct fat12_dir_entry entry;
+    if (dir_entry_read(file->dir_cluster, file->entry_index, &entry) != 0) {
+        return -1;
+    }
+    entry.cluster_low = file->first_cluster;
+    entry.file_size = file->size;
+    if (dir_entry_write(file->dir_cluster, file->entry_index, &entry) != 0) {
+        return -1;
+    }
+    return fat12_commit();
+}
+
+static struct fat12_file* fat12_get_handle(int fd) {
+    if (fd < 0 || fd >= FAT12_MAX_OPEN || !open_files[fd].used) {
+        return NULL;
+    }
+    return &open_files[fd];
+}
+
+int fat12_open(const char* path, int flags) {
+    if (!fs_initialized) {
+        return -1;
+    }
+    for (int fd = 0; fd < FAT12_MAX_OPEN; fd++) {
+        if (!open_files[fd].used) {
+            if (fat12_open_entry(&open_files[fd], path, flags) != 0) {
+                return -1;
+            }
+            return fd;
+        }
+    }
+    return -1;
+}
+
+int fat12_read(int fd, void* buffer, uint32_t size) {
+    struct fat12_file* file = fat12_get_handle(fd);
+    if (file == NULL || !(file->flags & FAT12_O_READ)) {
+        return -1;
+    }
+    return file_read(file, buffer, size);
+}
+
+int fat12_write(int fd, const void* buffer, uint32_t size) {
+    struct fat12_file* file = fat12_get_handle(fd);
+    if (file == NULL || !(file->flags & FAT12_O_WRITE)) {
+        return -1;
+    }
+    return file_write(file, buffer, size);
+}
+
+/* Seeking past the end is allowed; the gap is zero-filled by the next
+   write. Returns the new offset. */
+int fat12_seek(int fd, int32_t offset, int whence) {
+    struct fat12_file* file = fat12_get_handle(fd);
+    if (file == NULL) {
+        return -1;
+    }
+    int32_t base = 0;
+    if (whence == FAT12_SEEK_CUR) {
+        base = file->offset;
+    } else if (whence == FAT12_SEEK_END) {
+        base = file->size;
+    } else if (whence != FAT12_SEEK_SET) {
+        return -1;
+    }
+    if (base + offset < 0) {
+        return -1;
+    }
+    file->offset = base + offset;
+    return file->offset;
+}
+
+int fat12_close(int fd) {
+    struct fat12_file* file = fat12_get_handle(fd);
+    if (file == NULL) {
+        return -1;
+    }
+    return file_close(file);
+}
+
+int fat12_set_readahead(uint32_t clusters) {
+    if (clusters > FAT12_READAHEAD_MAX) {
+        return -1;
+    }
+    readahead_window = clusters;
+    return 0;
+}
+
+uint32_t fat12_get_readahead() {
+    return readahead_window;
+}
+
+int fat12_list_directory(struct fat12_dir_entry* entries, int max_entries) {
+    if (!fs_initialized) {
+        return -1;
+    }
+    return dir_list(cwd_cluster, entries, max_entries);
+}
+
+int fat12_list_path(const char* path, struct fat12_dir_entry* entries, int max_entries) {
+    uint16_t dir;
+    if (!fs_initialized || path_walk(path, &dir, NULL) != 0) {
+        return -1;
+    }
+    return dir_list(dir, entries, max_entries);
+}
+
+int fat12_read_dir(const char* path, struct fat12_dirent* entries, int max_entries) {
+    uint16_t dir;
+    if (!fs_initialized || path_walk(path, &dir, NULL) != 0) {
+        return -1;
+    }
+    return dir_read(dir, entries, max_entries);
 }
 
 int fat12_is_initialized() {
     return fs_initialized;
 }
 
-int fat12_sync() {
+/* Replayed records go straight to the device. Commits only log the first
+   FAT copy, so its records are written to every copy. */
+static int journal_apply(uint32_t sector, const void* data) {
+    if (sector >= total_sectors || block_write(fs_device, sector, 1, data) != 0) {
+        return -1;
+    }
+    if (sector >= fat_start_sector && sector < fat_start_sector + boot_sector.sectors_per_fat) {
+        for (int i = 1; i < boot_sector.fat_count; i++) {
+            if (block_write(fs_device, sector + i * boot_sector.sectors_per_fat, 1, data) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The log lives in JOURNAL.SYS, a hidden system file in the root whose
+   clusters must form a single run. Transactions left in it by a crash are
+   replayed before anything else looks at the volume. */
+static int journal_mount() {
+    struct fat12_dir_entry entry;
+    struct lfn_name name;
+
+    if (lfn_parse(JOURNAL_NAME, &name) != 0) {
+        return 0;
+    }
+    int index = root_find(&name);
+    if (index < 0 || dir_entry_read(0, index, &entry) != 0) {
+        return 0;
+    }
+    uint16_t first = entry.cluster_low;
+    uint32_t sectors = entry.file_size / SECTOR_SIZE;
+    uint32_t clusters = (entry.file_size + cluster_size - 1) / cluster_size;
+    if (first < 2 || sectors < 2 || cluster_to_sector(first) + sectors > total_sectors) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < clusters; i++) {
+        uint16_t next = fat12_get_next_cluster(first + i);
+        if (i + 1 < clusters ? next != first + i + 1 : next < FAT12_EOF_CLUSTER) {
+            return 0;
+        }
+    }
+    journal_cluster = first;
+    if (journal_open(fs_device, cluster_to_sector(first), sectors) != 0) {
+        journal_format(fs_device, cluster_to_sector(first), sectors);
+        return 0;
+    }
+
+    int replayed = journal_replay(journal_apply);
+    if (replayed <= 0) {
+        return replayed;
+    }
+    // the home locations now hold the logged state, so load it again
+    if (block_flush(fs_device) != 0 || journal_reset() != 0) {
+        return -1;
+    }
+    bcache_invalidate(fs_device);
+    if (fat12_load() != 0) {
+        return -1;
+    }
+    fat12_decode();
+    dir_index_build();
+    return 0;
+}
+
+/* Gives a volume without a log one when a long enough run of clusters is
+   free. Without it every commit writes metadata straight home. */
+static void journal_create() {
+    struct fat12_dir_entry entry;
+    struct lfn_name name;
+    uint32_t run_length;
+    uint32_t clusters = (JOURNAL_SECTORS * SECTOR_SIZE + cluster_size - 1) / cluster_size;
+
+    uint16_t first = fat12_find_free_run(clusters, &run_length);
+    if (run_length < clusters || lfn_parse(JOURNAL_NAME, &name) != 0 ||
+        journal_format(fs_device, cluster_to_sector(first), clusters * cluster_sectors) != 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < clusters; i++) {
+        fat12_set_next_cluster(first + i, i + 1 < clusters ? first + i + 1 : FAT12_EOF_CLUSTER);
+    }
+    int index = dir_create(0, &name, FAT12_ATTR_READ_ONLY | FAT12_ATTR_HIDDEN | FAT12_ATTR_SYSTEM, first);
+    if (index < 0 || dir_entry_read(0, index, &entry) != 0) {
+        fat12_free_chain(first);
+        journal_close();
+        return;
+    }
+    entry.file_size = clusters * cluster_size;
+    dir_entry_write(0, index, &entry);
+    journal_cluster = first;
+    fat12_checkpoint();
+}
+
+/* Checkpoints ahead of an update whenever the log or the staging table
+   might not take everything it could leave unlogged, so that its commit
+   always fits. */
+static void journal_reserve() {
+    if (journaling && (journal_free() < 1 + fat_sectors + root_dir_sectors + META_STAGE_MAX ||
+                       meta_free_slots() < META_STAGE_RESERVE)) {
+        fat12_sync();
+    }
+}
+
+/* Ends an update: file data reaches the medium first, past the drive's
+   write cache, then every FAT, root and staged sector changed since the
+   last commit goes to the log in one write. They stay dirty until a
+   checkpoint writes them home; the clusters the update freed are free
+   for reuse from here. */
+static int fat12_commit() {
+    int records = 0;
+    int failed = 0;
+
+    if (!journaling) {
+        return fat12_checkpoint();
+    }
+    if (bcache_flush(fs_device) != 0 || block_flush(fs_device) != 0) {
+        return -1;
+    }
+    journal_begin();
+    for (uint32_t j = 0; j < fat_sectors; j++) {
+        if (test_dirty(fat_unlogged, j)) {
+            if (fat_decoded) {
+                fat12_pack_sector(j);
+            }
+            failed |= journal_add(fat_start_sector + j, fat_table + (j * SECTOR_SIZE));
+            records++;
+        }
+    }
+    for (uint32_t j = 0; j < root_dir_sectors; j++) {
+        if (test_dirty(dir_unlogged, j)) {
+            failed |= journal_add(root_dir_start_sector + j, root_directory + (j * SECTOR_SIZE));
+            records++;
+        }
+    }
+    for (int i = 0; i < META_STAGE_MAX; i++) {
+        if (meta_stage[i].used && meta_stage[i].unlogged) {
+            failed |= journal_add(meta_stage[i].sector, meta_stage[i].data);
+            records++;
+        }
+    }
+    if (records == 0) {
+        fat12_release_freed();
+        return 0;
+    }
+    if (failed || journal_commit() != 0) {
+        return fat12_checkpoint();
+    }
+    fat12_release_freed();
+    memset(fat_unlogged, 0, sizeof(fat_unlogged));
+    memset(dir_unlogged, 0, sizeof(dir_unlogged));
+    for (int i = 0; i < META_STAGE_MAX; i++) {
+        meta_stage[i].unlogged = 0;
+    }
+    return 0;
+}
+
+/* Only FAT and directory sectors touched since the last checkpoint are
+   written, with every dirty FAT sector repacked from the decoded table
+   once and then going to each FAT copy. Afterwards nothing in the log is
+   needed any more. */
+static int fat12_checkpoint() {
     for (int i = 0; i < boot_sector.fat_count; i++) {
         uint32_t fat_sector = fat_start_sector + (i * boot_sector.sectors_per_fat);
-        for (int j = 0; j < boot_sector.sectors_per_fat; j++) {
-            fat12_write_sector(fat_sector + j, fat_table + (j * SECTOR_SIZE));
+        for (uint32_t j = 0; j < fat_sectors; j++) {
+            if (test_dirty(fat_dirty, j)) {
+                if (fat_decoded && i == 0) {
+                    fat12_pack_sector(j);
+                }
+                fat12_write_sector(fat_sector + j, fat_table + (j * SECTOR_SIZE));
+            }
         }
     }
-    for (uint32_t sector = 0; sector < (boot_sector.root_entries*32)/SECTOR_SIZE; sector++) {
-        fat12_write_sector(root_dir_start_sector + sector, 
-                           root_directory + sector * SECTOR_SIZE);
+    memset(fat_dirty, 0, sizeof(fat_dirty));
+    memset(fat_unlogged, 0, sizeof(fat_unlogged));
+
+    for (uint32_t j = 0; j < root_dir_sectors; j++) {
+        if (test_dirty(dir_dirty, j)) {
+            fat12_write_sector(root_dir_start_sector + j, root_directory + (j * SECTOR_SIZE));
+        }
+    }
+    memset(dir_dirty, 0, sizeof(dir_dirty));
+    memset(dir_unlogged, 0, sizeof(dir_unlogged));
+
+    for (int i = 0; i < META_STAGE_MAX; i++) {
+        if (meta_stage[i].used) {
+            fat12_write_sector(meta_stage[i].sector, meta_stage[i].data);
+            meta_stage[i].used = 0;
+            meta_stage[i].unlogged = 0;
+        }
+    }
+
+    if (fs_device != NULL) {
+        if (bcache_flush(fs_device) != 0 || block_flush(fs_device) != 0) {
+            return -1;
+        }
+        fat12_release_freed();
+        return journal_reset();
     }
-    
+    fat12_release_freed();
     return 0;
-}
\ No newline at end of file
+}
+
+/* Commits whatever is pending and checkpoints it, leaving the log empty
+   and every structure in its home location. */
+int fat12_sync() {
+    if (journaling && fat12_commit() != 0) {
+        return -1;
+    }
+    return fat12_checkpoint();
+}
+
+/* Switching the log off checkpoints first so nothing is left to replay.
+   Fails when asked to switch it on for a volume without one. */
+int fat12_set_journaling(int enabled) {
+    journaling_wanted = enabled != 0;
+    if (!fs_initialized) {
+        return 0;
+    }
+    if (fat12_sync() != 0) {
+        return -1;
+    }
+    journaling = journaling_wanted && journal_is_open();
+    return journaling == journaling_wanted ? 0 : -1;
+}
+
+int fat12_journaling() {
+    return journaling;
+}
@@ -2,6 +2,7 @@
 #define FAT12_H
 
 #include "../kernel/kernel.h"
+#include "../kernel/block.h"
 
 /* Definitions */
 #define SECTOR_SIZE 512
@@ -15,6 +16,19 @@
 #define FAT12_ATTR_VOLUME_ID  0x08
 #define FAT12_ATTR_DIRECTORY  0x10
 #define FAT12_ATTR_ARCHIVE    0x20
+#define FAT12_MAX_OPEN 8
+#define FAT12_O_READ   0x01
+#define FAT12_O_WRITE  0x02
+#define FAT12_O_CREATE 0x04
+#define FAT12_O_TRUNC  0x08
+#define FAT12_O_APPEND 0x10
+#define FAT12_SEEK_SET 0
+#define FAT12_SEEK_CUR 1
+#define FAT12_SEEK_END 2
+#define FAT12_READAHEAD_DEFAULT 8
+#define FAT12_READAHEAD_MAX 32
+#define FAT12_NAME_MAX 255
+#define FAT12_MAX_PATH 256
 
 /* Struct Creation */
 struct fat12_boot_sector {
@@ -56,19 +70,63 @@ struct fat12_dir_entry {
     uint32_t file_size;        
 } __attribute__((packed));
 
+struct fat12_dirent {
+    char name[FAT12_NAME_MAX + 1];
+    uint8_t attributes;
+    uint16_t cluster;
+    uint32_t size;
+};
+
+struct fat12_file {
+    uint8_t used;
+    uint8_t flags;
+    uint8_t modified;
+    uint16_t dir_cluster;
+    int entry_index;
+    uint16_t first_cluster;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t clusters;
+    uint32_t run_index;
+    uint16_t run_cluster;
+    uint32_t run_length;
+    uint32_t ra_next;
+    uint32_t ra_index;
+};
+
 /* Function Declarations */
-int fat12_init();
+int fat12_init(struct block_device* dev, int io_mode);
 int fat12_read_sector(uint32_t sector, void* buffer);
+int fat12_read_sectors(uint32_t sector, uint32_t count, void* buffer);
+const void* fat12_map_sector(uint32_t sector);
 int fat12_write_sector(uint32_t sector, void* buffer);
 uint16_t fat12_get_next_cluster(uint16_t cluster);
 int fat12_set_next_cluster(uint16_t cluster, uint16_t next);
+void fat12_set_decoded_fat(int enabled);
 uint16_t fat12_find_free_cluster();
-int fat12_create_file(const char* name, uint8_t attributes);
-int fat12_delete_file(const char* name);
-int fat12_read_file(const char* name, void* buffer, uint32_t size);
-int fat12_write_file(const char* name, void* buffer, uint32_t size);
+uint16_t fat12_find_free_run(uint32_t count, uint32_t* run_length);
+uint32_t fat12_free_clusters();
+uint32_t fat12_cluster_size();
+int fat12_create_file(const char* path, uint8_t attributes);
+int fat12_delete_file(const char* path);
+int fat12_read_file(const char* path, void* buffer, uint32_t size);
+int fat12_write_file(const char* path, void* buffer, uint32_t size);
+int fat12_open(const char* path, int flags);
+int fat12_read(int fd, void* buffer, uint32_t size);
+int fat12_write(int fd, const void* buffer, uint32_t size);
+int fat12_seek(int fd, int32_t offset, int whence);
+int fat12_close(int fd);
+int fat12_set_readahead(uint32_t clusters);
+uint32_t fat12_get_readahead();
 int fat12_list_directory(struct fat12_dir_entry* entries, int max_entries);
+int fat12_list_path(const char* path, struct fat12_dir_entry* entries, int max_entries);
+int fat12_read_dir(const char* path, struct fat12_dirent* entries, int max_entries);
+int fat12_mkdir(const char* path);
+int fat12_chdir(const char* path);
+const char* fat12_getcwd();
 int fat12_is_initialized();
 int fat12_sync();
+int fat12_set_journaling(int enabled);
+int fat12_journaling();
 
 #endif
\ No newline at end of file
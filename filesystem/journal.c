@@ -0,0 +1,218 @@
+/* Libraries */
+#include "journal.h"
+#include "../kernel/mem.h"
+
+/* Function Declarations */
+static uint32_t crc32(uint32_t crc, const uint8_t* data, uint32_t length);
+static uint32_t tx_checksum(uint32_t count);
+static int write_super(uint32_t sequence);
+
+/* Global Variables */
+static struct block_device* journal_dev = NULL;
+static uint32_t journal_start = 0;
+static uint32_t journal_sectors = 0;
+static uint32_t journal_head = 1;
+static uint32_t journal_sequence = 1;
+static uint32_t tx_count = 0;
+static uint8_t tx_buffer[JOURNAL_TX_MAX * BLOCK_SECTOR_SIZE];
+static uint32_t crc_table[256];
+static int crc_ready = 0;
+static struct journal_stats stats;
+
+/* The log is a superblock followed by transactions written back to back.
+   Each transaction is a header listing the home sector of every record,
+   then the records, all checksummed together and written with a single
+   request, so a torn write fails the checksum and is never replayed. The
+   superblock names the sequence number the log starts at; a checkpoint
+   bumps it, which retires every transaction already in the log. */
+static uint32_t crc32(uint32_t crc, const uint8_t* data, uint32_t length) {
+    if (!crc_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+        crc_ready = 1;
+    }
+    crc = ~crc;
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t tx_checksum(uint32_t count) {
+    struct journal_header* header = (struct journal_header*)tx_buffer;
+    uint32_t saved = header->checksum;
+    header->checksum = 0;
+    uint32_t crc = crc32(0, tx_buffer, (count + 1) * BLOCK_SECTOR_SIZE);
+    header->checksum = saved;
+    return crc;
+}
+
+static int write_super(uint32_t sequence) {
+    uint8_t sector[BLOCK_SECTOR_SIZE];
+    struct journal_header* super = (struct journal_header*)sector;
+    memset(sector, 0, BLOCK_SECTOR_SIZE);
+    super->magic = JOURNAL_SUPER_MAGIC;
+    super->sequence = sequence;
+    super->count = journal_sectors;
+    if (block_write(journal_dev, journal_start, 1, sector) != 0) {
+        return -1;
+    }
+    return block_flush(journal_dev);
+}
+
+int journal_format(struct block_device* dev, uint32_t start, uint32_t sectors) {
+    if (dev == NULL || sectors < 2 || sectors > dev->sector_count) {
+        return -1;
+    }
+    journal_dev = dev;
+    journal_start = start;
+    journal_sectors = sectors;
+    journal_head = 1;
+    journal_sequence = 1;
+    // a log left behind by an earlier file here must not look valid
+    memset(tx_buffer, 0, BLOCK_SECTOR_SIZE);
+    if (block_write(dev, start + 1, 1, tx_buffer) != 0 || write_super(journal_sequence) != 0) {
+        journal_dev = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int journal_open(struct block_device* dev, uint32_t start, uint32_t sectors) {
+    uint8_t sector[BLOCK_SECTOR_SIZE];
+    struct journal_header* super = (struct journal_header*)sector;
+
+    journal_dev = NULL;
+    if (dev == NULL || block_read(dev, start, 1, sector) != 0 ||
+        super->magic != JOURNAL_SUPER_MAGIC || super->count != sectors) {
+        return -1;
+    }
+    journal_dev = dev;
+    journal_start = start;
+    journal_sectors = sectors;
+    journal_head = 1;
+    journal_sequence = super->sequence;
+    return 0;
+}
+
+/* Hands every record of each intact transaction to apply, oldest first,
+   and stops at the first header that is missing, out of sequence or fails
+   its checksum. Returns how many transactions were replayed; the caller
+   flushes the device and then calls journal_reset(). */
+int journal_replay(int (*apply)(uint32_t lba, const void* data)) {
+    struct journal_header* header = (struct journal_header*)tx_buffer;
+    int replayed = 0;
+
+    if (journal_dev == NULL) {
+        return -1;
+    }
+    while (journal_head + 1 < journal_sectors) {
+        if (block_read(journal_dev, journal_start + journal_head, 1, tx_buffer) != 0) {
+            return -1;
+        }
+        uint32_t count = header->count;
+        if (header->magic != JOURNAL_TX_MAGIC || header->sequence != journal_sequence || count == 0 ||
+            count >= JOURNAL_TX_MAX || journal_head + 1 + count > journal_sectors) {
+            break;
+        }
+        if (block_read(journal_dev, journal_start + journal_head + 1, count, tx_buffer + BLOCK_SECTOR_SIZE) != 0) {
+            return -1;
+        }
+        if (tx_checksum(count) != header->checksum) {
+            break;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (apply(header->lba[i], tx_buffer + (i + 1) * BLOCK_SECTOR_SIZE) != 0) {
+                return -1;
+            }
+        }
+        journal_head += 1 + count;
+        journal_sequence++;
+        replayed++;
+    }
+    stats.replayed += replayed;
+    return replayed;
+}
+
+void journal_close() {
+    journal_dev = NULL;
+}
+
+int journal_is_open() {
+    return journal_dev != NULL;
+}
+
+/* Sectors left for the next transaction, its header included. */
+uint32_t journal_free() {
+    return journal_dev == NULL ? 0 : journal_sectors - journal_head;
+}
+
+void journal_begin() {
+    tx_count = 0;
+}
+
+int journal_add(uint32_t lba, const void* data) {
+    struct journal_header* header = (struct journal_header*)tx_buffer;
+
+    if (tx_count + 1 >= JOURNAL_TX_MAX) {
+        return -1;
+    }
+    memcpy(tx_buffer + (tx_count + 1) * BLOCK_SECTOR_SIZE, data, BLOCK_SECTOR_SIZE);
+    header->lba[tx_count++] = lba;
+    return 0;
+}
+
+/* Writes the transaction built since journal_begin() and waits for it to
+   reach the medium. Fails without writing anything if the log is full. */
+int journal_commit() {
+    struct journal_header* header = (struct journal_header*)tx_buffer;
+
+    if (tx_count == 0) {
+        return 0;
+    }
+    if (journal_dev == NULL || tx_count + 1 > journal_free()) {
+        return -1;
+    }
+    header->magic = JOURNAL_TX_MAGIC;
+    header->sequence = journal_sequence;
+    header->count = tx_count;
+    for (uint32_t i = tx_count; i < JOURNAL_MAX_RECORDS; i++) {
+        header->lba[i] = 0;
+    }
+    header->checksum = tx_checksum(tx_count);
+    if (block_write(journal_dev, journal_start + journal_head, tx_count + 1, tx_buffer) != 0 ||
+        block_flush(journal_dev) != 0) {
+        return -1;
+    }
+    journal_head += tx_count + 1;
+    journal_sequence++;
+    stats.commits++;
+    stats.sectors_logged += tx_count;
+    tx_count = 0;
+    return 0;
+}
+
+/* Called once everything logged has been written home; empties the log. */
+int journal_reset() {
+    if (journal_dev == NULL || journal_head == 1) {
+        return 0;
+    }
+    if (write_super(journal_sequence) != 0) {
+        return -1;
+    }
+    journal_head = 1;
+    stats.checkpoints++;
+    return 0;
+}
+
+void journal_get_stats(struct journal_stats* out) {
+    out->commits = stats.commits;
+    out->sectors_logged = stats.sectors_logged;
+    out->checkpoints = stats.checkpoints;
+    out->replayed = stats.replayed;
+}
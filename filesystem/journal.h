@@ -0,0 +1,43 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "../kernel/kernel.h"
+#include "../kernel/block.h"
+
+/* Definitions */
+#define JOURNAL_SECTORS 128
+#define JOURNAL_TX_MAX 64
+#define JOURNAL_SUPER_MAGIC 0x4C4A4341
+#define JOURNAL_TX_MAGIC 0x58544341
+#define JOURNAL_MAX_RECORDS ((BLOCK_SECTOR_SIZE - 16) / 4)
+
+/* Struct Creation */
+struct journal_header {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t count;
+    uint32_t checksum;
+    uint32_t lba[JOURNAL_MAX_RECORDS];
+} __attribute__((packed));
+
+struct journal_stats {
+    uint32_t commits;
+    uint32_t sectors_logged;
+    uint32_t checkpoints;
+    uint32_t replayed;
+};
+
+/* Function Declarations */
+int journal_format(struct block_device* dev, uint32_t start, uint32_t sectors);
+int journal_open(struct block_device* dev, uint32_t start, uint32_t sectors);
+int journal_replay(int (*apply)(uint32_t lba, const void* data));
+void journal_close();
+int journal_is_open();
+uint32_t journal_free();
+void journal_begin();
+int journal_add(uint32_t lba, const void* data);
+int journal_commit();
+int journal_reset();
+void journal_get_stats(struct journal_stats* out);
+
+#endif
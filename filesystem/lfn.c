@@ -0,0 +1,287 @@
+/* Libraries */
+#include "lfn.h"
+
+/* Function Declarations */
+static char to_upper(char c);
+static char to_lower(char c);
+static int short_char(char c);
+static int long_char(char c);
+
+/* Global Variables */
+static const uint8_t lfn_offsets[LFN_CHARS_PER_ENTRY] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+
+static char to_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+static char to_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static int short_char(char c) {
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+        return 1;
+    }
+    for (const char* p = "!#$%&'()-@^_`{}~"; *p; p++) {
+        if (c == *p) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Long names are limited to printable ASCII, which is all the console can
+   show anyway. */
+static int long_char(char c) {
+    if (c < 0x20 || c == 0x7F) {
+        return 0;
+    }
+    for (const char* p = "\"*/:<>?\\|"; *p; p++) {
+        if (c == *p) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Names that fit 8.3 in a single case per part are stored as a plain short
+   entry, with lower case recorded in the NT case bits; anything else needs
+   LFN entries in front of a generated alias. has_short is set whenever the
+   upper-cased name is a valid 8.3 name, so lookups can use it either way. */
+int lfn_parse(const char* component, struct lfn_name* out) {
+    uint32_t length = 0;
+    int dot = -1;
+    int upper[2] = {0, 0};
+    int lower[2] = {0, 0};
+
+    while (component[length] != '\0') {
+        if (length >= FAT12_NAME_MAX || !long_char(component[length])) {
+            return -1;
+        }
+        out->name[length] = component[length];
+        if (component[length] == '.') {
+            dot = length;
+        }
+        length++;
+    }
+    if (length == 0) {
+        return -1;
+    }
+    out->name[length] = '\0';
+    out->length = length;
+    out->case_flags = 0;
+    out->has_short = 1;
+    out->needs_lfn = 0;
+    for (int i = 0; i < 11; i++) {
+        out->short_name[i] = ' ';
+    }
+    if (component[0] == '.' && (length == 1 || (length == 2 && component[1] == '.'))) {
+        out->short_name[0] = '.';
+        out->short_name[1] = length == 2 ? '.' : ' ';
+        return 0;
+    }
+
+    uint32_t base_length = dot < 0 ? length : (uint32_t)dot;
+    uint32_t ext_length = dot < 0 ? 0 : length - dot - 1;
+    if (base_length == 0 || base_length > 8 || ext_length > 3 || (dot >= 0 && ext_length == 0)) {
+        out->has_short = 0;
+    }
+    for (uint32_t i = 0; i < length && out->has_short; i++) {
+        char c = out->name[i];
+        int part = dot >= 0 && i > (uint32_t)dot;
+        if (dot >= 0 && i == (uint32_t)dot) {
+            continue;
+        }
+        if (!short_char(c)) {
+            out->has_short = 0;
+        } else if (c >= 'a' && c <= 'z') {
+            lower[part] = 1;
+        } else if (c >= 'A' && c <= 'Z') {
+            upper[part] = 1;
+        }
+        out->short_name[part ? 8 + i - dot - 1 : i] = to_upper(c);
+    }
+    if (!out->has_short || (lower[0] && upper[0]) || (lower[1] && upper[1])) {
+        out->needs_lfn = 1;
+        return 0;
+    }
+    out->case_flags = (lower[0] ? LFN_CASE_LOWER_BASE : 0) | (lower[1] ? LFN_CASE_LOWER_EXT : 0);
+    return 0;
+}
+
+/* The n-th alias candidate: BASIS~n for the first few, then two basis
+   characters and four hex digits of a hash, so a directory full of names
+   sharing a prefix does not need a long run of probes. */
+void lfn_make_alias(const struct lfn_name* name, uint32_t n, uint8_t* short_name) {
+    static const char hex[] = "0123456789ABCDEF";
+    char digits[8];
+    int digit_count = 0;
+    int dot = -1;
+    int base = 0;
+
+    for (uint32_t i = 0; i < name->length; i++) {
+        if (name->name[i] == '.') {
+            dot = i;
+        }
+    }
+    for (int i = 0; i < 11; i++) {
+        short_name[i] = ' ';
+    }
+    for (uint32_t i = 0; i < (dot < 0 ? name->length : (uint32_t)dot) && base < 8; i++) {
+        char c = name->name[i];
+        if (c == ' ' || c == '.') {
+            continue;
+        }
+        short_name[base++] = short_char(c) ? to_upper(c) : '_';
+    }
+    if (base == 0) {
+        short_name[base++] = '_';
+    }
+
+    if (n > 4) {
+        uint32_t hash = lfn_hash(name->name) + n;
+        base = base < 2 ? base : 2;
+        for (int i = 3; i >= 0; i--) {
+            short_name[base++] = hex[(hash >> (i * 4)) & 0xF];
+        }
+        n = 1;
+    }
+    do {
+        digits[digit_count++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    if (base > 8 - digit_count - 1) {
+        base = 8 - digit_count - 1;
+    }
+    short_name[base++] = '~';
+    while (digit_count > 0) {
+        short_name[base++] = digits[--digit_count];
+    }
+
+    if (dot >= 0) {
+        int j = 8;
+        for (uint32_t i = dot + 1; i < name->length && j < 11; i++) {
+            char c = name->name[i];
+            if (c != ' ') {
+                short_name[j++] = short_char(c) ? to_upper(c) : '_';
+            }
+        }
+    }
+}
+
+uint8_t lfn_checksum(const uint8_t* short_name) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = ((sum & 1) << 7) + (sum >> 1) + short_name[i];
+    }
+    return sum;
+}
+
+uint32_t lfn_entry_count(const struct lfn_name* name) {
+    return name->needs_lfn ? (name->length + LFN_CHARS_PER_ENTRY - 1) / LFN_CHARS_PER_ENTRY : 0;
+}
+
+/* Fills the LFN slot carrying characters (sequence - 1) * 13 onwards. The
+   name is NUL terminated inside the last slot and padded with 0xFFFF. */
+void lfn_pack(const struct lfn_name* name, uint32_t sequence, uint8_t checksum, struct fat12_dir_entry* entry) {
+    uint8_t* raw = (uint8_t*)entry;
+    uint32_t start = (sequence - 1) * LFN_CHARS_PER_ENTRY;
+
+    raw[0] = sequence | (start + LFN_CHARS_PER_ENTRY >= name->length ? LFN_LAST_ENTRY : 0);
+    raw[11] = LFN_ATTRIBUTES;
+    raw[12] = 0;
+    raw[13] = checksum;
+    raw[26] = 0;
+    raw[27] = 0;
+    for (int i = 0; i < LFN_CHARS_PER_ENTRY; i++) {
+        uint32_t pos = start + i;
+        uint16_t c = 0xFFFF;
+        if (pos < name->length) {
+            c = (uint8_t)name->name[pos];
+        } else if (pos == name->length) {
+            c = 0x0000;
+        }
+        raw[lfn_offsets[i]] = c & 0xFF;
+        raw[lfn_offsets[i] + 1] = c >> 8;
+    }
+}
+
+void lfn_reset(struct lfn_state* state) {
+    state->count = 0;
+}
+
+/* LFN slots come in descending sequence order right before their short
+   entry; a slot out of order or with a different checksum drops the
+   fragments gathered so far. Characters outside ASCII decode as '?'. */
+void lfn_feed(struct lfn_state* state, const struct fat12_dir_entry* entry) {
+    const uint8_t* raw = (const uint8_t*)entry;
+    uint8_t sequence = raw[0] & LFN_SEQUENCE_MASK;
+
+    if (raw[0] & LFN_LAST_ENTRY) {
+        if (sequence == 0 || sequence > LFN_MAX_ENTRIES) {
+            state->count = 0;
+            return;
+        }
+        state->count = sequence;
+        state->checksum = raw[13];
+        state->name[sequence * LFN_CHARS_PER_ENTRY] = '\0';
+    } else if (state->count == 0 || sequence == 0 || sequence != state->next || raw[13] != state->checksum) {
+        state->count = 0;
+        return;
+    }
+    state->next = sequence - 1;
+
+    char* out = &state->name[(sequence - 1) * LFN_CHARS_PER_ENTRY];
+    for (int i = 0; i < LFN_CHARS_PER_ENTRY; i++) {
+        uint16_t c = raw[lfn_offsets[i]] | (raw[lfn_offsets[i] + 1] << 8);
+        if (c == 0x0000 || c == 0xFFFF) {
+            out[i] = '\0';
+        } else {
+            out[i] = c < 0x80 ? (char)c : '?';
+        }
+    }
+}
+
+/* Returns the long name belonging to the short entry, or NULL when no
+   complete run of slots precedes it. */
+const char* lfn_finish(struct lfn_state* state, const struct fat12_dir_entry* entry) {
+    const char* name = NULL;
+    if (state->count != 0 && state->next == 0 && state->name[0] != '\0' &&
+        lfn_checksum((const uint8_t*)entry) == state->checksum) {
+        name = state->name;
+    }
+    state->count = 0;
+    return name;
+}
+
+void lfn_short_display(const struct fat12_dir_entry* entry, char* out) {
+    const uint8_t* raw = (const uint8_t*)entry;
+    int n = 0;
+    for (int i = 0; i < 8 && raw[i] != ' '; i++) {
+        out[n++] = (entry->reserved & LFN_CASE_LOWER_BASE) ? to_lower(raw[i]) : raw[i];
+    }
+    if (raw[8] != ' ') {
+        out[n++] = '.';
+        for (int i = 8; i < 11 && raw[i] != ' '; i++) {
+            out[n++] = (entry->reserved & LFN_CASE_LOWER_EXT) ? to_lower(raw[i]) : raw[i];
+        }
+    }
+    out[n] = '\0';
+}
+
+int lfn_name_equal(const char* a, const char* b) {
+    while (*a != '\0' && to_upper(*a) == to_upper(*b)) {
+        a++;
+        b++;
+    }
+    return *a == '\0' && *b == '\0';
+}
+
+uint32_t lfn_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name != '\0') {
+        hash = (hash ^ (uint8_t)to_upper(*name)) * 16777619u;
+        name++;
+    }
+    return hash;
+}
@@ -0,0 +1,46 @@
+#ifndef LFN_H
+#define LFN_H
+
+#include "fat12.h"
+
+/* Definitions */
+#define LFN_ATTRIBUTES 0x0F
+#define LFN_LAST_ENTRY 0x40
+#define LFN_SEQUENCE_MASK 0x1F
+#define LFN_CHARS_PER_ENTRY 13
+#define LFN_MAX_ENTRIES ((FAT12_NAME_MAX + LFN_CHARS_PER_ENTRY - 1) / LFN_CHARS_PER_ENTRY)
+#define LFN_CASE_LOWER_BASE 0x08
+#define LFN_CASE_LOWER_EXT 0x10
+#define LFN_ALIAS_TRIES 1000
+
+/* Struct Creation */
+struct lfn_name {
+    char name[FAT12_NAME_MAX + 1];
+    uint32_t length;
+    uint8_t short_name[11];
+    uint8_t case_flags;
+    uint8_t has_short;
+    uint8_t needs_lfn;
+};
+
+struct lfn_state {
+    char name[LFN_MAX_ENTRIES * LFN_CHARS_PER_ENTRY + 1];
+    uint8_t checksum;
+    uint8_t count;
+    uint8_t next;
+};
+
+/* Function Declarations */
+int lfn_parse(const char* component, struct lfn_name* out);
+void lfn_make_alias(const struct lfn_name* name, uint32_t n, uint8_t* short_name);
+uint8_t lfn_checksum(const uint8_t* short_name);
+uint32_t lfn_entry_count(const struct lfn_name* name);
+void lfn_pack(const struct lfn_name* name, uint32_t sequence, uint8_t checksum, struct fat12_dir_entry* entry);
+void lfn_reset(struct lfn_state* state);
+void lfn_feed(struct lfn_state* state, const struct fat12_dir_entry* entry);
+const char* lfn_finish(struct lfn_state* state, const struct fat12_dir_entry* entry);
+void lfn_short_display(const struct fat12_dir_entry* entry, char* out);
+int lfn_name_equal(const char* a, const char* b);
+uint32_t lfn_hash(const char* name);
+
+#endif
@@ -3,15 +3,20 @@
 global idt_load
 global irq0_handler
 global irq1_handler
+global irq14_handler
+global isr14_handler
 
 extern idt_desc
 extern irq_handler 
+extern page_fault_handler
 
 idt_load:
     lidt [idt_desc]
     ret
 
+; C code expects DF clear, and iret restores the interrupted flags
 irq0_handler:
+    cld
     pusha                    
     push dword 0                                
     call irq_handler         
@@ -20,9 +25,31 @@ irq0_handler:
     iret                    
 
 irq1_handler:
+    cld
     pusha                    
     push dword 1             
     call irq_handler         
     add esp, 4               
     popa                     
-    iret                     
\ No newline at end of file
+    iret
+
+irq14_handler:
+    cld
+    pusha
+    push dword 14
+    call irq_handler
+    add esp, 4
+    popa
+    iret
+
+; page fault: the CPU pushes an error code below eip
+isr14_handler:
+    cld
+    pusha
+    push dword [esp + 36]    ; eip
+    push dword [esp + 36]    ; error code
+    call page_fault_handler
+    add esp, 8
+    popa
+    add esp, 4
+    iret
\ No newline at end of file
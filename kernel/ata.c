@@ -0,0 +1,572 @@
+#include "ata.h"
+#include "io.h"
+#include "pci.h"
+#include "interrupts.h"
+#include "ktime.h"
+
+/* Function Declarations */
+static void ata_delay();
+static int ata_wait_ready();
+static int ata_wait_drq();
+static void ata_select(uint32_t lba);
+static void ata_issue(uint32_t lba, uint32_t count, unsigned char command);
+static int ata_block_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer);
+static int ata_block_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer);
+static int ata_block_flush(struct block_device* dev);
+static int ata_block_set_mode(struct block_device* dev, int mode);
+static void ata_dma_init(uint16_t* identify);
+static int ata_dma_transfer(uint32_t lba, uint32_t count, void* buffer, int write);
+static int ata_prd_add(int entries, uint32_t address, uint32_t bytes);
+static int ata_dma_start(uint32_t lba, uint32_t count, int entries, int write);
+static int ata_dma_finish();
+static int ata_async_start(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers, int write,
+                           void (*done)(void* ctx, int status), void* ctx);
+static int ata_block_read_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                                void (*done)(void* ctx, int status), void* ctx);
+static int ata_block_write_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                                 void (*done)(void* ctx, int status), void* ctx);
+static void ata_block_poll(struct block_device* dev);
+static int interrupts_enabled();
+static int ata_wait_irq();
+static void ata_wait_idle();
+static void ata_irq();
+static void ata_set_multiple();
+static void ata_reset();
+static void ata_async_timeout(void* ctx);
+
+/* Global Variables */
+static int ata_drive = ATA_MASTER;
+static int ata_present = 0;
+static uint32_t ata_sector_count = 0;
+static uint32_t ata_multiple = 1;
+static struct block_device ata_device;
+static uint16_t ata_bm_base = 0;
+static struct ata_prd ata_prdt[ATA_MAX_PRD] __attribute__((aligned(ATA_MAX_PRD * 8)));
+static volatile int ata_irq_done = 0;
+static volatile unsigned char ata_irq_status = 0;
+static volatile unsigned char ata_irq_bm_status = 0;
+static unsigned char ata_dma_direction = 0;
+static void (*volatile ata_async_done)(void* ctx, int status) = NULL;
+static void* ata_async_ctx = NULL;
+static volatile int ata_in_irq = 0;
+static struct timer ata_timer;
+static uint64_t ata_async_deadline = 0;
+
+static void ata_delay() {
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_PRIMARY_CTRL);
+    }
+}
+
+static int ata_wait_ready() {
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        unsigned char status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+        if (!(status & ATA_SR_BSY)) {
+            if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int ata_wait_drq() {
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        unsigned char status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+        if (status & ATA_SR_BSY) {
+            continue;
+        }
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            return -1;
+        }
+        if (status & ATA_SR_DRQ) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void ata_select(uint32_t lba) {
+    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0 | (ata_drive << 4) | ((lba >> 24) & 0x0F));
+    ata_delay();
+}
+
+struct block_device* ata_init(int drive) {
+    uint16_t identify[256];
+
+    ata_drive = drive;
+    ata_present = 0;
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+
+    ata_select(0);
+    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_LO, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_MID, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_HI, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay();
+
+    unsigned char status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF) {
+        return NULL;
+    }
+    for (int i = 0; i < ATA_TIMEOUT && (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) & ATA_SR_BSY); i++);
+
+    // ATAPI and SATA devices abort IDENTIFY and leave a signature here
+    if (inb(ATA_PRIMARY_IO + ATA_REG_LBA_MID) || inb(ATA_PRIMARY_IO + ATA_REG_LBA_HI)) {
+        return NULL;
+    }
+    if (ata_wait_drq() != 0) {
+        return NULL;
+    }
+    insw(ATA_PRIMARY_IO + ATA_REG_DATA, identify, 256);
+
+    ata_sector_count = identify[60] | ((uint32_t)identify[61] << 16);
+    if (ata_sector_count == 0) {
+        return NULL;
+    }
+
+    // word 47 holds the largest block READ/WRITE MULTIPLE can move per DRQ
+    ata_multiple = identify[47] & 0xFF;
+    ata_set_multiple();
+
+    ata_device.name = drive == ATA_MASTER ? "ata0" : "ata1";
+    ata_device.sector_count = ata_sector_count;
+    ata_device.max_transfer = ATA_MAX_TRANSFER;
+    ata_device.read = ata_block_read;
+    ata_device.write = ata_block_write;
+    ata_device.flush = ata_block_flush;
+    ata_device.set_mode = ata_block_set_mode;
+    ata_device.read_async = NULL;
+    ata_device.write_async = NULL;
+    ata_device.poll = ata_block_poll;
+    ata_device.map = NULL;
+    ata_device.mode = BLOCK_MODE_PIO;
+    ata_device.data = NULL;
+    ata_present = 1;
+    timer_setup(&ata_timer, ata_async_timeout, NULL);
+    ata_dma_init(identify);
+    return &ata_device;
+}
+
+static void ata_set_multiple() {
+    if (ata_multiple > 0) {
+        ata_select(0);
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, ata_multiple);
+        outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+        ata_delay();
+        if (ata_wait_ready() != 0) {
+            ata_multiple = 0;
+        }
+    }
+}
+
+/* Gets the channel out of a command the drive never finished: stops the
+   bus master, pulses SRST and restores what the reset may have cleared.
+   The drive may take 2 ms to raise BSY after the reset, covered here by
+   ISA port reads of about a microsecond each. */
+static void ata_reset() {
+    unsigned char ctrl = ata_device.mode == BLOCK_MODE_DMA ? 0 : ATA_CTRL_NIEN;
+    if (ata_bm_base) {
+        outb(ata_bm_base + ATA_BM_COMMAND, 0);
+        outb(ata_bm_base + ATA_BM_STATUS, inb(ata_bm_base + ATA_BM_STATUS) | ATA_BM_SR_ERR | ATA_BM_SR_IRQ);
+    }
+    outb(ATA_PRIMARY_CTRL, ctrl | ATA_CTRL_SRST);
+    ata_delay();
+    outb(ATA_PRIMARY_CTRL, ctrl);
+    for (int i = 0; i < ATA_RESET_DELAY; i++) {
+        inb(ATA_PRIMARY_CTRL);
+    }
+    ata_wait_ready();
+    ata_set_multiple();
+}
+
+/* Bus-master DMA needs the PCI IDE function's BAR4 register block and a
+   drive that reports DMA support in IDENTIFY word 49. */
+static void ata_dma_init(uint16_t* identify) {
+    struct pci_device ide;
+
+    ata_bm_base = 0;
+    if (!(identify[49] & 0x0100)) {
+        return;
+    }
+    if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide) != 0) {
+        return;
+    }
+    uint32_t bar4 = pci_read(&ide, PCI_REG_BAR4);
+    if (!(bar4 & 1) || (bar4 & 0xFFFC) == 0) {
+        return;
+    }
+    pci_write(&ide, PCI_REG_COMMAND, pci_read(&ide, PCI_REG_COMMAND) | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+    // select the fastest Ultra DMA mode the drive advertises, else multiword DMA
+    unsigned char xfer_mode = 0;
+    if ((identify[53] & 0x04) && (identify[88] & 0xFF)) {
+        for (int i = 7; i >= 0; i--) {
+            if (identify[88] & (1 << i)) {
+                xfer_mode = 0x40 | i;
+                break;
+            }
+        }
+    } else {
+        for (int i = 2; i >= 0; i--) {
+            if (identify[63] & (1 << i)) {
+                xfer_mode = 0x20 | i;
+                break;
+            }
+        }
+    }
+    if (xfer_mode) {
+        ata_select(0);
+        outb(ATA_PRIMARY_IO + ATA_REG_FEATURES, ATA_FEATURE_XFER_MODE);
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, xfer_mode);
+        outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_SET_FEATURES);
+        ata_delay();
+        if (ata_wait_ready() != 0) {
+            return;
+        }
+    }
+
+    ata_bm_base = bar4 & 0xFFFC;
+    irq_handle_install(ATA_IRQ, ata_irq);
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~0x04);
+    outb(PIC2_DATA, inb(PIC2_DATA) & ~0x40);
+}
+
+int ata_dma_available() {
+    return ata_bm_base != 0;
+}
+
+/* An asynchronous transfer is completed here, in interrupt context, by
+   handing its status to the callback it was started with. */
+static void ata_irq() {
+    if (ata_bm_base) {
+        ata_irq_bm_status = inb(ata_bm_base + ATA_BM_STATUS);
+    }
+    ata_irq_status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    ata_irq_done = 1;
+    if (ata_async_done) {
+        void (*done)(void* ctx, int status) = ata_async_done;
+        ktime_cancel(&ata_timer);
+        int status = ata_dma_finish();
+        ata_async_done = NULL;
+        ata_in_irq = 1;
+        done(ata_async_ctx, status);
+        ata_in_irq = 0;
+    }
+}
+
+static int interrupts_enabled() {
+    uint32_t eflags;
+    __asm__ volatile("pushf; pop %0" : "=r"(eflags));
+    return (eflags & 0x200) != 0;
+}
+
+/* Halts until IRQ14 reports completion. Interrupts are re-checked with
+   them disabled so a completion landing between the test and the hlt
+   cannot be missed; with interrupts off the bus-master status is polled.
+   The timer tick wakes the hlt, so a drive that never answers fails the
+   wait after ATA_IRQ_TIMEOUT_MS instead of hanging the kernel. */
+static int ata_wait_irq() {
+    uint64_t deadline = ktime_get_ns() + (uint64_t)ATA_IRQ_TIMEOUT_MS * NSEC_PER_MSEC;
+    if (!interrupts_enabled()) {
+        while (!(inb(ata_bm_base + ATA_BM_STATUS) & ATA_BM_SR_IRQ)) {
+            if (ktime_get_ns() > deadline) {
+                return -1;
+            }
+        }
+        ata_irq_bm_status = inb(ata_bm_base + ATA_BM_STATUS);
+        ata_irq_status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+        return 0;
+    }
+    while (1) {
+        __asm__ volatile("cli" : : : "memory");
+        if (ata_irq_done) {
+            break;
+        }
+        if (ktime_get_ns() > deadline) {
+            __asm__ volatile("sti" : : : "memory");
+            return -1;
+        }
+        __asm__ volatile("sti; hlt" : : : "memory");
+    }
+    __asm__ volatile("sti" : : : "memory");
+    return 0;
+}
+
+/* The channel runs one command at a time, so every new command first waits
+   for an outstanding asynchronous transfer to complete, or to time out. */
+static void ata_wait_idle() {
+    if (ata_async_done == NULL) {
+        return;
+    }
+    if (!interrupts_enabled()) {
+        while (ata_async_done) {
+            ata_block_poll(&ata_device);
+        }
+        return;
+    }
+    while (1) {
+        __asm__ volatile("cli" : : : "memory");
+        if (ata_async_done == NULL) {
+            break;
+        }
+        __asm__ volatile("sti; hlt" : : : "memory");
+    }
+    __asm__ volatile("sti" : : : "memory");
+}
+
+/* Appends a memory region to the PRD table. A region must be word aligned
+   and may not cross a 64 KiB boundary, so it is split where needed and
+   merged into the previous entry when physically contiguous with it. */
+static int ata_prd_add(int entries, uint32_t address, uint32_t bytes) {
+    while (bytes > 0) {
+        uint32_t chunk = 0x10000 - (address & 0xFFFF);
+        if (chunk > bytes) {
+            chunk = bytes;
+        }
+        struct ata_prd* prev = entries ? &ata_prdt[entries - 1] : NULL;
+        uint32_t prev_bytes = prev ? (prev->byte_count ? prev->byte_count : 0x10000) : 0;
+        if (prev && prev->address + prev_bytes == address && (address & 0xFFFF) != 0) {
+            prev->byte_count = (prev_bytes + chunk) & 0xFFFF;
+        } else {
+            if (entries == ATA_MAX_PRD) {
+                return -1;
+            }
+            ata_prdt[entries].address = address;
+            ata_prdt[entries].byte_count = chunk & 0xFFFF;
+            ata_prdt[entries].flags = 0;
+            entries++;
+        }
+        address += chunk;
+        bytes -= chunk;
+    }
+    return entries;
+}
+
+static int ata_dma_start(uint32_t lba, uint32_t count, int entries, int write) {
+    ata_prdt[entries - 1].flags = ATA_PRD_EOT;
+    ata_dma_direction = write ? 0 : ATA_BM_CMD_READ;
+    outb(ata_bm_base + ATA_BM_COMMAND, ata_dma_direction);
+    outl(ata_bm_base + ATA_BM_PRDT, (uint32_t)ata_prdt);
+    outb(ata_bm_base + ATA_BM_STATUS, inb(ata_bm_base + ATA_BM_STATUS) | ATA_BM_SR_ERR | ATA_BM_SR_IRQ);
+
+    if (ata_wait_ready() != 0) {
+        return -1;
+    }
+    ata_irq_done = 0;
+    ata_issue(lba, count, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+    outb(ata_bm_base + ATA_BM_COMMAND, ata_dma_direction | ATA_BM_CMD_START);
+    return 0;
+}
+
+static int ata_dma_finish() {
+    outb(ata_bm_base + ATA_BM_COMMAND, ata_dma_direction);
+    if ((ata_irq_bm_status & ATA_BM_SR_ERR) || (ata_irq_status & (ATA_SR_ERR | ATA_SR_DF))) {
+        return -1;
+    }
+    return 0;
+}
+
+static int ata_dma_transfer(uint32_t lba, uint32_t count, void* buffer, int write) {
+    if (!ata_present || count == 0 || count > ATA_MAX_TRANSFER || lba + count > ATA_MAX_LBA28) {
+        return -1;
+    }
+    int entries = ata_prd_add(0, (uint32_t)buffer, count * BLOCK_SECTOR_SIZE);
+    if (entries <= 0 || ata_dma_start(lba, count, entries, write) != 0) {
+        return -1;
+    }
+    if (ata_wait_irq() != 0) {
+        ata_reset();
+        return -1;
+    }
+    return ata_dma_finish();
+}
+
+/* Starts a DMA transfer scattered across one sector-sized buffer per
+   sector and returns immediately; done runs from the IRQ once the data has
+   moved. A completion callback may start the next transfer itself. */
+static int ata_async_start(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers, int write,
+                           void (*done)(void* ctx, int status), void* ctx) {
+    int enabled = interrupts_enabled();
+    if (dev->mode != BLOCK_MODE_DMA || !(enabled || ata_in_irq) || ata_async_done != NULL) {
+        return -1;
+    }
+    if (count == 0 || count > ATA_MAX_TRANSFER || lba + count > ATA_MAX_LBA28) {
+        return -1;
+    }
+    int entries = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        entries = ata_prd_add(entries, (uint32_t)buffers[i], BLOCK_SECTOR_SIZE);
+        if (entries < 0) {
+            return -1;
+        }
+    }
+    __asm__ volatile("cli" : : : "memory");
+    ata_async_done = done;
+    ata_async_ctx = ctx;
+    int result = 0;
+    if (ata_dma_start(lba, count, entries, write) != 0) {
+        ata_async_done = NULL;
+        result = -1;
+    } else {
+        ata_async_deadline = ktime_get_ns() + (uint64_t)ATA_IRQ_TIMEOUT_MS * NSEC_PER_MSEC;
+        ktime_arm(&ata_timer, ATA_IRQ_TIMEOUT_MS);
+    }
+    if (enabled) {
+        __asm__ volatile("sti" : : : "memory");
+    }
+    return result;
+}
+
+static int ata_block_read_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                                void (*done)(void* ctx, int status), void* ctx) {
+    return ata_async_start(dev, lba, count, buffers, 0, done, ctx);
+}
+
+static int ata_block_write_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                                 void (*done)(void* ctx, int status), void* ctx) {
+    return ata_async_start(dev, lba, count, buffers, 1, done, ctx);
+}
+
+/* Completes an outstanding transfer without waiting for IRQ14, for callers
+   running with interrupts disabled, where the timeout timer cannot run
+   either and the deadline is checked here instead. */
+static void ata_block_poll(struct block_device* dev) {
+    (void)dev;
+    if (ata_async_done && (inb(ata_bm_base + ATA_BM_STATUS) & ATA_BM_SR_IRQ)) {
+        ata_irq();
+    } else if (ata_async_done && ktime_get_ns() > ata_async_deadline) {
+        ata_async_timeout(NULL);
+    }
+}
+
+/* Fails an asynchronous transfer whose interrupt never came, from the
+   timer interrupt or a poll, after resetting the channel so the next
+   command finds the drive idle. */
+static void ata_async_timeout(void* ctx) {
+    (void)ctx;
+    if (ata_async_done == NULL) {
+        return;
+    }
+    void (*done)(void* ctx, int status) = ata_async_done;
+    ata_async_done = NULL;
+    ata_reset();
+    ata_in_irq = 1;
+    done(ata_async_ctx, -1);
+    ata_in_irq = 0;
+}
+
+int ata_multiple_count() {
+    return ata_multiple;
+}
+
+static void ata_issue(uint32_t lba, uint32_t count, unsigned char command) {
+    ata_select(lba);
+    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, count == ATA_MAX_TRANSFER ? 0 : count);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_LO, lba & 0xFF);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_MID, (lba >> 8) & 0xFF);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_HI, (lba >> 16) & 0xFF);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, command);
+    ata_delay();
+}
+
+/* With multiple mode enabled the drive raises DRQ once per block of
+   ata_multiple sectors rather than once per sector. */
+int ata_read_sectors(uint32_t lba, uint32_t count, void* buffer) {
+    if (!ata_present || count == 0 || count > ATA_MAX_TRANSFER || lba + count > ATA_MAX_LBA28) {
+        return -1;
+    }
+    uint32_t block = ata_multiple ? ata_multiple : 1;
+    uint16_t* data = (uint16_t*)buffer;
+
+    if (ata_wait_ready() != 0) {
+        return -1;
+    }
+    ata_issue(lba, count, ata_multiple ? ATA_CMD_READ_MULTIPLE : ATA_CMD_READ_PIO);
+    while (count > 0) {
+        uint32_t chunk = count < block ? count : block;
+        if (ata_wait_drq() != 0) {
+            return -1;
+        }
+        insw(ATA_PRIMARY_IO + ATA_REG_DATA, data, chunk * 256);
+        data += chunk * 256;
+        count -= chunk;
+    }
+    return 0;
+}
+
+int ata_write_sectors(uint32_t lba, uint32_t count, const void* buffer) {
+    if (!ata_present || count == 0 || count > ATA_MAX_TRANSFER || lba + count > ATA_MAX_LBA28) {
+        return -1;
+    }
+    uint32_t block = ata_multiple ? ata_multiple : 1;
+    const uint16_t* data = (const uint16_t*)buffer;
+
+    if (ata_wait_ready() != 0) {
+        return -1;
+    }
+    ata_issue(lba, count, ata_multiple ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_WRITE_PIO);
+    while (count > 0) {
+        uint32_t chunk = count < block ? count : block;
+        if (ata_wait_drq() != 0) {
+            return -1;
+        }
+        outsw(ATA_PRIMARY_IO + ATA_REG_DATA, data, chunk * 256);
+        data += chunk * 256;
+        count -= chunk;
+    }
+    return ata_wait_ready();
+}
+
+int ata_flush() {
+    if (!ata_present) {
+        return -1;
+    }
+    ata_select(0);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+    ata_delay();
+    return ata_wait_ready();
+}
+
+static int ata_block_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer) {
+    ata_wait_idle();
+    if (dev->mode == BLOCK_MODE_DMA && !((uint32_t)buffer & 1)) {
+        return ata_dma_transfer(lba, count, buffer, 0);
+    }
+    return ata_read_sectors(lba, count, buffer);
+}
+
+static int ata_block_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    ata_wait_idle();
+    if (dev->mode == BLOCK_MODE_DMA && !((uint32_t)buffer & 1)) {
+        return ata_dma_transfer(lba, count, (void*)buffer, 1);
+    }
+    return ata_write_sectors(lba, count, buffer);
+}
+
+static int ata_block_flush(struct block_device* dev) {
+    (void)dev;
+    ata_wait_idle();
+    return ata_flush();
+}
+
+/* The drive only raises IRQ14 while nIEN is clear, so PIO mode keeps it
+   masked at the device and polls instead. */
+static int ata_block_set_mode(struct block_device* dev, int mode) {
+    ata_wait_idle();
+    if (mode == BLOCK_MODE_DMA) {
+        if (!ata_bm_base) {
+            return -1;
+        }
+        outb(ATA_PRIMARY_CTRL, 0);
+        dev->read_async = ata_block_read_async;
+        dev->write_async = ata_block_write_async;
+    } else {
+        outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+        dev->read_async = NULL;
+        dev->write_async = NULL;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "kernel.h"
+#include "block.h"
+
+/* Definitions */
+#define ATA_PRIMARY_IO 0x1F0
+#define ATA_PRIMARY_CTRL 0x3F6
+#define ATA_REG_DATA 0
+#define ATA_REG_ERROR 1
+#define ATA_REG_FEATURES 1
+#define ATA_REG_SECCOUNT 2
+#define ATA_REG_LBA_LO 3
+#define ATA_REG_LBA_MID 4
+#define ATA_REG_LBA_HI 5
+#define ATA_REG_DRIVE 6
+#define ATA_REG_STATUS 7
+#define ATA_REG_COMMAND 7
+#define ATA_SR_BSY 0x80
+#define ATA_SR_DRDY 0x40
+#define ATA_SR_DF 0x20
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_ERR 0x01
+#define ATA_CTRL_NIEN 0x02
+#define ATA_CTRL_SRST 0x04
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_READ_MULTIPLE 0xC4
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_SET_MULTIPLE 0xC6
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_SET_FEATURES 0xEF
+#define ATA_FEATURE_XFER_MODE 0x03
+#define ATA_BM_COMMAND 0
+#define ATA_BM_STATUS 2
+#define ATA_BM_PRDT 4
+#define ATA_BM_CMD_START 0x01
+#define ATA_BM_CMD_READ 0x08
+#define ATA_BM_SR_ACTIVE 0x01
+#define ATA_BM_SR_ERR 0x02
+#define ATA_BM_SR_IRQ 0x04
+#define ATA_PRD_EOT 0x8000
+#define ATA_MAX_PRD 64
+#define ATA_IRQ 14
+#define ATA_MASTER 0
+#define ATA_SLAVE 1
+#define ATA_MAX_LBA28 0x0FFFFFFF
+#define ATA_MAX_TRANSFER 256
+#define ATA_TIMEOUT 1000000
+#define ATA_IRQ_TIMEOUT_MS 5000
+#define ATA_RESET_DELAY 2000
+
+/* Struct Creation */
+struct ata_prd {
+    uint32_t address;
+    uint16_t byte_count;
+    uint16_t flags;
+} __attribute__((packed));
+
+/* Function Declarations */
+struct block_device* ata_init(int drive);
+int ata_read_sectors(uint32_t lba, uint32_t count, void* buffer);
+int ata_write_sectors(uint32_t lba, uint32_t count, const void* buffer);
+int ata_flush();
+int ata_multiple_count();
+int ata_dma_available();
+
+#endif
@@ -0,0 +1,418 @@
+#include "bcache.h"
+#include "blkq.h"
+#include "mem.h"
+
+/* Function Declarations */
+static uint32_t bcache_hash(struct block_device* dev, uint32_t lba);
+static struct bcache_buffer* bcache_lookup(struct block_device* dev, uint32_t lba);
+static struct bcache_buffer* bcache_alloc(struct block_device* dev, uint32_t lba);
+static void lru_unlink(struct bcache_buffer* buf);
+static void lru_push_front(struct bcache_buffer* buf);
+static void hash_unlink(struct bcache_buffer* buf);
+static int bcache_writeback(struct bcache_buffer* buf);
+static void bcache_touch(struct bcache_buffer* buf);
+static void bcache_wait(struct bcache_buffer* buf);
+static void bcache_prefetch_done(void* ctx, int status);
+static void bcache_write_done(void* ctx, int status);
+static void bcache_consume(struct bcache_buffer* buf);
+static void counter_add(volatile uint32_t* counter, uint32_t value);
+static void counter_sub(volatile uint32_t* counter, uint32_t value);
+
+/* Global Variables */
+static struct bcache_buffer buffers[BCACHE_BUFFERS];
+static uint8_t buffer_data[BCACHE_BUFFERS][BLOCK_SECTOR_SIZE] __attribute__((aligned(BLOCK_SECTOR_SIZE)));
+static struct bcache_buffer* hash_table[BCACHE_HASH_SIZE];
+static struct bcache_buffer* lru_head = NULL;
+static struct bcache_buffer* lru_tail = NULL;
+static struct bcache_stats stats;
+static volatile uint32_t prefetch_pending = 0;
+static int flush_failed = 0;
+
+/* Counters the disk interrupt also updates. One locked instruction cannot
+   be split by the interrupt, and unlike cli it also runs in the host
+   harness. */
+static void counter_add(volatile uint32_t* counter, uint32_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_SEQ_CST);
+}
+
+static void counter_sub(volatile uint32_t* counter, uint32_t value) {
+    __atomic_fetch_sub(counter, value, __ATOMIC_SEQ_CST);
+}
+
+static uint32_t bcache_hash(struct block_device* dev, uint32_t lba) {
+    return (lba ^ ((size_t)dev >> 4)) & (BCACHE_HASH_SIZE - 1);
+}
+
+void bcache_init() {
+    for (int i = 0; i < BCACHE_HASH_SIZE; i++) {
+        hash_table[i] = NULL;
+    }
+    lru_head = NULL;
+    lru_tail = NULL;
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        buffers[i].dev = NULL;
+        buffers[i].lba = 0;
+        buffers[i].flags = 0;
+        buffers[i].data = buffer_data[i];
+        buffers[i].hash_next = NULL;
+        buffers[i].lru_prev = NULL;
+        buffers[i].lru_next = NULL;
+        lru_push_front(&buffers[i]);
+    }
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.flushes = 0;
+    stats.evictions = 0;
+    stats.dirty = 0;
+    stats.prefetched = 0;
+    stats.prefetch_hits = 0;
+    stats.prefetch_wasted = 0;
+    prefetch_pending = 0;
+}
+
+static void lru_unlink(struct bcache_buffer* buf) {
+    if (buf->lru_prev) {
+        buf->lru_prev->lru_next = buf->lru_next;
+    } else {
+        lru_head = buf->lru_next;
+    }
+    if (buf->lru_next) {
+        buf->lru_next->lru_prev = buf->lru_prev;
+    } else {
+        lru_tail = buf->lru_prev;
+    }
+    buf->lru_prev = NULL;
+    buf->lru_next = NULL;
+}
+
+static void lru_push_front(struct bcache_buffer* buf) {
+    buf->lru_prev = NULL;
+    buf->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = buf;
+    }
+    lru_head = buf;
+    if (lru_tail == NULL) {
+        lru_tail = buf;
+    }
+}
+
+static void hash_unlink(struct bcache_buffer* buf) {
+    struct bcache_buffer** link = &hash_table[bcache_hash(buf->dev, buf->lba)];
+    while (*link) {
+        if (*link == buf) {
+            *link = buf->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    buf->hash_next = NULL;
+}
+
+static struct bcache_buffer* bcache_lookup(struct block_device* dev, uint32_t lba) {
+    struct bcache_buffer* buf = hash_table[bcache_hash(dev, lba)];
+    while (buf) {
+        if (buf->dev == dev && buf->lba == lba && (buf->flags & (BCACHE_VALID | BCACHE_BUSY))) {
+            return buf;
+        }
+        buf = buf->hash_next;
+    }
+    return NULL;
+}
+
+static int bcache_writeback(struct bcache_buffer* buf) {
+    if (!(buf->flags & BCACHE_DIRTY)) {
+        return 0;
+    }
+    if (block_write(buf->dev, buf->lba, 1, buf->data) != 0) {
+        return -1;
+    }
+    buf->flags &= ~BCACHE_DIRTY;
+    counter_add(&stats.flushes, 1);
+    counter_sub(&stats.dirty, 1);
+    return 0;
+}
+
+/* Recycles the least recently used buffer that is not waiting on a
+   prefetch, writing it back first if dirty. The returned buffer is hashed
+   under (dev, lba) but not yet valid. */
+static struct bcache_buffer* bcache_alloc(struct block_device* dev, uint32_t lba) {
+    struct bcache_buffer* buf = lru_tail;
+    while (buf && (buf->flags & BCACHE_BUSY)) {
+        buf = buf->lru_prev;
+    }
+    if (buf == NULL) {
+        return NULL;
+    }
+    if (buf->flags & BCACHE_VALID) {
+        if (bcache_writeback(buf) != 0) {
+            return NULL;
+        }
+        if (buf->flags & BCACHE_PREFETCHED) {
+            stats.prefetch_wasted++;
+        }
+        stats.evictions++;
+    }
+    if (buf->dev) {
+        hash_unlink(buf);
+    }
+    buf->dev = dev;
+    buf->lba = lba;
+    buf->flags = 0;
+    uint32_t slot = bcache_hash(dev, lba);
+    buf->hash_next = hash_table[slot];
+    hash_table[slot] = buf;
+    lru_unlink(buf);
+    lru_push_front(buf);
+    return buf;
+}
+
+static void bcache_touch(struct bcache_buffer* buf) {
+    if (lru_head != buf) {
+        lru_unlink(buf);
+        lru_push_front(buf);
+    }
+}
+
+/* Busy buffers belong to the request queue until their segment completes. */
+static void bcache_wait(struct bcache_buffer* buf) {
+    while (buf->flags & BCACHE_BUSY) {
+        blkq_drain();
+    }
+}
+
+/* The first access to a prefetched sector is what counts as a prefetch hit. */
+static void bcache_consume(struct bcache_buffer* buf) {
+    if (buf->flags & BCACHE_PREFETCHED) {
+        buf->flags &= ~BCACHE_PREFETCHED;
+        stats.prefetch_hits++;
+    }
+}
+
+/* Runs from the device's completion interrupt. A failed prefetch just
+   leaves its buffer invalid to be reused. */
+static void bcache_prefetch_done(void* ctx, int status) {
+    struct bcache_buffer* buf = (struct bcache_buffer*)ctx;
+    buf->flags = status == 0 ? (BCACHE_VALID | BCACHE_PREFETCHED) : 0;
+    if (status == 0) {
+        stats.prefetched++;
+    }
+    counter_sub(&prefetch_pending, 1);
+}
+
+/* Queues reads of the uncached sectors of [lba, lba + count) into the
+   cache, one segment per buffer for the request queue to merge back into
+   as few commands as the device allows. When the device transfers
+   asynchronously the call returns as soon as the first command is issued
+   and later readers wait on the busy buffers; otherwise the sectors are
+   read before returning. Returns how many sectors from lba are now cached
+   or on their way; at most BCACHE_PREFETCH_INFLIGHT buffers are kept in
+   flight, so -1 also means "try again later". */
+int bcache_prefetch(struct block_device* dev, uint32_t lba, uint32_t count) {
+    if (dev == NULL || prefetch_pending >= BCACHE_PREFETCH_INFLIGHT) {
+        return -1;
+    }
+    if (lba >= dev->sector_count) {
+        return 0;
+    }
+    if (count > dev->sector_count - lba) {
+        count = dev->sector_count - lba;
+    }
+    uint32_t skipped = 0;
+    while (skipped < count && bcache_lookup(dev, lba)) {
+        lba++;
+        skipped++;
+    }
+    count -= skipped;
+    if (count > BCACHE_PREFETCH_MAX) {
+        count = BCACHE_PREFETCH_MAX;
+    }
+    if (count > BCACHE_PREFETCH_INFLIGHT - prefetch_pending) {
+        count = BCACHE_PREFETCH_INFLIGHT - prefetch_pending;
+    }
+    uint32_t run = 0;
+    while (run < count && bcache_lookup(dev, lba + run) == NULL) {
+        run++;
+    }
+    if (run == 0) {
+        return skipped;
+    }
+
+    uint32_t queued = 0;
+    while (queued < run) {
+        struct bcache_buffer* buf = bcache_alloc(dev, lba + queued);
+        if (buf == NULL) {
+            break;
+        }
+        buf->flags = BCACHE_BUSY;
+        counter_add(&prefetch_pending, 1);
+        if (blkq_submit(dev, lba + queued, 1, buf->data, 0, bcache_prefetch_done, buf) != 0) {
+            buf->flags = 0;
+            counter_sub(&prefetch_pending, 1);
+            break;
+        }
+        queued++;
+    }
+    blkq_run();
+    return queued ? (int)(skipped + queued) : -1;
+}
+
+int bcache_read(struct block_device* dev, uint32_t lba, void* buffer) {
+    return bcache_read_sectors(dev, lba, 1, buffer);
+}
+
+/* Cached sectors are copied out of memory; each run of uncached sectors is
+   fetched with a single device request straight into the caller's buffer
+   and then copied into the cache. */
+int bcache_read_sectors(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer) {
+    uint8_t* data = (uint8_t*)buffer;
+    uint32_t i = 0;
+
+    while (i < count) {
+        struct bcache_buffer* buf = bcache_lookup(dev, lba + i);
+        if (buf && (buf->flags & BCACHE_BUSY)) {
+            bcache_wait(buf);
+            continue;
+        }
+        if (buf) {
+            memcpy(data + i * BLOCK_SECTOR_SIZE, buf->data, BLOCK_SECTOR_SIZE);
+            bcache_consume(buf);
+            bcache_touch(buf);
+            stats.hits++;
+            i++;
+            continue;
+        }
+
+        uint32_t run = 1;
+        while (i + run < count && bcache_lookup(dev, lba + i + run) == NULL) {
+            run++;
+        }
+        if (block_read(dev, lba + i, run, data + i * BLOCK_SECTOR_SIZE) != 0) {
+            return -1;
+        }
+        stats.misses += run;
+        for (uint32_t j = 0; j < run; j++) {
+            buf = bcache_alloc(dev, lba + i + j);
+            if (buf == NULL) {
+                return -1;
+            }
+            memcpy(buf->data, data + (i + j) * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+            buf->flags = BCACHE_VALID;
+        }
+        i += run;
+    }
+    return 0;
+}
+
+int bcache_write(struct block_device* dev, uint32_t lba, const void* buffer) {
+    return bcache_write_sectors(dev, lba, 1, buffer);
+}
+
+int bcache_write_sectors(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    const uint8_t* data = (const uint8_t*)buffer;
+
+    if (dev == NULL || lba + count > dev->sector_count) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        struct bcache_buffer* buf = bcache_lookup(dev, lba + i);
+        if (buf && (buf->flags & BCACHE_BUSY)) {
+            bcache_wait(buf);
+            buf = bcache_lookup(dev, lba + i);
+        }
+        if (buf) {
+            if (buf->flags & BCACHE_PREFETCHED) {
+                stats.prefetch_wasted++;
+            }
+            bcache_touch(buf);
+        } else {
+            buf = bcache_alloc(dev, lba + i);
+            if (buf == NULL) {
+                return -1;
+            }
+        }
+        memcpy(buf->data, data + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+        if (!(buf->flags & BCACHE_DIRTY)) {
+            counter_add(&stats.dirty, 1);
+        }
+        buf->flags = BCACHE_VALID | BCACHE_DIRTY;
+    }
+    return 0;
+}
+
+static void bcache_write_done(void* ctx, int status) {
+    struct bcache_buffer* buf = (struct bcache_buffer*)ctx;
+    if (status == 0) {
+        buf->flags &= ~(BCACHE_DIRTY | BCACHE_BUSY);
+        counter_add(&stats.flushes, 1);
+        counter_sub(&stats.dirty, 1);
+    } else {
+        buf->flags &= ~BCACHE_BUSY;
+        flush_failed = 1;
+    }
+}
+
+/* Every dirty buffer goes to the request queue as its own segment; the
+   elevator sorts them into one sweep across the disk and merges
+   neighbouring sectors, so a FAT or directory rewritten sector by sector
+   goes out as a few large writes. */
+int bcache_flush(struct block_device* dev) {
+    if (stats.dirty == 0) {
+        return 0;
+    }
+    flush_failed = 0;
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        struct bcache_buffer* buf = &buffers[i];
+        if (!(buf->flags & BCACHE_DIRTY) || (buf->flags & BCACHE_BUSY) || (dev != NULL && buf->dev != dev)) {
+            continue;
+        }
+        buf->flags |= BCACHE_BUSY;
+        if (blkq_submit(buf->dev, buf->lba, 1, buf->data, 1, bcache_write_done, buf) != 0) {
+            buf->flags &= ~BCACHE_BUSY;
+            if (bcache_writeback(buf) != 0) {
+                flush_failed = 1;
+            }
+        }
+    }
+    blkq_drain();
+    return flush_failed ? -1 : 0;
+}
+
+void bcache_invalidate(struct block_device* dev) {
+    blkq_drain();
+    for (int i = 0; i < BCACHE_BUFFERS; i++) {
+        struct bcache_buffer* buf = &buffers[i];
+        if (buf->dev == NULL || buf->dev != dev) {
+            continue;
+        }
+        if (buf->flags & BCACHE_DIRTY) {
+            counter_sub(&stats.dirty, 1);
+        }
+        if (buf->flags & BCACHE_PREFETCHED) {
+            stats.prefetch_wasted++;
+        }
+        hash_unlink(buf);
+        buf->dev = NULL;
+        buf->flags = 0;
+        lru_unlink(buf);
+        if (lru_tail) {
+            lru_tail->lru_next = buf;
+            buf->lru_prev = lru_tail;
+            lru_tail = buf;
+        } else {
+            lru_head = buf;
+            lru_tail = buf;
+        }
+    }
+}
+
+void bcache_get_stats(struct bcache_stats* out) {
+    out->hits = stats.hits;
+    out->misses = stats.misses;
+    out->flushes = stats.flushes;
+    out->evictions = stats.evictions;
+    out->dirty = stats.dirty;
+    out->prefetched = stats.prefetched;
+    out->prefetch_hits = stats.prefetch_hits;
+    out->prefetch_wasted = stats.prefetch_wasted;
+}
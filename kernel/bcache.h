@@ -0,0 +1,50 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "kernel.h"
+#include "block.h"
+
+/* Definitions */
+#define BCACHE_BUFFERS 64
+#define BCACHE_HASH_SIZE 64
+#define BCACHE_VALID 0x01
+#define BCACHE_DIRTY 0x02
+#define BCACHE_BUSY 0x04
+#define BCACHE_PREFETCHED 0x08
+#define BCACHE_PREFETCH_MAX 16
+#define BCACHE_PREFETCH_INFLIGHT 32
+
+/* Struct Creation */
+struct bcache_buffer {
+    struct block_device* dev;
+    uint32_t lba;
+    volatile uint8_t flags;
+    uint8_t* data;
+    struct bcache_buffer* hash_next;
+    struct bcache_buffer* lru_prev;
+    struct bcache_buffer* lru_next;
+};
+
+struct bcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t flushes;
+    uint32_t evictions;
+    uint32_t dirty;
+    uint32_t prefetched;
+    uint32_t prefetch_hits;
+    uint32_t prefetch_wasted;
+};
+
+/* Function Declarations */
+void bcache_init();
+int bcache_read(struct block_device* dev, uint32_t lba, void* buffer);
+int bcache_read_sectors(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer);
+int bcache_write(struct block_device* dev, uint32_t lba, const void* buffer);
+int bcache_write_sectors(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer);
+int bcache_prefetch(struct block_device* dev, uint32_t lba, uint32_t count);
+int bcache_flush(struct block_device* dev);
+void bcache_invalidate(struct block_device* dev);
+void bcache_get_stats(struct bcache_stats* out);
+
+#endif
@@ -0,0 +1,296 @@
+#include "blkq.h"
+#include "mem.h"
+
+/* Function Declarations */
+static int interrupts_enabled();
+static int blkq_pick();
+static uint32_t blkq_gather(int first);
+static int blkq_transfer(struct block_device* dev, uint32_t lba, uint32_t count, int write);
+static void blkq_finish(int status);
+static void blkq_irq_done(void* ctx, int status);
+static void blkq_dispatch(int allow_sync);
+
+/* Global Variables */
+static struct blkq_segment segments[BLKQ_DEPTH];
+static int active[BLKQ_MAX_MERGE];
+static int active_count = 0;
+static uint8_t* active_buffers[BLKQ_MAX_MERGE];
+static struct block_device* active_dev = NULL;
+static volatile int busy = 0;
+static uint32_t head_lba = 0;
+static uint8_t bounce[BLKQ_MAX_MERGE * BLOCK_SECTOR_SIZE] __attribute__((aligned(BLOCK_SECTOR_SIZE)));
+static uint64_t (*clock_source)() = NULL;
+static struct blkq_stats stats;
+
+static int interrupts_enabled() {
+    unsigned long eflags;
+    __asm__ volatile("pushf; pop %0" : "=r"(eflags));
+    return (eflags & 0x200) != 0;
+}
+
+/* Latencies are kept in whatever unit the clock counts, TSC cycles in the
+   kernel. Without a clock they read as zero. */
+void blkq_set_clock(uint64_t (*clock)()) {
+    clock_source = clock;
+}
+
+/* Queues a transfer of count sectors to or from buffer. Nothing reaches
+   the device until blkq_run() or blkq_drain(), so a caller queueing many
+   segments gets them sorted and merged first. done runs once the data has
+   moved, from the disk interrupt when the device completes asynchronously. */
+int blkq_submit(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer, int write,
+                void (*done)(void* ctx, int status), void* ctx) {
+    if (dev == NULL || count == 0 || count > BLKQ_MAX_MERGE || lba + count > dev->sector_count) {
+        return -1;
+    }
+    int slot = -1;
+    for (int pass = 0; pass < 2 && slot < 0; pass++) {
+        if (pass == 1) {
+            blkq_drain();
+        }
+        for (int i = 0; i < BLKQ_DEPTH; i++) {
+            if (segments[i].state == BLKQ_FREE) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        return -1;
+    }
+    struct blkq_segment* seg = &segments[slot];
+    seg->dev = dev;
+    seg->lba = lba;
+    seg->count = count;
+    seg->buffer = (uint8_t*)buffer;
+    seg->write = write != 0;
+    seg->done = done;
+    seg->ctx = ctx;
+    seg->submitted = clock_source ? clock_source() : 0;
+    stats.submitted++;
+    // published last, as the interrupt handler may be scanning the queue;
+    // the barrier keeps the compiler from sinking the stores above past it
+    __asm__ volatile("" : : : "memory");
+    seg->state = BLKQ_PENDING;
+    return 0;
+}
+
+/* C-LOOK: the lowest pending segment at or above where the last command
+   ended, or the lowest of all once the sweep has passed the rest. */
+static int blkq_pick() {
+    int best = -1;
+    int lowest = -1;
+    for (int i = 0; i < BLKQ_DEPTH; i++) {
+        if (segments[i].state != BLKQ_PENDING) {
+            continue;
+        }
+        if (segments[i].lba >= head_lba && (best < 0 || segments[i].lba < segments[best].lba)) {
+            best = i;
+        }
+        if (lowest < 0 || segments[i].lba < segments[lowest].lba) {
+            lowest = i;
+        }
+    }
+    return best >= 0 ? best : lowest;
+}
+
+/* Grows a command around the first segment with pending segments going
+   the same way that start where it ends or end where it starts, up to
+   what the device takes in one command. Returns its length in sectors. */
+static uint32_t blkq_gather(int first) {
+    struct blkq_segment* seg = &segments[first];
+    uint32_t start = seg->lba;
+    uint32_t end = seg->lba + seg->count;
+    uint32_t limit = BLKQ_MAX_MERGE;
+    int found = 1;
+
+    if (seg->dev->max_transfer && seg->dev->max_transfer < limit) {
+        limit = seg->dev->max_transfer;
+    }
+    active[0] = first;
+    active_count = 1;
+    seg->state = BLKQ_ACTIVE;
+    while (found) {
+        found = 0;
+        for (int i = 0; i < BLKQ_DEPTH; i++) {
+            struct blkq_segment* other = &segments[i];
+            if (other->state != BLKQ_PENDING || other->dev != seg->dev || other->write != seg->write ||
+                end - start + other->count > limit) {
+                continue;
+            }
+            if (other->lba == end) {
+                active[active_count++] = i;
+                end += other->count;
+            } else if (other->lba + other->count == start) {
+                for (int j = active_count; j > 0; j--) {
+                    active[j] = active[j - 1];
+                }
+                active[0] = i;
+                active_count++;
+                start = other->lba;
+            } else {
+                continue;
+            }
+            other->state = BLKQ_ACTIVE;
+            stats.merged++;
+            found = 1;
+        }
+    }
+
+    uint32_t n = 0;
+    for (int i = 0; i < active_count; i++) {
+        struct blkq_segment* part = &segments[active[i]];
+        for (uint32_t s = 0; s < part->count; s++) {
+            active_buffers[n++] = part->buffer + s * BLOCK_SECTOR_SIZE;
+        }
+    }
+    active_dev = seg->dev;
+    return n;
+}
+
+/* Synchronous fallback for devices without asynchronous transfers. Merged
+   segments whose buffers are not laid out back to back go through the
+   bounce buffer so the command still goes out whole. */
+static int blkq_transfer(struct block_device* dev, uint32_t lba, uint32_t count, int write) {
+    int contiguous = 1;
+    for (uint32_t i = 1; i < count; i++) {
+        if (active_buffers[i] != active_buffers[i - 1] + BLOCK_SECTOR_SIZE) {
+            contiguous = 0;
+            break;
+        }
+    }
+    if (contiguous) {
+        return write ? block_write(dev, lba, count, active_buffers[0]) : block_read(dev, lba, count, active_buffers[0]);
+    }
+    if (write) {
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(bounce + i * BLOCK_SECTOR_SIZE, active_buffers[i], BLOCK_SECTOR_SIZE);
+        }
+        return block_write(dev, lba, count, bounce);
+    }
+    if (block_read(dev, lba, count, bounce) != 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(active_buffers[i], bounce + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+    }
+    return 0;
+}
+
+static void blkq_finish(int status) {
+    uint64_t now = clock_source ? clock_source() : 0;
+    int count = active_count;
+
+    active_count = 0;
+    if (status != 0) {
+        stats.errors++;
+    }
+    for (int i = 0; i < count; i++) {
+        struct blkq_segment* seg = &segments[active[i]];
+        void (*done)(void* ctx, int status) = seg->done;
+        void* ctx = seg->ctx;
+        uint64_t latency = now - seg->submitted;
+        stats.latency_total += latency;
+        if (latency > stats.latency_max) {
+            stats.latency_max = latency;
+        }
+        stats.completed++;
+        seg->state = BLKQ_FREE;
+        if (done) {
+            done(ctx, status);
+        }
+    }
+    busy = 0;
+}
+
+/* Runs from the disk interrupt: completes the command and starts the next
+   one, so a queue of read-ahead keeps the disk busy without the task. */
+static void blkq_irq_done(void* ctx, int status) {
+    (void)ctx;
+    blkq_finish(status);
+    blkq_dispatch(0);
+}
+
+/* Issues commands until the queue is empty or one is left running in the
+   background. From interrupt context a command the device will not start
+   asynchronously is put back for the next blkq_run() or blkq_drain(). */
+static void blkq_dispatch(int allow_sync) {
+    while (!busy) {
+        int first = blkq_pick();
+        if (first < 0) {
+            return;
+        }
+        int write = segments[first].write;
+        uint32_t count = blkq_gather(first);
+        uint32_t lba = segments[active[0]].lba;
+        busy = 1;
+        stats.dispatched++;
+        head_lba = lba + count;
+        int started = write ? block_write_async(active_dev, lba, count, active_buffers, blkq_irq_done, NULL)
+                            : block_read_async(active_dev, lba, count, active_buffers, blkq_irq_done, NULL);
+        if (started == 0) {
+            return;
+        }
+        if (!allow_sync) {
+            for (int i = 0; i < active_count; i++) {
+                segments[active[i]].state = BLKQ_PENDING;
+            }
+            active_count = 0;
+            stats.dispatched--;
+            busy = 0;
+            return;
+        }
+        blkq_finish(blkq_transfer(active_dev, lba, count, write));
+    }
+}
+
+/* Starts work on whatever is queued; returns at once if a command is
+   already running, as its interrupt carries the queue on. */
+void blkq_run() {
+    blkq_dispatch(1);
+}
+
+/* Waits until every queued segment has completed. With interrupts off,
+   as in the shell, the device is polled for completions instead. */
+void blkq_drain() {
+    while (1) {
+        blkq_dispatch(1);
+        if (!busy) {
+            return;
+        }
+        if (!interrupts_enabled()) {
+            block_poll(active_dev);
+            continue;
+        }
+        __asm__ volatile("cli" : : : "memory");
+        if (busy) {
+            __asm__ volatile("sti; hlt" : : : "memory");
+        } else {
+            __asm__ volatile("sti" : : : "memory");
+        }
+    }
+}
+
+int blkq_busy() {
+    return busy;
+}
+
+void blkq_get_stats(struct blkq_stats* out) {
+    out->submitted = stats.submitted;
+    out->merged = stats.merged;
+    out->dispatched = stats.dispatched;
+    out->completed = stats.completed;
+    out->errors = stats.errors;
+    out->latency_total = stats.latency_total;
+    out->latency_max = stats.latency_max;
+}
+
+void blkq_reset_stats() {
+    stats.submitted = 0;
+    stats.merged = 0;
+    stats.dispatched = 0;
+    stats.completed = 0;
+    stats.errors = 0;
+    stats.latency_total = 0;
+    stats.latency_max = 0;
+}
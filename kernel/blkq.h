@@ -0,0 +1,47 @@
+#ifndef BLKQ_H
+#define BLKQ_H
+
+#include "kernel.h"
+#include "block.h"
+
+/* Definitions */
+#define BLKQ_DEPTH 128
+#define BLKQ_MAX_MERGE 64
+#define BLKQ_FREE 0
+#define BLKQ_PENDING 1
+#define BLKQ_ACTIVE 2
+
+/* Struct Creation */
+struct blkq_segment {
+    struct block_device* dev;
+    uint32_t lba;
+    uint32_t count;
+    uint8_t* buffer;
+    uint8_t write;
+    volatile uint8_t state;
+    void (*done)(void* ctx, int status);
+    void* ctx;
+    uint64_t submitted;
+};
+
+struct blkq_stats {
+    uint32_t submitted;
+    uint32_t merged;
+    uint32_t dispatched;
+    uint32_t completed;
+    uint32_t errors;
+    uint64_t latency_total;
+    uint64_t latency_max;
+};
+
+/* Function Declarations */
+void blkq_set_clock(uint64_t (*clock)());
+int blkq_submit(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer, int write,
+                void (*done)(void* ctx, int status), void* ctx);
+void blkq_run();
+void blkq_drain();
+int blkq_busy();
+void blkq_get_stats(struct blkq_stats* out);
+void blkq_reset_stats();
+
+#endif
@@ -0,0 +1,144 @@
+#include "block.h"
+
+/* Global Variables */
+static struct block_device* devices[BLOCK_MAX_DEVICES];
+static int device_count = 0;
+
+int block_register(struct block_device* dev) {
+    if (dev == NULL || device_count >= BLOCK_MAX_DEVICES) {
+        return -1;
+    }
+    devices[device_count] = dev;
+    return device_count++;
+}
+
+struct block_device* block_get_device(int index) {
+    if (index < 0 || index >= device_count) {
+        return NULL;
+    }
+    return devices[index];
+}
+
+/* Requests larger than the device's per-command limit are split here so
+   drivers only ever see transfers they can issue as a single command. */
+int block_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer) {
+    if (dev == NULL || lba + count > dev->sector_count || lba + count < lba) {
+        return -1;
+    }
+    uint8_t* data = (uint8_t*)buffer;
+    while (count > 0) {
+        uint32_t chunk = count;
+        if (dev->max_transfer && chunk > dev->max_transfer) {
+            chunk = dev->max_transfer;
+        }
+        if (dev->read(dev, lba, chunk, data) != 0) {
+            dev->errors++;
+            return -1;
+        }
+        dev->read_requests++;
+        dev->sectors_read += chunk;
+        lba += chunk;
+        count -= chunk;
+        data += chunk * BLOCK_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+int block_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    if (dev == NULL || lba + count > dev->sector_count || lba + count < lba) {
+        return -1;
+    }
+    const uint8_t* data = (const uint8_t*)buffer;
+    while (count > 0) {
+        uint32_t chunk = count;
+        if (dev->max_transfer && chunk > dev->max_transfer) {
+            chunk = dev->max_transfer;
+        }
+        if (dev->write(dev, lba, chunk, data) != 0) {
+            dev->errors++;
+            return -1;
+        }
+        dev->write_requests++;
+        dev->sectors_written += chunk;
+        lba += chunk;
+        count -= chunk;
+        data += chunk * BLOCK_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+/* Starts a read into one buffer per sector and returns without waiting.
+   Fails when the device cannot take an asynchronous request right now,
+   in which case the caller falls back to block_read(). */
+int block_read_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                     void (*done)(void* ctx, int status), void* ctx) {
+    if (dev == NULL || dev->read_async == NULL || lba + count > dev->sector_count || lba + count < lba) {
+        return -1;
+    }
+    if (dev->max_transfer && count > dev->max_transfer) {
+        return -1;
+    }
+    if (dev->read_async(dev, lba, count, buffers, done, ctx) != 0) {
+        return -1;
+    }
+    dev->read_requests++;
+    dev->sectors_read += count;
+    return 0;
+}
+
+int block_write_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                      void (*done)(void* ctx, int status), void* ctx) {
+    if (dev == NULL || dev->write_async == NULL || lba + count > dev->sector_count || lba + count < lba) {
+        return -1;
+    }
+    if (dev->max_transfer && count > dev->max_transfer) {
+        return -1;
+    }
+    if (dev->write_async(dev, lba, count, buffers, done, ctx) != 0) {
+        return -1;
+    }
+    dev->write_requests++;
+    dev->sectors_written += count;
+    return 0;
+}
+
+/* Completes an outstanding asynchronous request by polling the device,
+   for callers waiting with interrupts disabled. */
+void block_poll(struct block_device* dev) {
+    if (dev != NULL && dev->poll) {
+        dev->poll(dev);
+    }
+}
+
+int block_flush(struct block_device* dev) {
+    if (dev == NULL) {
+        return -1;
+    }
+    if (dev->flush) {
+        return dev->flush(dev);
+    }
+    return 0;
+}
+
+/* Returns where sectors [lba, lba + count) live in memory on devices that
+   keep them there, such as a RAM disk, or NULL. Writes through the pointer
+   land on the device directly. */
+void* block_map(struct block_device* dev, uint32_t lba, uint32_t count) {
+    if (dev == NULL || dev->map == NULL || lba + count > dev->sector_count || lba + count < lba) {
+        return NULL;
+    }
+    return dev->map(dev, lba);
+}
+
+/* Returns the mode actually in effect, which is PIO for devices that have
+   no DMA engine or failed to set one up. */
+int block_set_mode(struct block_device* dev, int mode) {
+    if (dev == NULL) {
+        return -1;
+    }
+    if (dev->set_mode == NULL || dev->set_mode(dev, mode) != 0) {
+        return dev->mode;
+    }
+    dev->mode = mode;
+    return dev->mode;
+}
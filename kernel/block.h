@@ -0,0 +1,50 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_MAX_DEVICES 4
+#define BLOCK_MODE_PIO 0
+#define BLOCK_MODE_DMA 1
+
+/* Struct Creation */
+struct block_device {
+    const char* name;
+    uint32_t sector_count;
+    uint32_t max_transfer;
+    int (*read)(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer);
+    int (*write)(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer);
+    int (*flush)(struct block_device* dev);
+    int (*set_mode)(struct block_device* dev, int mode);
+    int (*read_async)(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                      void (*done)(void* ctx, int status), void* ctx);
+    int (*write_async)(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                       void (*done)(void* ctx, int status), void* ctx);
+    void (*poll)(struct block_device* dev);
+    void* (*map)(struct block_device* dev, uint32_t lba);
+    int mode;
+    void* data;
+    uint32_t read_requests;
+    uint32_t write_requests;
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    uint32_t errors;
+};
+
+/* Function Declarations */
+int block_register(struct block_device* dev);
+struct block_device* block_get_device(int index);
+int block_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer);
+int block_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer);
+int block_flush(struct block_device* dev);
+int block_set_mode(struct block_device* dev, int mode);
+int block_read_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                     void (*done)(void* ctx, int status), void* ctx);
+int block_write_async(struct block_device* dev, uint32_t lba, uint32_t count, uint8_t** buffers,
+                      void (*done)(void* ctx, int status), void* ctx);
+void block_poll(struct block_device* dev);
+void* block_map(struct block_device* dev, uint32_t lba, uint32_t count);
+
+#endif
@@ -0,0 +1,317 @@
+#include "frame.h"
+#include "mem.h"
+
+/* Definitions */
+#define FRAME_FREE 0x80
+#define FRAME_RESERVED 0x40
+#define FRAME_TAIL 0x20
+#define FRAME_AVAILABLE 0x10
+
+/* Struct Creation */
+struct frame_node {
+    struct frame_node* prev;
+    struct frame_node* next;
+};
+
+/* Function Declarations */
+static int e820_usable(const struct e820_entry* entry);
+static size_t align_up(uint64_t addr);
+static void mark_frames(uint64_t base, uint64_t end, uint8_t value, int inward);
+static size_t place_info(const struct e820_map* map, const struct frame_range* ranges, int count, uint64_t limit);
+static struct frame_node* frame_node(uint32_t index);
+static void list_push(uint32_t index, uint32_t order);
+static void list_remove(uint32_t index, uint32_t order);
+
+/* Global Variables */
+static uint8_t* frame_info = NULL;
+static size_t frame_base = 0;
+static uint32_t frame_count = 0;
+static struct frame_node* free_lists[FRAME_ORDERS];
+static struct frame_stats stats;
+
+/* Entries from BIOSes that only fill in 20 bytes keep the valid bit the
+   bootloader preset. */
+static int e820_usable(const struct e820_entry* entry) {
+    return entry->type == E820_USABLE && (entry->attributes & E820_ATTR_VALID) && entry->length != 0;
+}
+
+static size_t align_up(uint64_t addr) {
+    return (size_t)((addr + FRAME_SIZE - 1) & ~(uint64_t)(FRAME_SIZE - 1));
+}
+
+/* Sets the frames in [base, end): only those wholly inside the range when
+   inward, as for usable memory, or every frame it touches otherwise. */
+static void mark_frames(uint64_t base, uint64_t end, uint8_t value, int inward) {
+    uint64_t top = frame_base + ((uint64_t)frame_count << FRAME_SHIFT);
+    if (base < frame_base) {
+        base = frame_base;
+    }
+    if (end > top) {
+        end = top;
+    }
+    if (base >= end) {
+        return;
+    }
+    uint64_t first = (base - frame_base) >> FRAME_SHIFT;
+    uint64_t last = (end - frame_base) >> FRAME_SHIFT;
+    if (inward && ((base - frame_base) & (FRAME_SIZE - 1))) {
+        first++;
+    }
+    if (!inward && ((end - frame_base) & (FRAME_SIZE - 1))) {
+        last++;
+    }
+    for (uint64_t i = first; i < last; i++) {
+        frame_info[i] = value;
+    }
+}
+
+/* The per-frame state array goes in the first usable memory clear of the
+   reserved ranges and of anything the BIOS holds back, so its size follows
+   the machine. */
+static size_t place_info(const struct e820_map* map, const struct frame_range* ranges, int count, uint64_t limit) {
+    for (uint32_t i = 0; i < map->count && i < E820_MAX; i++) {
+        const struct e820_entry* entry = &map->entries[i];
+        if (!e820_usable(entry)) {
+            continue;
+        }
+        uint64_t end = entry->base + entry->length;
+        if (end > limit) {
+            end = limit;
+        }
+        uint64_t candidate = align_up(entry->base);
+        int moved = 1;
+        while (moved) {
+            moved = 0;
+            for (int r = 0; r < count; r++) {
+                uint64_t r_end = (uint64_t)ranges[r].base + ranges[r].length;
+                if (candidate < r_end && candidate + frame_count > ranges[r].base) {
+                    candidate = align_up(r_end);
+                    moved = 1;
+                }
+            }
+            // nor on memory an overlapping entry holds back
+            for (uint32_t j = 0; j < map->count && j < E820_MAX; j++) {
+                const struct e820_entry* held = &map->entries[j];
+                uint64_t held_end = held->base + held->length;
+                if (held->type != E820_USABLE && candidate < held_end && candidate + frame_count > held->base) {
+                    candidate = align_up(held_end);
+                    moved = 1;
+                }
+            }
+        }
+        if (candidate + frame_count <= end) {
+            return (size_t)candidate;
+        }
+    }
+    return 0;
+}
+
+static struct frame_node* frame_node(uint32_t index) {
+    return (struct frame_node*)(frame_base + ((size_t)index << FRAME_SHIFT));
+}
+
+/* Free blocks are kept on one doubly linked list per order, threaded
+   through the first bytes of each block itself. */
+static void list_push(uint32_t index, uint32_t order) {
+    struct frame_node* node = frame_node(index);
+    node->prev = NULL;
+    node->next = free_lists[order];
+    if (free_lists[order] != NULL) {
+        free_lists[order]->prev = node;
+    }
+    free_lists[order] = node;
+    frame_info[index] = FRAME_FREE | order;
+    stats.free_blocks[order]++;
+    stats.free_frames += 1u << order;
+}
+
+static void list_remove(uint32_t index, uint32_t order) {
+    struct frame_node* node = frame_node(index);
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        free_lists[order] = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    stats.free_blocks[order]--;
+    stats.free_frames -= 1u << order;
+}
+
+/* Takes over the usable memory in the BIOS map, less the reserved ranges
+   (low memory and the kernel image, at boot). Each run of free frames is
+   cut into the largest aligned blocks that fit, up to FRAME_MAX_ORDER. */
+int frame_init(const struct e820_map* map, const struct frame_range* reserved, int reserved_count) {
+    struct frame_range ranges[FRAME_MAX_RESERVED + 1];
+    uint64_t limit = sizeof(size_t) < 8 ? 0x100000000ULL : ~0ULL - FRAME_SIZE;
+    uint64_t low = limit;
+    uint64_t high = 0;
+
+    if (map == NULL || reserved_count < 0 || reserved_count > FRAME_MAX_RESERVED) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < map->count && i < E820_MAX; i++) {
+        const struct e820_entry* entry = &map->entries[i];
+        uint64_t end = entry->base + entry->length;
+        if (!e820_usable(entry) || entry->base >= limit) {
+            continue;
+        }
+        if (end > limit) {
+            end = limit;
+        }
+        if (entry->base < low) {
+            low = entry->base;
+        }
+        if (end > high) {
+            high = end;
+        }
+    }
+    if (high <= low) {
+        return -1;
+    }
+    // blocks are aligned to their size in physical memory too
+    frame_base = (size_t)(low & ~(((uint64_t)FRAME_SIZE << FRAME_MAX_ORDER) - 1));
+    frame_count = (uint32_t)((high - frame_base) >> FRAME_SHIFT);
+
+    for (int i = 0; i < reserved_count; i++) {
+        ranges[i] = reserved[i];
+    }
+    size_t info = place_info(map, ranges, reserved_count, limit);
+    if (info == 0) {
+        return -1;
+    }
+    ranges[reserved_count].base = info;
+    ranges[reserved_count].length = frame_count;
+    frame_info = (uint8_t*)info;
+
+    memset(frame_info, FRAME_RESERVED, frame_count);
+    for (uint32_t i = 0; i < map->count && i < E820_MAX; i++) {
+        const struct e820_entry* entry = &map->entries[i];
+        if (e820_usable(entry)) {
+            mark_frames(entry->base, entry->base + entry->length, FRAME_AVAILABLE, 1);
+        }
+    }
+    // entries may overlap, and anything the BIOS holds back wins
+    for (uint32_t i = 0; i < map->count && i < E820_MAX; i++) {
+        const struct e820_entry* entry = &map->entries[i];
+        if (entry->type != E820_USABLE) {
+            mark_frames(entry->base, entry->base + entry->length, FRAME_RESERVED, 0);
+        }
+    }
+    for (int i = 0; i <= reserved_count; i++) {
+        mark_frames(ranges[i].base, (uint64_t)ranges[i].base + ranges[i].length, FRAME_RESERVED, 0);
+    }
+
+    for (int i = 0; i < FRAME_ORDERS; i++) {
+        free_lists[i] = NULL;
+        stats.free_blocks[i] = 0;
+    }
+    stats.free_frames = 0;
+    stats.allocations = 0;
+    stats.frees = 0;
+    stats.failures = 0;
+
+    uint32_t index = 0;
+    while (index < frame_count) {
+        if (frame_info[index] != FRAME_AVAILABLE) {
+            index++;
+            continue;
+        }
+        uint32_t end = index;
+        while (end < frame_count && frame_info[end] == FRAME_AVAILABLE) {
+            end++;
+        }
+        while (index < end) {
+            uint32_t order = FRAME_MAX_ORDER;
+            while (order > 0 && ((index & ((1u << order) - 1)) || index + (1u << order) > end)) {
+                order--;
+            }
+            for (uint32_t i = 1; i < (1u << order); i++) {
+                frame_info[index + i] = FRAME_TAIL;
+            }
+            list_push(index, order);
+            index += 1u << order;
+        }
+    }
+    stats.total_frames = stats.free_frames;
+    return 0;
+}
+
+/* Returns the address of 2^order contiguous frames aligned to their size,
+   or 0. The smallest free block that fits is split in halves down to the
+   order asked for, so this is O(log n) in the size of memory. */
+size_t frame_alloc(uint32_t order) {
+    uint32_t k = order;
+    if (frame_info == NULL || order > FRAME_MAX_ORDER) {
+        stats.failures++;
+        return 0;
+    }
+    while (k <= FRAME_MAX_ORDER && free_lists[k] == NULL) {
+        k++;
+    }
+    if (k > FRAME_MAX_ORDER) {
+        stats.failures++;
+        return 0;
+    }
+    uint32_t index = (uint32_t)(((size_t)free_lists[k] - frame_base) >> FRAME_SHIFT);
+    list_remove(index, k);
+    while (k > order) {
+        k--;
+        list_push(index + (1u << k), k);
+    }
+    frame_info[index] = order;
+    stats.allocations++;
+    return frame_base + ((size_t)index << FRAME_SHIFT);
+}
+
+/* Gives back a block from frame_alloc(), merging it with its buddy for as
+   long as the buddy is free. Fails on addresses that are not the start of
+   an allocated block, which catches double frees. */
+int frame_free(size_t addr) {
+    if (frame_info == NULL || addr < frame_base || (addr & (FRAME_SIZE - 1))) {
+        return -1;
+    }
+    size_t offset = (addr - frame_base) >> FRAME_SHIFT;
+    if (offset >= frame_count) {
+        return -1;
+    }
+    uint32_t index = (uint32_t)offset;
+    uint32_t order = frame_info[index];
+    if (order > FRAME_MAX_ORDER) {
+        return -1;
+    }
+    while (order < FRAME_MAX_ORDER) {
+        uint32_t buddy = index ^ (1u << order);
+        if (buddy >= frame_count || frame_info[buddy] != (FRAME_FREE | order)) {
+            break;
+        }
+        list_remove(buddy, order);
+        if (buddy < index) {
+            frame_info[index] = FRAME_TAIL;
+            index = buddy;
+        } else {
+            frame_info[buddy] = FRAME_TAIL;
+        }
+        order++;
+    }
+    list_push(index, order);
+    stats.frees++;
+    return 0;
+}
+
+/* The end of the highest memory the allocator manages. */
+size_t frame_limit() {
+    return frame_base + ((size_t)frame_count << FRAME_SHIFT);
+}
+
+void frame_get_stats(struct frame_stats* out) {
+    out->total_frames = stats.total_frames;
+    out->free_frames = stats.free_frames;
+    for (int i = 0; i < FRAME_ORDERS; i++) {
+        out->free_blocks[i] = stats.free_blocks[i];
+    }
+    out->allocations = stats.allocations;
+    out->frees = stats.frees;
+    out->failures = stats.failures;
+}
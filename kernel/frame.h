@@ -0,0 +1,51 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define FRAME_SIZE 4096
+#define FRAME_SHIFT 12
+#define FRAME_MAX_ORDER 10
+#define FRAME_ORDERS (FRAME_MAX_ORDER + 1)
+#define FRAME_MAX_RESERVED 8
+#define E820_MAX 32
+#define E820_USABLE 1
+#define E820_ATTR_VALID 0x01
+
+/* Struct Creation */
+struct e820_entry {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t attributes;
+} __attribute__((packed));
+
+/* Built by boot.asm at 0x8000 and handed to _start(). */
+struct e820_map {
+    uint32_t count;
+    struct e820_entry entries[E820_MAX];
+} __attribute__((packed));
+
+struct frame_range {
+    size_t base;
+    size_t length;
+};
+
+struct frame_stats {
+    uint32_t total_frames;
+    uint32_t free_frames;
+    uint32_t free_blocks[FRAME_ORDERS];
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+};
+
+/* Function Declarations */
+int frame_init(const struct e820_map* map, const struct frame_range* reserved, int reserved_count);
+size_t frame_alloc(uint32_t order);
+int frame_free(size_t addr);
+size_t frame_limit();
+void frame_get_stats(struct frame_stats* out);
+
+#endif
@@ -0,0 +1,243 @@
+#include "heap.h"
+#include "frame.h"
+
+/* Function Declarations */
+static uint32_t align_to(uint32_t value, uint32_t align);
+static void slab_unlink(struct slab** list, struct slab* slab);
+static void slab_push(struct slab** list, struct slab* slab);
+static struct slab* slab_create(struct kmem_cache* cache);
+
+/* Global Variables */
+static struct kmem_cache caches[HEAP_MAX_CACHES];
+static int cache_count = 0;
+static struct kmem_cache* size_classes[HEAP_CLASSES];
+static struct heap_stats stats;
+static const char* class_names[HEAP_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256", "kmalloc-512", "kmalloc-1024"
+};
+
+static uint32_t align_to(uint32_t value, uint32_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+/* Sets up the general purpose size classes. Needs the frame allocator. */
+int heap_init() {
+    cache_count = 0;
+    stats.large_allocations = 0;
+    stats.large_frees = 0;
+    stats.failures = 0;
+    for (int i = 0; i < HEAP_CLASSES; i++) {
+        size_classes[i] = kmem_cache_create(class_names[i], HEAP_MIN_CLASS << i, HEAP_MIN_ALIGN);
+        if (size_classes[i] == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* A cache of objects of one size, carved from single-frame slabs with the
+   slab header at the start of the frame. align must be a power of two;
+   objects of more than about a frame do not fit and belong in kmalloc(). */
+struct kmem_cache* kmem_cache_create(const char* name, uint32_t size, uint32_t align) {
+    if (cache_count >= HEAP_MAX_CACHES || size == 0 || align == 0 || (align & (align - 1))) {
+        return NULL;
+    }
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+    struct kmem_cache* cache = &caches[cache_count];
+    cache->name = name;
+    cache->object_size = align_to(size, align);
+    cache->first_offset = align_to(sizeof(struct slab), align);
+    if (cache->first_offset + cache->object_size > FRAME_SIZE) {
+        return NULL;
+    }
+    cache->per_slab = (FRAME_SIZE - cache->first_offset) / cache->object_size;
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->slabs = 0;
+    cache->empty_slabs = 0;
+    cache->active = 0;
+    cache->allocations = 0;
+    cache->frees = 0;
+    cache->failures = 0;
+    cache_count++;
+    return cache;
+}
+
+static void slab_unlink(struct slab** list, struct slab* slab) {
+    if (slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+static void slab_push(struct slab** list, struct slab* slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+static struct slab* slab_create(struct kmem_cache* cache) {
+    struct slab* slab = (struct slab*)frame_alloc(0);
+    if (slab == NULL) {
+        return NULL;
+    }
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free = NULL;
+    uint8_t* object = (uint8_t*)slab + cache->first_offset + (cache->per_slab - 1) * cache->object_size;
+    for (uint32_t i = 0; i < cache->per_slab; i++) {
+        *(void**)object = slab->free;
+        slab->free = object;
+        object -= cache->object_size;
+    }
+    cache->slabs++;
+    return slab;
+}
+
+/* Partly used slabs are filled first so empty ones can go back to the
+   frame allocator; one empty slab is kept to absorb alloc/free churn. */
+void* kmem_cache_alloc(struct kmem_cache* cache) {
+    if (cache == NULL) {
+        return NULL;
+    }
+    struct slab* slab = cache->partial;
+    if (slab == NULL) {
+        slab = cache->empty;
+        if (slab != NULL) {
+            slab_unlink(&cache->empty, slab);
+            cache->empty_slabs--;
+        } else {
+            slab = slab_create(cache);
+            if (slab == NULL) {
+                cache->failures++;
+                return NULL;
+            }
+        }
+        slab_push(&cache->partial, slab);
+    }
+    void* object = slab->free;
+    slab->free = *(void**)object;
+    slab->in_use++;
+    if (slab->in_use == cache->per_slab) {
+        slab_unlink(&cache->partial, slab);
+        slab_push(&cache->full, slab);
+    }
+    cache->active++;
+    cache->allocations++;
+    return object;
+}
+
+void kmem_cache_free(struct kmem_cache* cache, void* object) {
+    if (object == NULL) {
+        return;
+    }
+    struct slab* slab = (struct slab*)((size_t)object & ~(size_t)(FRAME_SIZE - 1));
+    if (slab->cache != cache) {
+        return;
+    }
+    if (slab->in_use == cache->per_slab) {
+        slab_unlink(&cache->full, slab);
+        slab_push(&cache->partial, slab);
+    }
+    *(void**)object = slab->free;
+    slab->free = object;
+    slab->in_use--;
+    cache->active--;
+    cache->frees++;
+    if (slab->in_use == 0) {
+        slab_unlink(&cache->partial, slab);
+        if (cache->empty_slabs > 0) {
+            frame_free((size_t)slab);
+            cache->slabs--;
+        } else {
+            slab_push(&cache->empty, slab);
+            cache->empty_slabs++;
+        }
+    }
+}
+
+/* Requests up to HEAP_MAX_CLASS bytes come from the power of two size
+   classes; larger ones take whole frames. Slab objects never start on a
+   frame boundary, which is how kfree() tells the two apart. */
+void* kmalloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (size <= HEAP_MAX_CLASS) {
+        int index = 0;
+        while ((size_t)(HEAP_MIN_CLASS << index) < size) {
+            index++;
+        }
+        if (size_classes[index] == NULL) {
+            stats.failures++;
+            return NULL;
+        }
+        void* object = kmem_cache_alloc(size_classes[index]);
+        if (object == NULL) {
+            stats.failures++;
+        }
+        return object;
+    }
+    uint32_t order = 0;
+    while (order <= FRAME_MAX_ORDER && ((size_t)FRAME_SIZE << order) < size) {
+        order++;
+    }
+    if (order > FRAME_MAX_ORDER) {
+        stats.failures++;
+        return NULL;
+    }
+    void* block = (void*)frame_alloc(order);
+    if (block == NULL) {
+        stats.failures++;
+        return NULL;
+    }
+    stats.large_allocations++;
+    return block;
+}
+
+void kfree(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (((size_t)ptr & (FRAME_SIZE - 1)) == 0) {
+        if (frame_free((size_t)ptr) == 0) {
+            stats.large_frees++;
+        }
+        return;
+    }
+    struct slab* slab = (struct slab*)((size_t)ptr & ~(size_t)(FRAME_SIZE - 1));
+    kmem_cache_free(slab->cache, ptr);
+}
+
+int kmem_cache_get_stats(int index, struct kmem_cache_stats* out) {
+    if (index < 0 || index >= cache_count) {
+        return -1;
+    }
+    struct kmem_cache* cache = &caches[index];
+    out->name = cache->name;
+    out->object_size = cache->object_size;
+    out->per_slab = cache->per_slab;
+    out->slabs = cache->slabs;
+    out->active = cache->active;
+    out->total = cache->slabs * cache->per_slab;
+    out->allocations = cache->allocations;
+    out->frees = cache->frees;
+    out->failures = cache->failures;
+    return 0;
+}
+
+void heap_get_stats(struct heap_stats* out) {
+    out->large_allocations = stats.large_allocations;
+    out->large_frees = stats.large_frees;
+    out->failures = stats.failures;
+}
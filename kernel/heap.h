@@ -0,0 +1,66 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define HEAP_MAX_CACHES 16
+#define HEAP_MIN_CLASS 16
+#define HEAP_MAX_CLASS 1024
+#define HEAP_CLASSES 7
+#define HEAP_MIN_ALIGN 16
+
+/* Struct Creation */
+struct slab {
+    struct kmem_cache* cache;
+    struct slab* prev;
+    struct slab* next;
+    void* free;
+    uint32_t in_use;
+};
+
+struct kmem_cache {
+    const char* name;
+    uint32_t object_size;
+    uint32_t first_offset;
+    uint32_t per_slab;
+    struct slab* partial;
+    struct slab* full;
+    struct slab* empty;
+    uint32_t slabs;
+    uint32_t empty_slabs;
+    uint32_t active;
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+};
+
+struct kmem_cache_stats {
+    const char* name;
+    uint32_t object_size;
+    uint32_t per_slab;
+    uint32_t slabs;
+    uint32_t active;
+    uint32_t total;
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+};
+
+struct heap_stats {
+    uint32_t large_allocations;
+    uint32_t large_frees;
+    uint32_t failures;
+};
+
+/* Function Declarations */
+int heap_init();
+struct kmem_cache* kmem_cache_create(const char* name, uint32_t size, uint32_t align);
+void* kmem_cache_alloc(struct kmem_cache* cache);
+void kmem_cache_free(struct kmem_cache* cache, void* object);
+void* kmalloc(size_t size);
+void kfree(void* ptr);
+int kmem_cache_get_stats(int index, struct kmem_cache_stats* out);
+void heap_get_stats(struct heap_stats* out);
+
+#endif
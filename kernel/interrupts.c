@@ -22,6 +22,8 @@ void idt_install(){
     }
     idt_set_gate(IRQ0, (unsigned int)irq0_handler, 0x08, 0x8E); //timer interrupt
     idt_set_gate(IRQ1, (unsigned int)irq1_handler, 0x08, 0x8E); //kbm interrupt
+    idt_set_gate(IRQ14, (unsigned int)irq14_handler, 0x08, 0x8E); //primary ata interrupt
+    idt_set_gate(ISR_PAGE_FAULT, (unsigned int)isr14_handler, 0x08, 0x8E);
     idt_load();
 }
 
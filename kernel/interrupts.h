@@ -2,8 +2,10 @@
 #define INTERRUPTS_H
 
 #define IDT_ENTRIES 256
+#define ISR_PAGE_FAULT 14
 #define IRQ0 32
 #define IRQ1 33
+#define IRQ14 46
 
 /* Struct Definitions */
 struct idt_entry{
@@ -25,6 +27,8 @@ void idt_install();
 extern void idt_load();
 extern void irq0_handler();
 extern void irq1_handler();
+extern void irq14_handler();
+extern void isr14_handler();
 void irq_handler (int irq);
 void irq_handle_install(int, void(*)());
 void irq_handle_uninstall(int);
@@ -1,25 +1,43 @@
 #include "io.h"
 
 void outb(unsigned short port, unsigned char val){
-    __asm__ volatile("outb %0, %1": : "a"(val), "Nd"(port));
+    __asm__ volatile("outb %0, %1": : "a"(val), "Nd"(port) : "memory");
 }
 
 unsigned char inb(unsigned short port){
     unsigned char ret;
-    __asm__ volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    __asm__ volatile("inb %1, %0" : "=a"(ret) : "Nd"(port) : "memory");
     return ret;
 }
 
 void outw(unsigned short port, unsigned short val){
-    __asm__ volatile("outw %0, %1": : "a"(val), "Nd"(port));
+    __asm__ volatile("outw %0, %1": : "a"(val), "Nd"(port) : "memory");
 }
 
 unsigned short inw(unsigned short port){
     unsigned short ret;
-    __asm__ volatile("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    __asm__ volatile("inw %1, %0" : "=a"(ret) : "Nd"(port) : "memory");
     return ret;
 }
 
+void outl(unsigned short port, unsigned int val){
+    __asm__ volatile("outl %0, %1": : "a"(val), "Nd"(port) : "memory");
+}
+
+unsigned int inl(unsigned short port){
+    unsigned int ret;
+    __asm__ volatile("inl %1, %0" : "=a"(ret) : "Nd"(port) : "memory");
+    return ret;
+}
+
+void insw(unsigned short port, void* buffer, unsigned int count){
+    __asm__ volatile("cld; rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+void outsw(unsigned short port, const void* buffer, unsigned int count){
+    __asm__ volatile("cld; rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
 void pic_remapper(int off1, int off2){
     unsigned char a1, a2;
     a1 = inb(PIC1_DATA);
@@ -20,6 +20,10 @@ void outb(unsigned short port, unsigned char val);
 unsigned char inb(unsigned short port);
 void outw(unsigned short port, unsigned short val);
 unsigned short inw(unsigned short port);
+void outl(unsigned short port, unsigned int val);
+unsigned int inl(unsigned short port);
+void insw(unsigned short port, void* buffer, unsigned int count);
+void outsw(unsigned short port, const void* buffer, unsigned int count);
 void pic_remapper(int off1, int off2);
 void disable_pic();
 
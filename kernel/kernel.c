@@ -4,29 +4,87 @@
 #include "io.h"
 #include "kbm.h"
 #include "shell.h"
+#include "ata.h"
+#include "bcache.h"
+#include "blkq.h"
+#include "tsc.h"
+#include "mem.h"
+#include "frame.h"
+#include "heap.h"
+#include "paging.h"
+#include "ktime.h"
 #include "../filesystem/fat12.h"
 
-void _start() {
-    __asm__ volatile("cli");
-    __asm__ volatile("mov $0x90000, %esp");
-    
+/* Definitions */
+#define KERNEL_STACK_ORDER 3
+
+/* Function Declarations */
+static void kernel_main();
+
+/* Placed first in the image by linker.ld, at 4 MiB where the bootloader
+   copies the kernel, with a boot stack at 0x90000 and the BIOS memory map
+   as the argument. .bss is not in the image, so it is cleared here before
+   anything relies on it, with memset_rep() as memset() itself reads flags
+   that live there. Once memory management is up the kernel moves to a
+   stack of its own, whose lowest page is left unmapped as a guard. */
+__attribute__((section(".text.entry"))) void _start(struct e820_map* map) {
+    __asm__ volatile("cli" : : : "memory");
+    memset_rep(__bss_start, 0, __bss_end - __bss_start);
+
     set_colour(VGA_COLOUR_WHITE, VGA_COLOUR_BLACK);
     clr_scr();
+
+    // low memory holds the BIOS data, the boot stack and the map itself
+    struct frame_range reserved[2] = {
+        {0, 0x100000},
+        {(size_t)__kernel_start, (size_t)(__kernel_end - __kernel_start)}
+    };
+    // the heap, and with it file I/O, cannot work without frames
+    if (frame_init(map, reserved, 2) != 0) {
+        println("No usable memory map from the BIOS, halting");
+        while (1) {
+            __asm__ volatile("hlt" : : : "memory");
+        }
+    }
+    size_t stack = frame_alloc(KERNEL_STACK_ORDER);
+    if (paging_init(frame_limit()) != 0) {
+        println("No PSE support, running without paging");
+    } else if (stack != 0) {
+        paging_guard(stack);
+    }
+    if (stack != 0) {
+        size_t top = stack + (FRAME_SIZE << KERNEL_STACK_ORDER);
+        __asm__ volatile("mov %0, %%esp; call *%1" : : "r"(top), "r"(kernel_main) : "memory");
+    }
+    kernel_main();
+}
+
+static void kernel_main() {
     idt_install();
+    mem_sse_init();
+    heap_init();
     
     pic_remapper(0x20, 0x28);
-    outb(PIC1_DATA, inb(PIC1_DATA) & ~0x02);  
+    ktime_init(KTIME_HZ);
+    ktime_set_tickless(1);
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~0x03);
     
     while (inb(KBD_STATUS_PORT) & 0x02);     
     outb(KBD_DATA_PORT, 0xF4);              
 
     irq_handle_install(1, kbm_handler);
     
-    __asm__ volatile("sti");
-    fat12_init();
+    __asm__ volatile("sti" : : : "memory");
+    bcache_init();
+    blkq_set_clock(tsc_read);
+    struct block_device* disk = ata_init(ATA_SLAVE);
+    if (disk != NULL) {
+        block_register(disk);
+    }
+    fat12_init(disk, BLOCK_MODE_DMA);
     shell_init();
     
     while(1) {
-        __asm__ volatile("hlt");
+        ktime_idle();
     }
 }
\ No newline at end of file
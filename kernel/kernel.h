@@ -5,10 +5,18 @@
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
+typedef unsigned long long uint64_t;
 typedef signed char int8_t;
 typedef signed short int16_t;
 typedef signed int int32_t;
 
-void _start();
+extern uint8_t __kernel_start[];
+extern uint8_t __bss_start[];
+extern uint8_t __bss_end[];
+extern uint8_t __kernel_end[];
+
+struct e820_map;
+
+void _start(struct e820_map* map);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "ktime.h"
+#include "pit.h"
+#include "tsc.h"
+#include "interrupts.h"
+
+/* Function Declarations */
+static void ktime_irq();
+static void ktime_program();
+static uint32_t irq_save();
+static void irq_restore(uint32_t eflags);
+
+/* Global Variables */
+static uint64_t tsc_base = 0;
+static uint32_t ns_mult = 0;
+static uint32_t ns_shift = 0;
+static uint32_t rate_hz = 0;
+static volatile uint32_t interrupts = 0;
+static int tickless = 0;
+static uint32_t idle_wakeups = 0;
+static uint32_t wakeups_per_sec = 0;
+static uint64_t window_start = 0;
+
+/* Calibrates the TSC against the PIT and starts IRQ0 at hz. Time is read
+   from the TSC, which is finer than any tick and keeps counting with
+   interrupts off, so a late or lost tick only delays timers; the tick just
+   runs the timer wheel, whose unit is the millisecond whatever the rate. */
+int ktime_init(uint32_t hz) {
+    uint32_t khz = pit_calibrate_tsc();
+    if (khz == 0) {
+        khz = tsc_khz();
+    } else {
+        tsc_set_khz(khz);
+    }
+    // ns = cycles * ns_mult >> ns_shift, with ns_mult kept to 32 bits
+    ns_shift = KTIME_SHIFT;
+    while (ns_shift > 0 && div64_32((uint64_t)NSEC_PER_MSEC << ns_shift, khz) > 0xFFFFFFFF) {
+        ns_shift--;
+    }
+    ns_mult = div64_32((uint64_t)NSEC_PER_MSEC << ns_shift, khz);
+    tsc_base = tsc_read();
+
+    timer_wheel_init(0);
+    irq_handle_install(0, ktime_irq);
+    ktime_set_rate(hz);
+    return 0;
+}
+
+/* Returns the rate actually set, which the PIT divisor rounds. In tickless
+   mode the rate is kept for when periodic ticks come back. */
+uint32_t ktime_set_rate(uint32_t hz) {
+    uint32_t eflags = irq_save();
+    uint32_t divisor = pit_set_rate(hz);
+    rate_hz = (PIT_FREQUENCY + divisor / 2) / divisor;
+    if (tickless) {
+        ktime_program();
+    }
+    irq_restore(eflags);
+    return rate_hz;
+}
+
+/* Tickless mode drops the periodic tick: IRQ0 is programmed one-shot for
+   the next timer due, so an idle CPU sleeps until there is work. */
+void ktime_set_tickless(int enabled) {
+    uint32_t eflags = irq_save();
+    tickless = enabled;
+    if (tickless) {
+        ktime_program();
+    } else {
+        pit_set_rate(rate_hz);
+    }
+    irq_restore(eflags);
+}
+
+int ktime_tickless() {
+    return tickless;
+}
+
+/* With no timer pending the PIT is set as far out as it reaches, about
+   55 ms, which bounds how long anything polling a deadline waits. */
+static void ktime_program() {
+    uint64_t tick;
+    uint32_t count = PIT_MAX_COUNT;
+    if (timer_next(&tick) == 0) {
+        uint64_t due = tick * NSEC_PER_MSEC;
+        uint64_t now = ktime_get_ns();
+        uint64_t delay = due > now ? due - now : 0;
+        // no further than the PIT reaches, which also keeps the product
+        // below from overflowing
+        if (delay > (uint64_t)PIT_MAX_COUNT * NSEC_PER_SEC / PIT_FREQUENCY) {
+            delay = (uint64_t)PIT_MAX_COUNT * NSEC_PER_SEC / PIT_FREQUENCY;
+        }
+        // rounded up, as waking a little early only costs another wakeup
+        count = div64_32(delay * PIT_FREQUENCY + NSEC_PER_SEC - 1, NSEC_PER_SEC);
+    }
+    pit_oneshot(count);
+}
+
+uint32_t ktime_hz() {
+    return rate_hz;
+}
+
+/* Nanoseconds since ktime_init(), 0 before it. The 64 by 32-bit multiply
+   is done in halves so no bits of the product are lost. */
+uint64_t ktime_get_ns() {
+    if (ns_mult == 0) {
+        return 0;
+    }
+    uint64_t delta = tsc_read() - tsc_base;
+    uint64_t low = (delta & 0xFFFFFFFF) * ns_mult;
+    uint64_t high = (delta >> 32) * ns_mult;
+    return (high << (32 - ns_shift)) + (low >> ns_shift);
+}
+
+uint64_t ktime_get_ms() {
+    return div64_32(ktime_get_ns(), NSEC_PER_MSEC);
+}
+
+uint32_t ktime_interrupts() {
+    return interrupts;
+}
+
+static void ktime_irq() {
+    interrupts++;
+    timer_run(ktime_get_ms());
+    if (tickless) {
+        ktime_program();
+    }
+}
+
+/* The idle loop. Counts how often the halted CPU is woken, by any
+   interrupt, over windows of about a second. */
+void ktime_idle() {
+    __asm__ volatile("hlt" : : : "memory");
+    idle_wakeups++;
+    uint64_t now = ktime_get_ms();
+    if (now - window_start >= KTIME_WINDOW_MS) {
+        wakeups_per_sec = idle_wakeups * 1000 / (uint32_t)(now - window_start);
+        idle_wakeups = 0;
+        window_start = now;
+    }
+}
+
+uint32_t ktime_wakeups_per_sec() {
+    return wakeups_per_sec;
+}
+
+static uint32_t irq_save() {
+    uint32_t eflags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags) : : "memory");
+    return eflags;
+}
+
+static void irq_restore(uint32_t eflags) {
+    __asm__ volatile("push %0; popf" : : "r"(eflags) : "memory", "cc");
+}
+
+/* Arms timer to fire ms milliseconds from now, from the timer interrupt.
+   The wheel is shared with that interrupt, so it is kept out meanwhile. */
+int ktime_arm(struct timer* timer, uint32_t ms) {
+    uint32_t eflags = irq_save();
+    int result = timer_add(timer, ktime_get_ms() + ms);
+    if (result == 0 && tickless) {
+        ktime_program();
+    }
+    irq_restore(eflags);
+    return result;
+}
+
+int ktime_cancel(struct timer* timer) {
+    uint32_t eflags = irq_save();
+    int result = timer_cancel(timer);
+    irq_restore(eflags);
+    return result;
+}
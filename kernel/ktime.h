@@ -0,0 +1,28 @@
+#ifndef KTIME_H
+#define KTIME_H
+
+#include "kernel.h"
+#include "timer.h"
+
+/* Definitions */
+#define KTIME_HZ 1000
+#define KTIME_SHIFT 24
+#define NSEC_PER_SEC 1000000000
+#define NSEC_PER_MSEC 1000000
+#define KTIME_WINDOW_MS 1000
+
+/* Function Declarations */
+int ktime_init(uint32_t hz);
+uint32_t ktime_set_rate(uint32_t hz);
+uint32_t ktime_hz();
+void ktime_set_tickless(int enabled);
+int ktime_tickless();
+void ktime_idle();
+uint32_t ktime_wakeups_per_sec();
+uint64_t ktime_get_ns();
+uint64_t ktime_get_ms();
+uint32_t ktime_interrupts();
+int ktime_arm(struct timer* timer, uint32_t ms);
+int ktime_cancel(struct timer* timer);
+
+#endif
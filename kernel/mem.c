@@ -0,0 +1,285 @@
+#include "mem.h"
+
+/* Definitions */
+typedef uint32_t __attribute__((may_alias)) mem_word;
+
+/* Global Variables */
+static int sse_enabled = 0;
+static int sse_preferred = 0;
+static int erms_preferred = 0;
+static volatile int sse_busy = 0;
+
+/* memcpy() and memset() take the SSE2 paths for anything of MEM_SSE_MIN
+   bytes or more once mem_sse_init() has switched SSE on. On CPUs with
+   fast rep strings (ERMS), rep movsb / rep stosb measured faster from
+   MEM_ERMS_MIN up and take over there. rep movsd / rep stosd cover the
+   rest. The interrupt stubs do not save the XMM registers, so an SSE
+   loop marks itself busy and anything that interrupts it falls back to
+   the integer path rather than clobbering them. */
+void* memcpy(void* dest, const void* src, size_t n) {
+    if (erms_preferred && n >= MEM_ERMS_MIN) {
+        return memcpy_erms(dest, src, n);
+    }
+    if (sse_preferred && n >= MEM_SSE_MIN && !sse_busy) {
+        return memcpy_sse(dest, src, n);
+    }
+    return memcpy_rep(dest, src, n);
+}
+
+/* Copies forwards unless dest overlaps the end of src, in which case the
+   copy runs from the top down with the direction flag set. That happens
+   in a single asm statement so no compiled code ever runs with DF set. */
+void* memmove(void* dest, const void* src, size_t n) {
+    if ((uint8_t*)dest <= (const uint8_t*)src || (uint8_t*)dest >= (const uint8_t*)src + n) {
+        return memcpy(dest, src, n);
+    }
+    uint8_t* d = (uint8_t*)dest + n - 1;
+    const uint8_t* s = (const uint8_t*)src + n - 1;
+    size_t bytes = n % 4;
+    size_t words = n / 4;
+    __asm__ volatile("std\n"
+                     "rep movsb\n"
+                     "sub $3, %0\n"
+                     "sub $3, %1\n"
+                     "mov %3, %2\n"
+                     "rep movsl\n"
+                     "cld"
+                     : "+D"(d), "+S"(s), "+c"(bytes)
+                     : "r"(words)
+                     : "memory", "cc");
+    return dest;
+}
+
+void* memset(void* dest, int val, size_t n) {
+    if (erms_preferred && n >= MEM_ERMS_MIN) {
+        return memset_erms(dest, val, n);
+    }
+    if (sse_preferred && n >= MEM_SSE_MIN && !sse_busy) {
+        return memset_sse(dest, val, n);
+    }
+    return memset_rep(dest, val, n);
+}
+
+int memcmp(const void* a, const void* b, size_t n) {
+    const uint8_t* x = (const uint8_t*)a;
+    const uint8_t* y = (const uint8_t*)b;
+    size_t i = 0;
+    while (i + 4 <= n && *(const mem_word*)(x + i) == *(const mem_word*)(y + i)) {
+        i += 4;
+    }
+    for (; i < n; i++) {
+        if (x[i] != y[i]) {
+            return x[i] - y[i];
+        }
+    }
+    return 0;
+}
+
+/* Fills count 16-bit cells, as in VGA text memory. */
+void* memsetw(void* dest, uint16_t val, size_t count) {
+    void* d = dest;
+    __asm__ volatile("rep stosw" : "+D"(d), "+c"(count) : "a"(val) : "memory");
+    return dest;
+}
+
+/* The byte-at-a-time loops the kernel used before, kept as a baseline. */
+void* memcpy_bytes(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+    return dest;
+}
+
+void* memset_bytes(void* dest, int val, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = (uint8_t)val;
+    }
+    return dest;
+}
+
+void* memcpy_rep(void* dest, const void* src, size_t n) {
+    void* d = dest;
+    size_t words = n / 4;
+    size_t bytes = n % 4;
+    __asm__ volatile("rep movsl" : "+D"(d), "+S"(src), "+c"(words) : : "memory");
+    if (bytes) {
+        __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(bytes) : : "memory");
+    }
+    return dest;
+}
+
+void* memset_rep(void* dest, int val, size_t n) {
+    void* d = dest;
+    uint32_t pattern = (uint8_t)val * 0x01010101u;
+    size_t words = n / 4;
+    size_t bytes = n % 4;
+    __asm__ volatile("rep stosl" : "+D"(d), "+c"(words) : "a"(pattern) : "memory");
+    if (bytes) {
+        __asm__ volatile("rep stosb" : "+D"(d), "+c"(bytes) : "a"(pattern) : "memory");
+    }
+    return dest;
+}
+
+/* Single byte rep strings, which ERMS CPUs run in large internal chunks
+   whatever the size and alignment. */
+void* memcpy_erms(void* dest, const void* src, size_t n) {
+    void* d = dest;
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+    return dest;
+}
+
+void* memset_erms(void* dest, int val, size_t n) {
+    void* d = dest;
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(val) : "memory");
+    return dest;
+}
+
+/* Aligns the destination to 16 bytes, then moves 64 bytes per iteration
+   through four XMM registers, with aligned loads when the source lines up
+   too. The caller must have SSE enabled. */
+__attribute__((target("sse2"))) void* memcpy_sse(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    size_t head = (16 - ((size_t)d & 15)) & 15;
+
+    if (head > n) {
+        head = n;
+    }
+    for (size_t i = 0; i < head; i++) {
+        d[i] = s[i];
+    }
+    d += head;
+    s += head;
+    n -= head;
+    size_t blocks = n / 64;
+    if (blocks) {
+        sse_busy = 1;
+        if (((size_t)s & 15) == 0) {
+            __asm__ volatile("1:\n"
+                             "movdqa (%1), %%xmm0\n"
+                             "movdqa 16(%1), %%xmm1\n"
+                             "movdqa 32(%1), %%xmm2\n"
+                             "movdqa 48(%1), %%xmm3\n"
+                             "movdqa %%xmm0, (%0)\n"
+                             "movdqa %%xmm1, 16(%0)\n"
+                             "movdqa %%xmm2, 32(%0)\n"
+                             "movdqa %%xmm3, 48(%0)\n"
+                             "add $64, %0\n"
+                             "add $64, %1\n"
+                             "dec %2\n"
+                             "jnz 1b"
+                             : "+r"(d), "+r"(s), "+r"(blocks)
+                             :
+                             : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+        } else {
+            __asm__ volatile("1:\n"
+                             "movdqu (%1), %%xmm0\n"
+                             "movdqu 16(%1), %%xmm1\n"
+                             "movdqu 32(%1), %%xmm2\n"
+                             "movdqu 48(%1), %%xmm3\n"
+                             "movdqa %%xmm0, (%0)\n"
+                             "movdqa %%xmm1, 16(%0)\n"
+                             "movdqa %%xmm2, 32(%0)\n"
+                             "movdqa %%xmm3, 48(%0)\n"
+                             "add $64, %0\n"
+                             "add $64, %1\n"
+                             "dec %2\n"
+                             "jnz 1b"
+                             : "+r"(d), "+r"(s), "+r"(blocks)
+                             :
+                             : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+        }
+        sse_busy = 0;
+    }
+    n %= 64;
+    while (n >= 4) {
+        *(mem_word*)d = *(const mem_word*)s;
+        d += 4;
+        s += 4;
+        n -= 4;
+    }
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+__attribute__((target("sse2"))) void* memset_sse(void* dest, int val, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    uint32_t pattern = (uint8_t)val * 0x01010101u;
+    size_t head = (16 - ((size_t)d & 15)) & 15;
+
+    if (head > n) {
+        head = n;
+    }
+    for (size_t i = 0; i < head; i++) {
+        d[i] = (uint8_t)val;
+    }
+    d += head;
+    n -= head;
+    size_t blocks = n / 64;
+    if (blocks) {
+        sse_busy = 1;
+        __asm__ volatile("movd %2, %%xmm0\n"
+                         "pshufd $0, %%xmm0, %%xmm0\n"
+                         "1:\n"
+                         "movdqa %%xmm0, (%0)\n"
+                         "movdqa %%xmm0, 16(%0)\n"
+                         "movdqa %%xmm0, 32(%0)\n"
+                         "movdqa %%xmm0, 48(%0)\n"
+                         "add $64, %0\n"
+                         "dec %1\n"
+                         "jnz 1b"
+                         : "+r"(d), "+r"(blocks)
+                         : "r"(pattern)
+                         : "memory", "xmm0");
+        sse_busy = 0;
+    }
+    n %= 64;
+    while (n >= 4) {
+        *(mem_word*)d = pattern;
+        d += 4;
+        n -= 4;
+    }
+    while (n--) {
+        *d++ = (uint8_t)val;
+    }
+    return dest;
+}
+
+/* Turns on SSE for the kernel: CR0.EM off so SSE instructions do not trap
+   as x87 emulation, CR0.MP on, and CR4.OSFXSR/OSXMMEXCPT to declare that
+   the OS handles SSE state and exceptions. Fails on CPUs without SSE2. */
+int mem_sse_init() {
+    uint32_t max, eax, ebx, ecx, edx;
+    unsigned long cr0, cr4;
+
+    __asm__ volatile("cpuid" : "=a"(max), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & CPUID_SSE2) || !(edx & CPUID_FXSR)) {
+        return -1;
+    }
+    int erms = 0;
+    if (max >= 7) {
+        __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+        erms = (ebx & CPUID_ERMS) != 0;
+    }
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~(unsigned long)(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP;
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+    sse_enabled = 1;
+    sse_preferred = 1;
+    erms_preferred = erms;
+    return 0;
+}
+
+int mem_sse_enabled() {
+    return sse_enabled;
+}
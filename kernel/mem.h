@@ -0,0 +1,35 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define MEM_SSE_MIN 256
+#define MEM_ERMS_MIN 4096
+#define CPUID_FXSR (1 << 24)
+#define CPUID_SSE2 (1 << 26)
+#define CPUID_ERMS (1 << 9)
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+/* Function Declarations */
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
+void* memset(void* dest, int val, size_t n);
+int memcmp(const void* a, const void* b, size_t n);
+void* memsetw(void* dest, uint16_t val, size_t count);
+void* memcpy_bytes(void* dest, const void* src, size_t n);
+void* memcpy_rep(void* dest, const void* src, size_t n);
+void* memcpy_sse(void* dest, const void* src, size_t n);
+void* memcpy_erms(void* dest, const void* src, size_t n);
+void* memset_bytes(void* dest, int val, size_t n);
+void* memset_rep(void* dest, int val, size_t n);
+void* memset_sse(void* dest, int val, size_t n);
+void* memset_erms(void* dest, int val, size_t n);
+int mem_sse_init();
+int mem_sse_enabled();
+
+#endif
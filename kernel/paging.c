@@ -0,0 +1,173 @@
+#include "paging.h"
+#include "frame.h"
+#include "vga.h"
+
+/* Function Declarations */
+static void invlpg(size_t addr);
+static uint32_t* page_table_for(size_t addr);
+static void print_hex(uint32_t value);
+
+/* Global Variables */
+static uint32_t page_directory[PAGE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t low_table[PAGE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static int enabled = 0;
+static int wc_supported = 0;
+static uint32_t global_flag = 0;
+static size_t guards[PAGING_MAX_GUARDS];
+static int guard_count = 0;
+
+static void invlpg(size_t addr) {
+    __asm__ volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+/* Identity maps memory up to memory_end. Everything above the first 4 MiB,
+   the kernel included, goes in 4 MiB pages so it costs a handful of TLB
+   entries. The first 4 MiB uses small pages: page 0 is left out to catch
+   NULL dereferences, and VGA text memory is made write-combining through
+   PAT entry 1 where the CPU has PAT. */
+int paging_init(size_t memory_end) {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & CPUID_PSE)) {
+        return -1;
+    }
+    global_flag = (edx & CPUID_PGE) ? PAGE_GLOBAL : 0;
+    wc_supported = (edx & CPUID_PAT) != 0;
+    // 0 stands for the full 4 GiB
+    if (memory_end != 0 && memory_end < (size_t)__kernel_end) {
+        memory_end = (size_t)__kernel_end;
+    }
+
+    low_table[0] = 0;
+    for (uint32_t i = 1; i < PAGE_ENTRIES; i++) {
+        low_table[i] = (i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE;
+    }
+    page_directory[0] = (size_t)low_table | PAGE_PRESENT | PAGE_WRITE;
+    uint32_t large_pages = (memory_end - 1) / PAGE_LARGE_SIZE + 1;
+    for (uint32_t i = 1; i < PAGE_ENTRIES; i++) {
+        page_directory[i] = i < large_pages ? (i * PAGE_LARGE_SIZE) | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | global_flag : 0;
+    }
+
+    if (wc_supported) {
+        uint32_t low, high;
+        __asm__ volatile("wbinvd" : : : "memory");
+        __asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(MSR_PAT));
+        low = (low & ~0xFF00u) | (PAT_WC << 8);
+        __asm__ volatile("wrmsr" : : "a"(low), "d"(high), "c"(MSR_PAT) : "memory");
+        for (size_t addr = MEM_SPACE; addr < MEM_SPACE + MEM_SPACE_SIZE; addr += PAGE_SIZE) {
+            low_table[addr / PAGE_SIZE] |= PAGE_CACHE_WC;
+        }
+    }
+
+    size_t cr;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr));
+    cr |= CR4_PSE | (global_flag ? CR4_PGE : 0);
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr) : "memory");
+    __asm__ volatile("mov %0, %%cr3" : : "r"((size_t)page_directory) : "memory");
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr));
+    cr |= CR0_PG | CR0_WP;
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr) : "memory");
+    enabled = 1;
+    return 0;
+}
+
+int paging_enabled() {
+    return enabled;
+}
+
+int paging_wc_supported() {
+    return enabled && wc_supported;
+}
+
+/* Returns the page table covering addr, first breaking its 4 MiB page into
+   small pages with the same mapping if need be. */
+static uint32_t* page_table_for(size_t addr) {
+    if (!enabled) {
+        return NULL;
+    }
+    uint32_t* entry = &page_directory[addr / PAGE_LARGE_SIZE];
+    if (!(*entry & PAGE_PRESENT)) {
+        return NULL;
+    }
+    if (*entry & PAGE_LARGE) {
+        uint32_t* table = (uint32_t*)frame_alloc(0);
+        if (table == NULL) {
+            return NULL;
+        }
+        size_t base = *entry & ~(PAGE_LARGE_SIZE - 1);
+        for (uint32_t i = 0; i < PAGE_ENTRIES; i++) {
+            table[i] = (base + i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE | global_flag;
+        }
+        *entry = (size_t)table | PAGE_PRESENT | PAGE_WRITE;
+        invlpg(base);
+    }
+    return (uint32_t*)(*entry & ~(PAGE_SIZE - 1));
+}
+
+/* Unmaps the page at addr, so running into it faults instead of silently
+   overwriting whatever lies below. Used under kernel stacks. */
+int paging_guard(size_t addr) {
+    uint32_t* table = page_table_for(addr);
+    if (table == NULL || guard_count >= PAGING_MAX_GUARDS) {
+        return -1;
+    }
+    addr &= ~(size_t)(PAGE_SIZE - 1);
+    table[(addr / PAGE_SIZE) % PAGE_ENTRIES] = 0;
+    invlpg(addr);
+    guards[guard_count++] = addr;
+    return 0;
+}
+
+/* Sets the memory type of the mapped pages in [addr, addr + size) to one
+   of the PAGE_CACHE_ types. */
+int paging_set_cache(size_t addr, size_t size, uint32_t cache) {
+    if (cache == PAGE_CACHE_WC && !paging_wc_supported()) {
+        return -1;
+    }
+    for (size_t page = addr & ~(size_t)(PAGE_SIZE - 1); page < addr + size; page += PAGE_SIZE) {
+        uint32_t* table = page_table_for(page);
+        if (table == NULL) {
+            return -1;
+        }
+        uint32_t* entry = &table[(page / PAGE_SIZE) % PAGE_ENTRIES];
+        if (*entry & PAGE_PRESENT) {
+            *entry = (*entry & ~PAGE_CACHE_MASK) | cache;
+            invlpg(page);
+        }
+    }
+    // nothing cached under the old type may linger
+    __asm__ volatile("wbinvd" : : : "memory");
+    return 0;
+}
+
+static void print_hex(uint32_t value) {
+    print("0x");
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        enter_char("0123456789ABCDEF"[(value >> shift) & 0xF]);
+    }
+}
+
+/* Called from the exception stub. There is nothing to page in, so any
+   fault is a kernel bug: report it and stop. */
+void page_fault_handler(uint32_t error, uint32_t eip) {
+    size_t addr;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(addr));
+    print("\nPage fault at ");
+    print_hex(addr);
+    print(", eip ");
+    print_hex(eip);
+    print(", error ");
+    print_hex(error);
+    for (int i = 0; i < guard_count; i++) {
+        if (addr - guards[i] < PAGE_SIZE) {
+            print(" (stack overflow)");
+        }
+    }
+    if (addr < PAGE_SIZE) {
+        print(" (NULL pointer)");
+    }
+    enter_char('\n');
+    while (1) {
+        __asm__ volatile("cli; hlt" : : : "memory");
+    }
+}
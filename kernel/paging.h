@@ -0,0 +1,39 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define PAGE_SIZE 4096
+#define PAGE_LARGE_SIZE 0x400000
+#define PAGE_ENTRIES 1024
+#define PAGE_PRESENT 0x001
+#define PAGE_WRITE 0x002
+#define PAGE_PWT 0x008
+#define PAGE_PCD 0x010
+#define PAGE_LARGE 0x080
+#define PAGE_GLOBAL 0x100
+#define PAGE_CACHE_MASK (PAGE_PWT | PAGE_PCD | 0x080)
+#define PAGE_CACHE_WB 0
+#define PAGE_CACHE_WC PAGE_PWT
+#define PAGE_CACHE_UC (PAGE_PWT | PAGE_PCD)
+#define PAGING_MAX_GUARDS 8
+#define CR0_WP (1 << 16)
+#define CR0_PG (1u << 31)
+#define CR4_PSE (1 << 4)
+#define CR4_PGE (1 << 7)
+#define CPUID_PSE (1 << 3)
+#define CPUID_PGE (1 << 13)
+#define CPUID_PAT (1 << 16)
+#define MSR_PAT 0x277
+#define PAT_WC 0x01
+
+/* Function Declarations */
+int paging_init(size_t memory_end);
+int paging_enabled();
+int paging_wc_supported();
+int paging_guard(size_t addr);
+int paging_set_cache(size_t addr, size_t size, uint32_t cache);
+void page_fault_handler(uint32_t error, uint32_t eip);
+
+#endif
@@ -0,0 +1,52 @@
+#include "pci.h"
+#include "io.h"
+
+/* Function Declarations */
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    return 0x80000000 | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) | ((uint32_t)func << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_read(struct pci_device* dev, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(dev->bus, dev->slot, dev->func, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write(struct pci_device* dev, uint8_t offset, uint32_t val) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(dev->bus, dev->slot, dev->func, offset));
+    outl(PCI_CONFIG_DATA, val);
+}
+
+/* Brute-force scan of every bus/slot/function; fine for the handful of
+   lookups done at boot. */
+int pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_device* out) {
+    struct pci_device dev;
+    for (int bus = 0; bus < 256; bus++) {
+        for (int slot = 0; slot < 32; slot++) {
+            for (int func = 0; func < 8; func++) {
+                dev.bus = bus;
+                dev.slot = slot;
+                dev.func = func;
+                uint32_t id = pci_read(&dev, PCI_REG_VENDOR);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    if (func == 0) {
+                        break;
+                    }
+                    continue;
+                }
+                uint32_t class_reg = pci_read(&dev, PCI_REG_CLASS);
+                if (((class_reg >> 24) & 0xFF) == class_code && ((class_reg >> 16) & 0xFF) == subclass) {
+                    dev.vendor = id & 0xFFFF;
+                    dev.device = (id >> 16) & 0xFFFF;
+                    *out = dev;
+                    return 0;
+                }
+                if (func == 0 && !(pci_read(&dev, PCI_REG_HEADER) & 0x00800000)) {
+                    break;
+                }
+            }
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,33 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_REG_VENDOR 0x00
+#define PCI_REG_COMMAND 0x04
+#define PCI_REG_CLASS 0x08
+#define PCI_REG_HEADER 0x0C
+#define PCI_REG_BAR4 0x20
+#define PCI_COMMAND_IO 0x0001
+#define PCI_COMMAND_MASTER 0x0004
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+/* Struct Creation */
+struct pci_device {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint16_t vendor;
+    uint16_t device;
+};
+
+/* Function Declarations */
+uint32_t pci_read(struct pci_device* dev, uint8_t offset);
+void pci_write(struct pci_device* dev, uint8_t offset, uint32_t val);
+int pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_device* out);
+
+#endif
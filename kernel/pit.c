@@ -0,0 +1,57 @@
+#include "pit.h"
+#include "io.h"
+#include "tsc.h"
+
+/* Runs channel 0 as a rate generator raising IRQ0 about hz times a
+   second. Returns the divisor programmed, which fixes the exact rate. */
+uint32_t pit_set_rate(uint32_t hz) {
+    if (hz < PIT_MIN_HZ) {
+        hz = PIT_MIN_HZ;
+    }
+    if (hz > PIT_MAX_HZ) {
+        hz = PIT_MAX_HZ;
+    }
+    uint32_t divisor = (PIT_FREQUENCY + hz / 2) / hz;
+    outb(PIT_COMMAND, PIT_MODE_RATE);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, divisor >> 8);
+    return divisor;
+}
+
+/* Raises IRQ0 once, count PIT clocks from now, and then stays quiet until
+   reprogrammed. count is clamped to what the 16-bit counter holds, about
+   55 ms. */
+void pit_oneshot(uint32_t count) {
+    if (count == 0) {
+        count = 1;
+    }
+    if (count > PIT_MAX_COUNT) {
+        count = PIT_MAX_COUNT;
+    }
+    outb(PIT_COMMAND, PIT_MODE_ONESHOT);
+    outb(PIT_CHANNEL0, count & 0xFF);
+    outb(PIT_CHANNEL0, count >> 8);
+}
+
+/* Counts TSC cycles while channel 2 counts down PIT_CALIBRATE_MS once; its
+   output, readable at port 0x61, goes high at zero. Channel 2 drives the
+   speaker, which is kept off. Returns the TSC rate in kHz, or 0 if the
+   output never rose. */
+uint32_t pit_calibrate_tsc() {
+    uint32_t latch = PIT_FREQUENCY * PIT_CALIBRATE_MS / 1000;
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_GATE2);
+    outb(PIT_COMMAND, PIT_MODE_COUNT2);
+    outb(PIT_CHANNEL2, latch & 0xFF);
+    outb(PIT_CHANNEL2, latch >> 8);
+
+    uint64_t start = tsc_read();
+    int i = 0;
+    while (!(inb(PIT_GATE_PORT) & PIT_OUT2) && i < PIT_TIMEOUT) {
+        i++;
+    }
+    uint64_t cycles = tsc_read() - start;
+    if (i == PIT_TIMEOUT) {
+        return 0;
+    }
+    return div64_32(cycles, PIT_CALIBRATE_MS);
+}
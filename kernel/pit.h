@@ -0,0 +1,29 @@
+#ifndef PIT_H
+#define PIT_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL0 0x40
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND 0x43
+#define PIT_GATE_PORT 0x61
+#define PIT_GATE2 0x01
+#define PIT_SPEAKER 0x02
+#define PIT_OUT2 0x20
+#define PIT_MODE_RATE 0x34
+#define PIT_MODE_ONESHOT 0x30
+#define PIT_MODE_COUNT2 0xB0
+#define PIT_MIN_HZ 19
+#define PIT_MAX_HZ 10000
+#define PIT_CALIBRATE_MS 50
+#define PIT_TIMEOUT 10000000
+#define PIT_MAX_COUNT 0xFFFF
+
+/* Function Declarations */
+uint32_t pit_set_rate(uint32_t hz);
+void pit_oneshot(uint32_t count);
+uint32_t pit_calibrate_tsc();
+
+#endif
@@ -0,0 +1,60 @@
+#include "ramdisk.h"
+#include "mem.h"
+
+/* Function Declarations */
+static int ramdisk_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer);
+static int ramdisk_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer);
+static int ramdisk_flush(struct block_device* dev);
+static void* ramdisk_map(struct block_device* dev, uint32_t lba);
+
+/* Global Variables */
+static struct block_device ramdisk_device;
+
+/* A block device backed by sector_count sectors of memory at memory, which
+   the caller owns. The contents are whatever the memory held, so a fresh
+   RAM disk is formatted at mount like a blank drive. Sectors can be mapped
+   in place with block_map(), which is what lets the file system read it
+   without copying. */
+struct block_device* ramdisk_create(void* memory, uint32_t sector_count) {
+    if (memory == NULL || sector_count == 0) {
+        return NULL;
+    }
+    ramdisk_device.name = "ram0";
+    ramdisk_device.sector_count = sector_count;
+    ramdisk_device.max_transfer = 0;
+    ramdisk_device.read = ramdisk_read;
+    ramdisk_device.write = ramdisk_write;
+    ramdisk_device.flush = ramdisk_flush;
+    ramdisk_device.set_mode = NULL;
+    ramdisk_device.read_async = NULL;
+    ramdisk_device.write_async = NULL;
+    ramdisk_device.poll = NULL;
+    ramdisk_device.map = ramdisk_map;
+    ramdisk_device.mode = BLOCK_MODE_PIO;
+    ramdisk_device.data = memory;
+    ramdisk_device.read_requests = 0;
+    ramdisk_device.write_requests = 0;
+    ramdisk_device.sectors_read = 0;
+    ramdisk_device.sectors_written = 0;
+    ramdisk_device.errors = 0;
+    return &ramdisk_device;
+}
+
+static int ramdisk_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer) {
+    memcpy(buffer, ramdisk_map(dev, lba), count * BLOCK_SECTOR_SIZE);
+    return 0;
+}
+
+static int ramdisk_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    memcpy(ramdisk_map(dev, lba), buffer, count * BLOCK_SECTOR_SIZE);
+    return 0;
+}
+
+static int ramdisk_flush(struct block_device* dev) {
+    (void)dev;
+    return 0;
+}
+
+static void* ramdisk_map(struct block_device* dev, uint32_t lba) {
+    return (uint8_t*)dev->data + lba * BLOCK_SECTOR_SIZE;
+}
@@ -0,0 +1,13 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "kernel.h"
+#include "block.h"
+
+/* Definitions */
+#define RAMDISK_SECTORS 2880
+
+/* Function Declarations */
+struct block_device* ramdisk_create(void* memory, uint32_t sector_count);
+
+#endif
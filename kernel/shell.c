@@ -1,19 +1,43 @@
 #include "shell.h"
 #include "vga.h"
 #include "kernel.h"
+#include "block.h"
+#include "bcache.h"
+#include "blkq.h"
+#include "ramdisk.h"
+#include "mem.h"
+#include "tsc.h"
+#include "frame.h"
+#include "heap.h"
+#include "paging.h"
+#include "ktime.h"
+#include "pit.h"
 #include "../filesystem/fat12.h"
+#include "../filesystem/dentry.h"
+#include "../filesystem/journal.h"
 
 /* Defintions */
 #define MAX_INPUT 128
+#define BENCH_CHUNK_SECTORS 64
+#define BENCH_SEQ_SECTORS 2048
+#define BENCH_RANDOM_READS 256
+#define BENCH_LOOKUP_STEP 32
+#define BENCH_LOOKUPS 64
+#define BENCH_MEM_BYTES (256 * 1024)
+#define LS_MAX_ENTRIES 32
+#define BENCH_FB_FRAMES 200
 
 /* Global Variables */
 static char input_buffer[MAX_INPUT];
 static int input_pos = 0;
+static uint8_t bench_buffer[BLOCK_SECTOR_SIZE * BENCH_CHUNK_SECTORS] __attribute__((aligned(16)));
 
 /* Function Declarations */
 static int str_len(const char* str);
 static int str_compare(const char* a, const char* b);
+static int str_prefix(const char* str, const char* prefix);
 static void print_int(int num);
+static int parse_uint(const char* str, uint32_t* value);
 
 
 static void print_int(int num) {
@@ -51,8 +75,32 @@ static int str_compare(const char* a, const char* b) {
     return *a - *b;
 }
 
+static int str_prefix(const char* str, const char* prefix) {
+    while (*prefix && *str == *prefix) { str++; prefix++; }
+    return *prefix == '\0';
+}
+
+static int parse_uint(const char* str, uint32_t* value) {
+    uint32_t result = 0;
+    if (*str == '\0') {
+        return -1;
+    }
+    while (*str) {
+        if (*str < '0' || *str > '9') {
+            return -1;
+        }
+        result = result * 10 + (*str - '0');
+        str++;
+    }
+    *value = result;
+    return 0;
+}
+
 void shell_print_prompt() {
-    print("@AcornOS$~: ");
+    const char* cwd = fat12_getcwd();
+    print("@AcornOS$");
+    print(cwd[1] == '\0' ? "~" : cwd);
+    print(": ");
     mark_inp_start(); 
 }
 
@@ -61,7 +109,25 @@ void help_cmd() {
     println("help     - Display available commands");
     println("clear    - Clear screen");
     println("fstest   - Test for file system");
-    println("ls       - List files in system");
+    println("ls [dir] - List files in a directory");
+    println("cd [dir] - Change the current directory");
+    println("mkdir    - Create a directory");
+    println("cat      - Print a file");
+    println("diskbench - Measure disk read throughput");
+    println("dmabench - Compare PIO and DMA throughput");
+    println("cachestat - Show block cache counters");
+    println("iostat   - Show request queue counters and latency");
+    println("sync     - Write pending file system changes to disk");
+    println("journal [on|off] - Show journal counters or switch journaling");
+    println("ramdisk [off] - Mount a scratch volume in memory, or go back to the disk");
+    println("lookupbench - Time file lookups as the directory fills");
+    println("membench - Compare memcpy/memset variants in bytes per cycle");
+    println("meminfo  - Show physical memory and free blocks by size");
+    println("slabinfo - Show heap caches, their use and fragmentation");
+    println("fbbench  - Time screen redraws with VGA memory uncached and write-combining");
+    println("readahead [n] - Show or set the read-ahead window in clusters");
+    println("clock [hz] - Show uptime and timer counters, or set the timer interrupt rate");
+    println("tickless [on|off] - Show idle wakeups per second or switch the periodic tick");
 }
 
 void clear_cmd() {
@@ -91,18 +157,6 @@ void fs_test_cmd() {
         println("Failed");
     }
     
-    print("Testing file read... ");
-    char buffer[64];
-    int bytes_read = fat12_read_file("test.txt", buffer, 63);
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        println("Success");
-        print("Content: ");
-        println(buffer);
-    } else {
-        println("Failed or file not found");
-    }
-    
     print("Testing file creation... ");
     if (fat12_create_file("newfile.txt", 0x20) == 0) {
         println("Success");
@@ -137,37 +191,580 @@ void fs_test_cmd() {
     println("Test Complete");
 }
 
-void ls_cmd() {
-    struct fat12_dir_entry entries[32];
-    int count = fat12_list_directory(entries, 32);
+void ls_cmd(const char* path) {
+    struct fat12_dirent* entries = kmalloc(LS_MAX_ENTRIES * sizeof(struct fat12_dirent));
+    if (entries == NULL) {
+        println("\nOut of memory");
+        return;
+    }
+    int count = fat12_read_dir(path, entries, LS_MAX_ENTRIES);
     
     if (count < 0) {
+        kfree(entries);
         println("\nError reading directory");
         return;
     }
     
-    if (count == 0) {
+    int shown = 0;
+    for (int i = 0; i < count; i++) {
+        if (entries[i].attributes & FAT12_ATTR_HIDDEN) {
+            continue;
+        }
+        if (shown++ == 0) {
+            println("\nFiles:");
+        }
+        print(entries[i].name);
+        if (entries[i].attributes & FAT12_ATTR_DIRECTORY) {
+            println(" <DIR>");
+        } else {
+            print(" (");
+            print_int(entries[i].size);
+            println(" bytes)");
+        }
+    }
+    if (shown == 0) {
         println("\nDirectory is empty");
+    }
+    kfree(entries);
+}
+
+static void print_rate(const char* label, uint32_t sectors, uint64_t cycles) {
+    uint32_t us = tsc_cycles_to_us(cycles);
+    if (us == 0) {
+        us = 1;
+    }
+    print(label);
+    print_int(div64_32((uint64_t)sectors * 1000000, us));
+    print(" sectors/sec (");
+    print_int(sectors);
+    print(" sectors in ");
+    print_int(us / 1000);
+    println(" ms)");
+}
+
+static void disk_bench(struct block_device* dev) {
+    uint32_t total = BENCH_SEQ_SECTORS;
+    if (total > dev->sector_count) {
+        total = dev->sector_count;
+    }
+    uint64_t start = tsc_read();
+    for (uint32_t lba = 0; lba < total; lba += BENCH_CHUNK_SECTORS) {
+        uint32_t count = total - lba;
+        if (count > BENCH_CHUNK_SECTORS) {
+            count = BENCH_CHUNK_SECTORS;
+        }
+        if (block_read(dev, lba, count, bench_buffer) != 0) {
+            println("Sequential read failed");
+            return;
+        }
+    }
+    print_rate("Sequential: ", total, tsc_read() - start);
+
+    uint32_t seed = 12345;
+    start = tsc_read();
+    for (int i = 0; i < BENCH_RANDOM_READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (block_read(dev, (seed >> 8) % dev->sector_count, 1, bench_buffer) != 0) {
+            println("Random read failed");
+            return;
+        }
+    }
+    print_rate("Random:     ", BENCH_RANDOM_READS, tsc_read() - start);
+}
+
+void diskbench_cmd() {
+    struct block_device* dev = block_get_device(0);
+    if (dev == NULL) {
+        println("\nNo disk attached");
         return;
     }
-    
-    println("\nFiles:");
-    for (int i = 0; i < count; i++) {
-        for (int j = 0; j < 8 && entries[i].filename[j] != ' '; j++) {
-            enter_char(entries[i].filename[j]);
-        }
-        
-        if (entries[i].extension[0] != ' ') {
-            enter_char('.');
-            for (int j = 0; j < 3 && entries[i].extension[j] != ' '; j++) {
-                enter_char(entries[i].extension[j]);
+    print("\nBenchmarking ");
+    print(dev->name);
+    println(dev->mode == BLOCK_MODE_DMA ? " (DMA)" : " (PIO)");
+    tsc_khz();
+    disk_bench(dev);
+}
+
+void dmabench_cmd() {
+    struct block_device* dev = block_get_device(0);
+    if (dev == NULL) {
+        println("\nNo disk attached");
+        return;
+    }
+    int saved_mode = dev->mode;
+    tsc_khz();
+    println("\nPIO:");
+    block_set_mode(dev, BLOCK_MODE_PIO);
+    disk_bench(dev);
+    if (block_set_mode(dev, BLOCK_MODE_DMA) != BLOCK_MODE_DMA) {
+        println("DMA not available");
+    } else {
+        println("DMA:");
+        disk_bench(dev);
+    }
+    block_set_mode(dev, saved_mode);
+}
+
+void cachestat_cmd() {
+    struct bcache_stats stats;
+    bcache_get_stats(&stats);
+    print("\nHits:      ");
+    print_int(stats.hits);
+    print("\nMisses:    ");
+    print_int(stats.misses);
+    print("\nFlushes:   ");
+    print_int(stats.flushes);
+    print("\nEvictions: ");
+    print_int(stats.evictions);
+    print("\nDirty:     ");
+    print_int(stats.dirty);
+    print("\nPrefetched: ");
+    print_int(stats.prefetched);
+    print("\nPrefetch hits: ");
+    print_int(stats.prefetch_hits);
+    print("\nPrefetch wasted: ");
+    print_int(stats.prefetch_wasted);
+
+    struct dentry_stats dstats;
+    dentry_get_stats(&dstats);
+    print("\nDentry hits: ");
+    print_int(dstats.hits);
+    print("\nDentry misses: ");
+    print_int(dstats.misses);
+    print("\nDentry evictions: ");
+    print_int(dstats.evictions);
+    enter_char('\n');
+}
+
+void iostat_cmd() {
+    struct blkq_stats stats;
+    blkq_get_stats(&stats);
+    print("\nSubmitted:  ");
+    print_int(stats.submitted);
+    print("\nMerged:     ");
+    print_int(stats.merged);
+    print("\nDispatched: ");
+    print_int(stats.dispatched);
+    print("\nCompleted:  ");
+    print_int(stats.completed);
+    print("\nErrors:     ");
+    print_int(stats.errors);
+    uint64_t average = stats.completed ? div64_32(stats.latency_total, stats.completed) : 0;
+    print("\nAvg latency: ");
+    print_int(tsc_cycles_to_us(average));
+    print(" us\nMax latency: ");
+    print_int(tsc_cycles_to_us(stats.latency_max));
+    println(" us");
+}
+
+void meminfo_cmd() {
+    struct frame_stats stats;
+    frame_get_stats(&stats);
+    print("\nMemory: ");
+    print_int(stats.total_frames * (FRAME_SIZE / 1024));
+    print(" KiB, free: ");
+    print_int(stats.free_frames * (FRAME_SIZE / 1024));
+    println(" KiB");
+    println("block\tfree");
+    for (int i = 0; i < FRAME_ORDERS; i++) {
+        print_int((FRAME_SIZE / 1024) << i);
+        print(" KiB\t");
+        print_int(stats.free_blocks[i]);
+        enter_char('\n');
+    }
+    print("Allocations: ");
+    print_int(stats.allocations);
+    print("\nFrees:       ");
+    print_int(stats.frees);
+    print("\nFailures:    ");
+    print_int(stats.failures);
+    enter_char('\n');
+}
+
+void clock_cmd(const char* arg) {
+    uint32_t hz;
+    struct timer_stats stats;
+    if (*arg != '\0') {
+        if (parse_uint(arg, &hz) != 0 || hz < PIT_MIN_HZ || hz > PIT_MAX_HZ) {
+            print("\nRate must be ");
+            print_int(PIT_MIN_HZ);
+            print("-");
+            print_int(PIT_MAX_HZ);
+            println(" Hz");
+            return;
+        }
+        ktime_set_rate(hz);
+    }
+    uint32_t ms = (uint32_t)ktime_get_ms();
+    print("\nUptime: ");
+    print_int(ms / 1000);
+    enter_char('.');
+    print_int(ms % 1000 / 100);
+    print_int(ms % 100 / 10);
+    print_int(ms % 10);
+    print(" s\nTimer:  ");
+    print_int(ktime_hz());
+    print(ktime_tickless() ? " Hz when ticking, " : " Hz, ");
+    print_int(ktime_interrupts());
+    print(" interrupts\nTSC:    ");
+    print_int(tsc_khz());
+    println(" kHz");
+    timer_get_stats(&stats);
+    print("Timers: ");
+    print_int(stats.pending);
+    print(" pending, ");
+    print_int(stats.armed);
+    print(" armed, ");
+    print_int(stats.fired);
+    print(" fired, ");
+    print_int(stats.cancelled);
+    print(" cancelled, ");
+    print_int(stats.cascaded);
+    println(" cascaded");
+}
+
+/* The rate is measured by the idle loop, which does not run while a
+   command does, so it reflects the time before the command was typed. */
+void tickless_cmd(const char* arg) {
+    if (str_compare(arg, "on") == 0 || str_compare(arg, "off") == 0) {
+        ktime_set_tickless(arg[1] == 'n');
+    } else if (*arg != '\0') {
+        println("\nUsage: tickless [on|off]");
+        return;
+    }
+    print(ktime_tickless() ? "\nTickless: on" : "\nTickless: off");
+    print("\nWakeups:  ");
+    print_int(ktime_wakeups_per_sec());
+    println("/s");
+}
+
+/* Use is the share of slab memory holding live objects; the rest is free
+   objects, slab headers and the tail of each frame no object fits in. */
+void slabinfo_cmd() {
+    struct kmem_cache_stats stats;
+    struct heap_stats heap;
+    println("\ncache\t\tsize\tactive\ttotal\tslabs\tuse");
+    for (int i = 0; kmem_cache_get_stats(i, &stats) == 0; i++) {
+        print(stats.name);
+        print(str_len(stats.name) < 8 ? "\t\t" : "\t");
+        print_int(stats.object_size);
+        enter_char('\t');
+        print_int(stats.active);
+        enter_char('\t');
+        print_int(stats.total);
+        enter_char('\t');
+        print_int(stats.slabs);
+        enter_char('\t');
+        print_int(stats.slabs ? stats.active * stats.object_size * 100 / (stats.slabs * FRAME_SIZE) : 0);
+        println("%");
+    }
+    heap_get_stats(&heap);
+    print("Large: ");
+    print_int(heap.large_allocations - heap.large_frees);
+    print(" live, ");
+    print_int(heap.large_allocations);
+    print(" allocated, failures: ");
+    print_int(heap.failures);
+    enter_char('\n');
+}
+
+/* Redraws the whole screen cell by cell, as the console writes it, with
+   VGA memory uncached and then write-combining, and puts it back after. */
+void fbbench_cmd() {
+    static uint16_t saved[WIDTH * HEIGHT];
+    static const uint32_t types[2] = {PAGE_CACHE_UC, PAGE_CACHE_WC};
+    static const char* names[2] = {"uncached:        ", "write-combining: "};
+    volatile uint16_t* screen = (volatile uint16_t*)MEM_SPACE;
+    uint32_t us[2] = {0, 0};
+    int runs = paging_wc_supported() ? 2 : 1;
+
+    if (!paging_enabled()) {
+        println("\nPaging is off");
+        return;
+    }
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        saved[i] = screen[i];
+    }
+    for (int t = 0; t < runs; t++) {
+        paging_set_cache(MEM_SPACE, MEM_SPACE_SIZE, types[t]);
+        uint64_t start = tsc_read();
+        for (int frame = 0; frame < BENCH_FB_FRAMES; frame++) {
+            uint16_t cell = vga_entry('A' + frame % 26, vga_colour(VGA_COLOUR_LIGHT_GRAY, VGA_COLOUR_BLACK));
+            for (int i = 0; i < WIDTH * HEIGHT; i++) {
+                screen[i] = cell;
+            }
+        }
+        us[t] = tsc_cycles_to_us(tsc_read() - start);
+        if (us[t] == 0) {
+            us[t] = 1;
+        }
+    }
+    paging_set_cache(MEM_SPACE, MEM_SPACE_SIZE, runs == 2 ? PAGE_CACHE_WC : PAGE_CACHE_WB);
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        screen[i] = saved[i];
+    }
+
+    enter_char('\n');
+    for (int t = 0; t < runs; t++) {
+        print(names[t]);
+        print_int(us[t] / BENCH_FB_FRAMES);
+        print(" us/frame, ");
+        print_int(div64_32((uint64_t)WIDTH * HEIGHT * 2 * BENCH_FB_FRAMES, us[t]));
+        println(" MB/s");
+    }
+    if (runs == 2) {
+        print("Speedup: ");
+        print_int(us[0] / us[1]);
+        enter_char('.');
+        enter_char('0' + us[0] * 10 / us[1] % 10);
+        println("x");
+    } else {
+        println("No PAT, write-combining unavailable");
+    }
+}
+
+/* Prints bytes per cycle with two decimals. */
+static void print_rate_per_cycle(uint32_t bytes, uint64_t cycles) {
+    uint32_t rate = div64_32((uint64_t)bytes * 100, cycles ? (uint32_t)cycles : 1);
+    print_int(rate / 100);
+    enter_char('.');
+    enter_char('0' + rate / 10 % 10);
+    enter_char('0' + rate % 10);
+}
+
+/* Copies and fills BENCH_MEM_BYTES in blocks of each size between the two
+   halves of the bench buffer with every variant of the memory routines. */
+void membench_cmd() {
+    static const uint32_t sizes[4] = {64, 512, 4096, 16384};
+    static const char* names[4] = {"bytes", "rep", "erms", "sse"};
+    uint8_t* src = bench_buffer;
+    uint8_t* dest = bench_buffer + sizeof(bench_buffer) / 2;
+    int variants = mem_sse_enabled() ? 4 : 3;
+
+    println("\nsize\tvariant\tmemcpy\tmemset (bytes/cycle)");
+    for (int i = 0; i < 4; i++) {
+        for (int v = 0; v < variants; v++) {
+            uint32_t rounds = BENCH_MEM_BYTES / sizes[i];
+            uint64_t start = tsc_read();
+            for (uint32_t r = 0; r < rounds; r++) {
+                if (v == 0) {
+                    memcpy_bytes(dest, src, sizes[i]);
+                } else if (v == 1) {
+                    memcpy_rep(dest, src, sizes[i]);
+                } else if (v == 2) {
+                    memcpy_erms(dest, src, sizes[i]);
+                } else {
+                    memcpy_sse(dest, src, sizes[i]);
+                }
             }
+            uint64_t copy = tsc_read() - start;
+            start = tsc_read();
+            for (uint32_t r = 0; r < rounds; r++) {
+                if (v == 0) {
+                    memset_bytes(dest, r, sizes[i]);
+                } else if (v == 1) {
+                    memset_rep(dest, r, sizes[i]);
+                } else if (v == 2) {
+                    memset_erms(dest, r, sizes[i]);
+                } else {
+                    memset_sse(dest, r, sizes[i]);
+                }
+            }
+            uint64_t fill = tsc_read() - start;
+            print_int(sizes[i]);
+            enter_char('\t');
+            print(names[v]);
+            enter_char('\t');
+            print_rate_per_cycle(BENCH_MEM_BYTES, copy);
+            enter_char('\t');
+            print_rate_per_cycle(BENCH_MEM_BYTES, fill);
+            enter_char('\n');
         }
-        
-        print(" (");
-        print_int(entries[i].file_size);
-        println(" bytes)");
     }
+    if (!mem_sse_enabled()) {
+        println("SSE2 not available");
+    }
+}
+
+void cd_cmd(const char* path) {
+    if (fat12_chdir(path) != 0) {
+        println("\nNo such directory");
+        return;
+    }
+    enter_char('\n');
+}
+
+void mkdir_cmd(const char* path) {
+    if (fat12_mkdir(path) != 0) {
+        println("\nCannot create directory");
+        return;
+    }
+    enter_char('\n');
+}
+
+void readahead_cmd(const char* arg) {
+    uint32_t clusters;
+    if (*arg != '\0') {
+        if (parse_uint(arg, &clusters) != 0 || fat12_set_readahead(clusters) != 0) {
+            print("\nWindow must be 0-");
+            print_int(FAT12_READAHEAD_MAX);
+            enter_char('\n');
+            return;
+        }
+    }
+    print("\nRead-ahead: ");
+    print_int(fat12_get_readahead());
+    println(" clusters");
+}
+
+/* The RAM disk's memory comes from the frame allocator on first use. It
+   is cleared once so the first mount formats it, and keeps its files
+   until reboot across switches back and forth. */
+void ramdisk_cmd(const char* arg) {
+    static struct block_device* ram = NULL;
+    struct block_device* dev;
+
+    if (str_compare(arg, "off") == 0) {
+        dev = block_get_device(0);
+    } else if (*arg != '\0') {
+        println("\nUsage: ramdisk [off]");
+        return;
+    } else {
+        if (ram == NULL) {
+            uint32_t order = 0;
+            while ((FRAME_SIZE << order) < RAMDISK_SECTORS * BLOCK_SECTOR_SIZE) {
+                order++;
+            }
+            void* memory = (void*)frame_alloc(order);
+            if (memory == NULL) {
+                println("\nNot enough memory for the RAM disk");
+                return;
+            }
+            memset(memory, 0, RAMDISK_SECTORS * BLOCK_SECTOR_SIZE);
+            ram = ramdisk_create(memory, RAMDISK_SECTORS);
+            block_register(ram);
+        }
+        dev = ram;
+    }
+    if (fat12_is_initialized() && fat12_sync() != 0) {
+        println("\nSync failed");
+        return;
+    }
+    if (fat12_init(dev, BLOCK_MODE_DMA) != 0) {
+        println("\nMount failed");
+        return;
+    }
+    print("\nMounted ");
+    println(dev->name);
+}
+
+void journal_cmd(const char* arg) {
+    struct journal_stats stats;
+    if (str_compare(arg, "on") == 0 || str_compare(arg, "off") == 0) {
+        if (fat12_set_journaling(arg[1] == 'n') != 0) {
+            println("\nNo journal on this volume");
+            return;
+        }
+    } else if (*arg != '\0') {
+        println("\nUsage: journal [on|off]");
+        return;
+    }
+    journal_get_stats(&stats);
+    print(fat12_journaling() ? "\nJournaling: on" : "\nJournaling: off");
+    print("\nCommits:     ");
+    print_int(stats.commits);
+    print("\nLogged:      ");
+    print_int(stats.sectors_logged);
+    print("\nCheckpoints: ");
+    print_int(stats.checkpoints);
+    print("\nReplayed:    ");
+    print_int(stats.replayed);
+    enter_char('\n');
+}
+
+static void bench_file_name(char* name, int n) {
+    const char* prefix = "bnch";
+    int i = 0;
+    while (prefix[i]) {
+        name[i] = prefix[i];
+        i++;
+    }
+    name[i++] = '0' + (n / 1000) % 10;
+    name[i++] = '0' + (n / 100) % 10;
+    name[i++] = '0' + (n / 10) % 10;
+    name[i++] = '0' + n % 10;
+    name[i++] = '.';
+    name[i++] = 't';
+    name[i++] = 'm';
+    name[i++] = 'p';
+    name[i] = '\0';
+}
+
+/* Fills the root directory with empty files and, every BENCH_LOOKUP_STEP
+   files, times lookups of present and absent names. Reading an empty file
+   returns right after the directory lookup, so that is what is measured. */
+void lookupbench_cmd() {
+    char name[16];
+    char dummy[1];
+    int created = 0;
+
+    println("\nEntries  hit cycles  miss cycles");
+    while (1) {
+        bench_file_name(name, created);
+        if (fat12_create_file(name, FAT12_ATTR_ARCHIVE) != 0) {
+            break;
+        }
+        created++;
+        if (created % BENCH_LOOKUP_STEP != 0) {
+            continue;
+        }
+
+        uint32_t seed = created;
+        uint64_t start = tsc_read();
+        for (int i = 0; i < BENCH_LOOKUPS; i++) {
+            seed = seed * 1103515245 + 12345;
+            bench_file_name(name, (seed >> 8) % created);
+            fat12_read_file(name, dummy, 0);
+        }
+        uint32_t hit = div64_32(tsc_read() - start, BENCH_LOOKUPS);
+
+        start = tsc_read();
+        for (int i = 0; i < BENCH_LOOKUPS; i++) {
+            bench_file_name(name, 9000 + i);
+            fat12_read_file(name, dummy, 0);
+        }
+        uint32_t miss = div64_32(tsc_read() - start, BENCH_LOOKUPS);
+
+        print_int(created);
+        print("      ");
+        print_int(hit);
+        print("        ");
+        print_int(miss);
+        enter_char('\n');
+    }
+
+    for (int i = 0; i < created; i++) {
+        bench_file_name(name, i);
+        fat12_delete_file(name);
+    }
+}
+
+void cat_cmd(const char* name) {
+    char chunk[64];
+    int fd = fat12_open(name, FAT12_O_READ);
+    if (fd < 0) {
+        println("\nFile not found");
+        return;
+    }
+    enter_char('\n');
+    int bytes;
+    while ((bytes = fat12_read(fd, chunk, sizeof(chunk))) > 0) {
+        for (int i = 0; i < bytes; i++) {
+            enter_char(chunk[i]);
+        }
+    }
+    fat12_close(fd);
+    enter_char('\n');
 }
 
 void execute_command(char* input) {
@@ -195,7 +792,86 @@ void execute_command(char* input) {
         fs_test_cmd();
     }
     else if (str_compare(input, "ls") == 0) {
-        ls_cmd();
+        ls_cmd(".");
+    }
+    else if (str_prefix(input, "ls ")) {
+        ls_cmd(input + 3);
+    }
+    else if (str_compare(input, "cd") == 0) {
+        cd_cmd("/");
+    }
+    else if (str_prefix(input, "cd ")) {
+        cd_cmd(input + 3);
+    }
+    else if (str_prefix(input, "mkdir ")) {
+        mkdir_cmd(input + 6);
+    }
+    else if (str_prefix(input, "cat ")) {
+        cat_cmd(input + 4);
+    }
+    else if (str_compare(input, "diskbench") == 0) {
+        diskbench_cmd();
+    }
+    else if (str_compare(input, "dmabench") == 0) {
+        dmabench_cmd();
+    }
+    else if (str_compare(input, "cachestat") == 0) {
+        cachestat_cmd();
+    }
+    else if (str_compare(input, "iostat") == 0) {
+        iostat_cmd();
+    }
+    else if (str_compare(input, "membench") == 0) {
+        membench_cmd();
+    }
+    else if (str_compare(input, "meminfo") == 0) {
+        meminfo_cmd();
+    }
+    else if (str_compare(input, "slabinfo") == 0) {
+        slabinfo_cmd();
+    }
+    else if (str_compare(input, "fbbench") == 0) {
+        fbbench_cmd();
+    }
+    else if (str_compare(input, "clock") == 0) {
+        clock_cmd("");
+    }
+    else if (str_prefix(input, "clock ")) {
+        clock_cmd(input + 6);
+    }
+    else if (str_compare(input, "tickless") == 0) {
+        tickless_cmd("");
+    }
+    else if (str_prefix(input, "tickless ")) {
+        tickless_cmd(input + 9);
+    }
+    else if (str_compare(input, "lookupbench") == 0) {
+        lookupbench_cmd();
+    }
+    else if (str_compare(input, "readahead") == 0) {
+        readahead_cmd("");
+    }
+    else if (str_prefix(input, "readahead ")) {
+        readahead_cmd(input + 10);
+    }
+    else if (str_compare(input, "journal") == 0) {
+        journal_cmd("");
+    }
+    else if (str_prefix(input, "journal ")) {
+        journal_cmd(input + 8);
+    }
+    else if (str_compare(input, "ramdisk") == 0) {
+        ramdisk_cmd("");
+    }
+    else if (str_prefix(input, "ramdisk ")) {
+        ramdisk_cmd(input + 8);
+    }
+    else if (str_compare(input, "sync") == 0) {
+        if (fat12_sync() != 0) {
+            println("\nSync failed");
+        } else {
+            enter_char('\n');
+        }
     }
     else {
         println("\nUnknown command");
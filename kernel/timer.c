@@ -0,0 +1,229 @@
+#include "timer.h"
+
+/* Function Declarations */
+static void timer_place(struct timer* timer);
+static void timer_unlink(struct timer* timer);
+static void timer_cascade(int level, uint32_t slot);
+static void timer_leave(int level, const struct timer* timer);
+static void timer_rescan(int level);
+
+/* Global Variables */
+static struct timer* wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+static uint64_t wheel_time = 0;
+static uint64_t level_next[TIMER_WHEEL_LEVELS];
+static uint32_t level_pending[TIMER_WHEEL_LEVELS];
+static int level_stale[TIMER_WHEEL_LEVELS];
+static struct timer_stats stats;
+
+/* Ticks are whatever unit the caller counts in; the kernel uses
+   milliseconds. now is the first tick timer_run() has yet to process. */
+void timer_wheel_init(uint64_t now) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SIZE; slot++) {
+            wheel[level][slot] = NULL;
+        }
+        level_next[level] = ~0ULL;
+        level_pending[level] = 0;
+        level_stale[level] = 0;
+    }
+    wheel_time = now;
+    stats.armed = 0;
+    stats.cancelled = 0;
+    stats.fired = 0;
+    stats.cascaded = 0;
+    stats.pending = 0;
+}
+
+void timer_setup(struct timer* timer, void (*callback)(void* ctx), void* ctx) {
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->list = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->ctx = ctx;
+}
+
+/* Level n holds timers due within 64^(n+1) ticks, slotted by bits
+   6n..6n+5 of their expiry, so a timer is placed with a couple of
+   compares and a list push. Overdue timers go in the next slot to run;
+   ones beyond the wheel's range wait in its last slot and are placed
+   again when it cascades. */
+static void timer_place(struct timer* timer) {
+    uint64_t expires = timer->expires;
+    int level = 0;
+    if (expires < wheel_time) {
+        expires = wheel_time;
+    } else {
+        uint64_t delta = expires - wheel_time;
+        if (delta >= TIMER_WHEEL_RANGE) {
+            delta = TIMER_WHEEL_RANGE - 1;
+            expires = wheel_time + delta;
+        }
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_WHEEL_BITS))) {
+            level++;
+        }
+    }
+    struct timer** list = &wheel[level][(expires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK];
+    timer->prev = NULL;
+    timer->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = timer;
+    }
+    *list = timer;
+    timer->list = list;
+    level_pending[level]++;
+    if (timer->expires < level_next[level]) {
+        level_next[level] = timer->expires;
+    }
+}
+
+/* Each level keeps its earliest expiry up to date as timers arrive; when
+   the earliest one leaves, the level is only marked for timer_next() to
+   look through again. */
+static void timer_leave(int level, const struct timer* timer) {
+    level_pending[level]--;
+    if (level_pending[level] == 0) {
+        level_next[level] = ~0ULL;
+        level_stale[level] = 0;
+    } else if (timer->expires == level_next[level]) {
+        level_stale[level] = 1;
+    }
+}
+
+static void timer_rescan(int level) {
+    level_next[level] = ~0ULL;
+    for (int slot = 0; slot < TIMER_WHEEL_SIZE; slot++) {
+        for (struct timer* timer = wheel[level][slot]; timer != NULL; timer = timer->next) {
+            if (timer->expires < level_next[level]) {
+                level_next[level] = timer->expires;
+            }
+        }
+    }
+    level_stale[level] = 0;
+}
+
+static void timer_unlink(struct timer* timer) {
+    timer_leave((int)((timer->list - &wheel[0][0]) / TIMER_WHEEL_SIZE), timer);
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->list = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    timer->list = NULL;
+}
+
+/* Arms timer to fire once at tick expires, moving it if already armed. */
+int timer_add(struct timer* timer, uint64_t expires) {
+    if (timer == NULL || timer->callback == NULL) {
+        return -1;
+    }
+    if (timer->list != NULL) {
+        timer_unlink(timer);
+        stats.pending--;
+    }
+    timer->expires = expires;
+    timer_place(timer);
+    stats.armed++;
+    stats.pending++;
+    return 0;
+}
+
+/* Returns 0 if the timer was pending and will now not fire, -1 if it was
+   not armed or has already fired. */
+int timer_cancel(struct timer* timer) {
+    if (timer == NULL || timer->list == NULL) {
+        return -1;
+    }
+    timer_unlink(timer);
+    stats.cancelled++;
+    stats.pending--;
+    return 0;
+}
+
+int timer_pending(const struct timer* timer) {
+    return timer->list != NULL;
+}
+
+/* Spreads a slot of a higher level over the levels below it as the wheel
+   reaches the span it covers. */
+static void timer_cascade(int level, uint32_t slot) {
+    struct timer* timer = wheel[level][slot];
+    wheel[level][slot] = NULL;
+    while (timer != NULL) {
+        struct timer* next = timer->next;
+        timer_leave(level, timer);
+        timer_place(timer);
+        stats.cascaded++;
+        timer = next;
+    }
+}
+
+/* Fires every timer due at or before now, in callbacks that may arm and
+   cancel timers themselves. Costs one step per tick elapsed, or nothing
+   beyond catching up the clock when no timer is pending. */
+void timer_run(uint64_t now) {
+    if (stats.pending == 0) {
+        if (now >= wheel_time) {
+            wheel_time = now + 1;
+        }
+        return;
+    }
+    while (wheel_time <= now) {
+        uint64_t tick = wheel_time;
+        uint32_t slot = tick & TIMER_WHEEL_MASK;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS && slot == 0; level++) {
+            slot = (tick >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+            timer_cascade(level, slot);
+        }
+        // timers armed from the callbacks below land in later ticks
+        wheel_time++;
+        struct timer** list = &wheel[0][tick & TIMER_WHEEL_MASK];
+        while (*list != NULL) {
+            struct timer* timer = *list;
+            timer_unlink(timer);
+            stats.fired++;
+            stats.pending--;
+            timer->callback(timer->ctx);
+        }
+    }
+}
+
+/* Finds the tick the earliest pending timer fires on, for programming a
+   one-shot wakeup. Level 0 holds the next 64 ticks in order, so its first
+   busy slot is the earliest there; timers still on higher levels may be
+   due sooner, so their earliest expiries are compared too. A level's
+   lists are only walked again after its earliest timer has left it.
+   Returns -1 with nothing pending. */
+int timer_next(uint64_t* tick) {
+    if (stats.pending == 0) {
+        return -1;
+    }
+    uint64_t next = wheel_time + TIMER_WHEEL_RANGE;
+    for (uint32_t i = 0; i < TIMER_WHEEL_SIZE; i++) {
+        if (wheel[0][(wheel_time + i) & TIMER_WHEEL_MASK] != NULL) {
+            next = wheel_time + i;
+            break;
+        }
+    }
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (level_stale[level]) {
+            timer_rescan(level);
+        }
+        if (level_next[level] < next) {
+            next = level_next[level];
+        }
+    }
+    *tick = next;
+    return 0;
+}
+
+void timer_get_stats(struct timer_stats* out) {
+    out->armed = stats.armed;
+    out->cancelled = stats.cancelled;
+    out->fired = stats.fired;
+    out->cascaded = stats.cascaded;
+    out->pending = stats.pending;
+}
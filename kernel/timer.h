@@ -0,0 +1,41 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_RANGE (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+/* Struct Creation */
+struct timer {
+    struct timer* prev;
+    struct timer* next;
+    struct timer** list;
+    uint64_t expires;
+    void (*callback)(void* ctx);
+    void* ctx;
+};
+
+struct timer_stats {
+    uint32_t armed;
+    uint32_t cancelled;
+    uint32_t fired;
+    uint32_t cascaded;
+    uint32_t pending;
+};
+
+/* Function Declarations */
+void timer_wheel_init(uint64_t now);
+void timer_setup(struct timer* timer, void (*callback)(void* ctx), void* ctx);
+int timer_add(struct timer* timer, uint64_t expires);
+int timer_cancel(struct timer* timer);
+int timer_pending(const struct timer* timer);
+void timer_run(uint64_t now);
+int timer_next(uint64_t* tick);
+void timer_get_stats(struct timer_stats* out);
+
+#endif
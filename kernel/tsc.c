@@ -0,0 +1,66 @@
+#include "tsc.h"
+#include "io.h"
+
+/* Function Declarations */
+static unsigned char cmos_read(unsigned char reg);
+static unsigned char rtc_seconds();
+
+/* Global Variables */
+static uint32_t tsc_freq_khz = 0;
+
+uint64_t tsc_read() {
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* There is no libgcc in the kernel link, so 64-bit division is done as
+   two 32-bit divl steps instead of through __udivdi3. */
+uint64_t div64_32(uint64_t dividend, uint32_t divisor) {
+    uint32_t high = dividend >> 32;
+    uint32_t low = dividend & 0xFFFFFFFF;
+    uint32_t quot_high = high / divisor;
+    uint32_t rem = high % divisor;
+    uint32_t quot_low;
+    __asm__("divl %2" : "=a"(quot_low), "=d"(rem) : "rm"(divisor), "a"(low), "d"(rem));
+    return ((uint64_t)quot_high << 32) | quot_low;
+}
+
+static unsigned char cmos_read(unsigned char reg) {
+    outb(CMOS_ADDRESS, reg);
+    return inb(CMOS_DATA);
+}
+
+static unsigned char rtc_seconds() {
+    while (cmos_read(CMOS_REG_STATUS_A) & 0x80);
+    return cmos_read(CMOS_REG_SECONDS);
+}
+
+/* Normally set at boot from the PIT by ktime_init(). Failing that it is
+   calibrated lazily against one RTC second edge, so the first caller pays
+   up to two seconds. */
+uint32_t tsc_khz() {
+    if (tsc_freq_khz) {
+        return tsc_freq_khz;
+    }
+    unsigned char start = rtc_seconds();
+    while (rtc_seconds() == start);
+    uint64_t t0 = tsc_read();
+    start = rtc_seconds();
+    while (rtc_seconds() == start);
+    uint64_t t1 = tsc_read();
+
+    tsc_freq_khz = div64_32(t1 - t0, 1000);
+    if (tsc_freq_khz == 0) {
+        tsc_freq_khz = 1;
+    }
+    return tsc_freq_khz;
+}
+
+void tsc_set_khz(uint32_t khz) {
+    tsc_freq_khz = khz;
+}
+
+uint32_t tsc_cycles_to_us(uint64_t cycles) {
+    return div64_32(cycles * 1000, tsc_khz());
+}
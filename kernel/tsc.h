@@ -0,0 +1,19 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include "kernel.h"
+
+/* Definitions */
+#define CMOS_ADDRESS 0x70
+#define CMOS_DATA 0x71
+#define CMOS_REG_SECONDS 0x00
+#define CMOS_REG_STATUS_A 0x0A
+
+/* Function Declarations */
+uint64_t tsc_read();
+uint32_t tsc_khz();
+void tsc_set_khz(uint32_t khz);
+uint32_t tsc_cycles_to_us(uint64_t cycles);
+uint64_t div64_32(uint64_t dividend, uint32_t divisor);
+
+#endif
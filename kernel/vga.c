@@ -1,6 +1,7 @@
 #include "vga.h"
 #include "kernel.h"
 #include "io.h"
+#include "mem.h"
 
 int cur_x = 0;
 int cur_y = 0;
@@ -18,12 +19,10 @@ unsigned short vga_entry(unsigned char c, unsigned char colour){
 }
 
 void clr_scr(){
-    unsigned short* vid_mem = (unsigned short*)MEM_SPACE;
+    volatile unsigned short* vid_mem = (volatile unsigned short*)MEM_SPACE;
     unsigned short blank = vga_entry(' ', curr_clr);
 
-    for (int i=0; i < WIDTH*HEIGHT; i++){
-        vid_mem[i]=blank;
-    }
+    memsetw((void*)vid_mem, blank, WIDTH*HEIGHT);
 
     cur_x=0;
     cur_y=0;
@@ -43,22 +42,18 @@ void set_colour(unsigned char fg, unsigned char bg){
 }
 
 void scroll_up(){
-    unsigned short* vid_mem = (unsigned short*)MEM_SPACE;
+    volatile unsigned short* vid_mem = (volatile unsigned short*)MEM_SPACE;
     unsigned short blank = vga_entry(' ', curr_clr);
 
-    for (int i=0; i<(HEIGHT-1)*WIDTH; i++){
-        vid_mem[i] = vid_mem[i+WIDTH];
-    } 
-    for (int i=(HEIGHT-1)*WIDTH; i<HEIGHT*WIDTH; i++){
-        vid_mem[i] = blank;
-    }
+    memmove((void*)vid_mem, (void*)(vid_mem+WIDTH), (HEIGHT-1)*WIDTH*sizeof(unsigned short));
+    memsetw((void*)(vid_mem+(HEIGHT-1)*WIDTH), blank, WIDTH);
 
     cur_y = HEIGHT-1;
     update_cursor();
 }
 
 void enter_char(char c){
-    unsigned short* vid_mem = (unsigned short*)MEM_SPACE;
+    volatile unsigned short* vid_mem = (volatile unsigned short*)MEM_SPACE;
     
     if (c == '\n') {
         cur_x = 0;
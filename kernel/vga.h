@@ -21,6 +21,7 @@
 #define VGA_COLOUR_LIGHT_BROWN 14
 #define VGA_COLOUR_WHITE 15
 #define MEM_SPACE 0xB8000
+#define MEM_SPACE_SIZE 0x8000
 
 #define WIDTH 80
 #define HEIGHT 25
@@ -0,0 +1,476 @@
+/* Libraries */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "host_disk.h"
+#include "../kernel/bcache.h"
+#include "../kernel/blkq.h"
+#include "../kernel/ramdisk.h"
+#include "../kernel/mem.h"
+#include "../filesystem/fat12.h"
+#include "../filesystem/dentry.h"
+
+/* Function Declarations */
+static double now_us();
+static void mount_fresh();
+static void report(const char* label, double us, uint32_t ops, const char* unit);
+static void bench_lookup();
+static void bench_allocation();
+static void bench_sequential();
+static void bench_random();
+static void bench_chain_walk();
+static void bench_path_walk();
+static void bench_listing();
+static void bench_small_writes(int journaled);
+static void bench_ramdisk();
+static void bench_memory();
+static void bench_image(const char* path);
+
+/* Definitions */
+#define BENCH_IMAGE "tests/fat12_bench.img"
+#define BENCH_SECTORS 2880
+#define BENCH_FILES 200
+#define BENCH_LOOKUPS 20000
+#define BENCH_FILE_SIZE (256 * 1024)
+#define BENCH_CHUNK 4096
+#define BENCH_PASSES 20
+#define BENCH_RANDOM_READS 20000
+#define BENCH_CHAIN_WALKS 2000
+#define BENCH_DEPTH 6
+#define BENCH_PATH_WALKS 20000
+#define BENCH_LONG_NAMES 50
+#define BENCH_LISTINGS 2000
+#define BENCH_SMALL_FILES 150
+#define BENCH_MEM_BYTES (64 * 1024 * 1024)
+
+/* Global Variables */
+static struct block_device* disk = NULL;
+static uint8_t data_buffer[BENCH_FILE_SIZE];
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void mount_fresh() {
+    if (disk != NULL) {
+        fat12_sync();
+        host_disk_close(disk);
+    }
+    disk = host_disk_create(BENCH_IMAGE, BENCH_SECTORS);
+    bcache_init();
+    if (disk == NULL || fat12_init(disk, BLOCK_MODE_PIO) != 0) {
+        printf("cannot create %s\n", BENCH_IMAGE);
+    }
+}
+
+static void report(const char* label, double us, uint32_t ops, const char* unit) {
+    printf("%-28s %10.3f us/%s  (%u %ss in %.1f ms)\n", label, us / ops, unit, ops, unit, us / 1000);
+}
+
+/* Opens of existing names and of names that miss, against a directory
+   holding BENCH_FILES entries. */
+static void bench_lookup() {
+    char name[16];
+
+    mount_fresh();
+    for (int i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "l%04d.txt", i);
+        fat12_create_file(name, FAT12_ATTR_ARCHIVE);
+    }
+
+    double start = now_us();
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        snprintf(name, sizeof(name), "l%04d.txt", (i * 7) % BENCH_FILES);
+        fat12_close(fat12_open(name, FAT12_O_READ));
+    }
+    report("lookup hit", now_us() - start, BENCH_LOOKUPS, "op");
+
+    start = now_us();
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        snprintf(name, sizeof(name), "m%04d.txt", i % BENCH_FILES);
+        fat12_open(name, FAT12_O_READ);
+    }
+    report("lookup miss", now_us() - start, BENCH_LOOKUPS, "op");
+}
+
+/* Single clusters, then a large file placed into the holes left by
+   deleting every other small file. */
+static void bench_allocation() {
+    mount_fresh();
+    uint32_t free_clusters = fat12_free_clusters();
+
+    double start = now_us();
+    for (uint32_t i = 0; i < free_clusters; i++) {
+        uint16_t cluster = fat12_find_free_cluster();
+        if (cluster == 0) {
+            free_clusters = i;
+            break;
+        }
+        fat12_set_next_cluster(cluster, FAT12_EOF_CLUSTER);
+    }
+    report("allocate cluster", now_us() - start, free_clusters, "op");
+
+    char name[16];
+    mount_fresh();
+    for (int i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "a%04d.bin", i);
+        fat12_write_file(name, data_buffer, SECTOR_SIZE);
+    }
+    for (int i = 0; i < BENCH_FILES; i += 2) {
+        snprintf(name, sizeof(name), "a%04d.bin", i);
+        fat12_delete_file(name);
+    }
+    start = now_us();
+    int written = fat12_write_file("frag.bin", data_buffer, BENCH_FILE_SIZE);
+    report("fragmented file write", now_us() - start, written > 0 ? written / SECTOR_SIZE : 1, "cluster");
+}
+
+static void bench_sequential() {
+    mount_fresh();
+    memset(data_buffer, 0x5A, sizeof(data_buffer));
+
+    double start = now_us();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        int fd = fat12_open("seq.bin", FAT12_O_WRITE | FAT12_O_CREATE | FAT12_O_TRUNC);
+        for (uint32_t pos = 0; pos < BENCH_FILE_SIZE; pos += BENCH_CHUNK) {
+            fat12_write(fd, data_buffer + pos, BENCH_CHUNK);
+        }
+        fat12_close(fd);
+    }
+    double us = now_us() - start;
+    report("sequential write", us, BENCH_PASSES * (BENCH_FILE_SIZE / BENCH_CHUNK), "chunk");
+    printf("%-28s %10.2f MB/s\n", "", BENCH_PASSES * (double)BENCH_FILE_SIZE / us);
+
+    uint32_t requests = disk->read_requests;
+    start = now_us();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        int fd = fat12_open("seq.bin", FAT12_O_READ);
+        while (fat12_read(fd, data_buffer, BENCH_CHUNK) > 0) {
+        }
+        fat12_close(fd);
+    }
+    us = now_us() - start;
+    report("sequential read", us, BENCH_PASSES * (BENCH_FILE_SIZE / BENCH_CHUNK), "chunk");
+    printf("%-28s %10.2f MB/s, %u device reads\n", "", BENCH_PASSES * (double)BENCH_FILE_SIZE / us,
+           disk->read_requests - requests);
+}
+
+static void bench_random() {
+    uint8_t sector[SECTOR_SIZE];
+    uint32_t seed = 1;
+
+    mount_fresh();
+    fat12_write_file("rand.bin", data_buffer, BENCH_FILE_SIZE);
+    int fd = fat12_open("rand.bin", FAT12_O_READ);
+    double start = now_us();
+    for (int i = 0; i < BENCH_RANDOM_READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        fat12_seek(fd, ((seed >> 8) % (BENCH_FILE_SIZE / SECTOR_SIZE)) * SECTOR_SIZE, FAT12_SEEK_SET);
+        fat12_read(fd, sector, SECTOR_SIZE);
+    }
+    report("random sector read", now_us() - start, BENCH_RANDOM_READS, "op");
+    fat12_close(fd);
+}
+
+/* Follows the chain of a file stitched together from the holes of a
+   fragmented volume, once against the packed 12-bit FAT and once against
+   the decoded table. */
+static void bench_chain_walk() {
+    static struct fat12_dir_entry entries[512];
+    char name[16];
+    uint16_t first = 0;
+
+    mount_fresh();
+    for (int i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "c%04d.bin", i);
+        fat12_write_file(name, data_buffer, SECTOR_SIZE);
+    }
+    for (int i = 0; i < BENCH_FILES; i += 2) {
+        snprintf(name, sizeof(name), "c%04d.bin", i);
+        fat12_delete_file(name);
+    }
+    fat12_write_file("chain.bin", data_buffer, BENCH_FILE_SIZE);
+    int count = fat12_list_directory(entries, 512);
+    for (int i = 0; i < count; i++) {
+        if (memcmp(entries[i].filename, "CHAIN   BIN", 11) == 0) {
+            first = entries[i].cluster_low;
+        }
+    }
+
+    for (int decoded = 0; decoded <= 1; decoded++) {
+        uint32_t links = 0;
+        fat12_set_decoded_fat(decoded);
+        double start = now_us();
+        for (int pass = 0; pass < BENCH_CHAIN_WALKS; pass++) {
+            uint16_t cluster = first;
+            while (cluster >= 2 && cluster < FAT12_BAD_CLUSTER) {
+                cluster = fat12_get_next_cluster(cluster);
+                links++;
+            }
+        }
+        double us = now_us() - start;
+        printf("%-28s %10.3f ns/link  (%u links in %.1f ms)\n",
+               decoded ? "chain walk (decoded FAT)" : "chain walk (packed FAT)", us * 1000 / links, links, us / 1000);
+    }
+}
+
+/* Opens a file BENCH_DEPTH directories down, each directory padded with
+   entries so a scan of it would span several sectors. */
+static void bench_path_walk() {
+    struct dentry_stats before, after;
+    char path[128];
+    char name[160];
+    int length = 0;
+
+    mount_fresh();
+    for (int depth = 0; depth < BENCH_DEPTH; depth++) {
+        length += snprintf(path + length, sizeof(path) - length, "%sdir%d", depth ? "/" : "", depth);
+        fat12_mkdir(path);
+        for (int i = 0; i < 40; i++) {
+            snprintf(name, sizeof(name), "%s/p%04d.txt", path, i);
+            fat12_create_file(name, FAT12_ATTR_ARCHIVE);
+        }
+    }
+    snprintf(name, sizeof(name), "%s/leaf.txt", path);
+    fat12_write_file(name, data_buffer, SECTOR_SIZE);
+
+    uint32_t requests = disk->read_requests;
+    dentry_get_stats(&before);
+    double start = now_us();
+    for (int i = 0; i < BENCH_PATH_WALKS; i++) {
+        fat12_close(fat12_open(name, FAT12_O_READ));
+    }
+    report("path walk", now_us() - start, BENCH_PATH_WALKS, "op");
+    dentry_get_stats(&after);
+    printf("%-28s %u dentry hits, %u misses, %u device reads\n", "", after.hits - before.hits,
+           after.misses - before.misses, disk->read_requests - requests);
+}
+
+/* Lists a directory of long names: the root serves them from its decoded
+   name pool, a subdirectory reassembles them from the LFN slots. */
+static void bench_listing() {
+    static struct fat12_dirent entries[BENCH_LONG_NAMES + 2];
+    char name[64];
+
+    mount_fresh();
+    fat12_mkdir("long names");
+    for (int i = 0; i < BENCH_LONG_NAMES; i++) {
+        snprintf(name, sizeof(name), "a fairly long file name %04d.txt", i);
+        fat12_create_file(name, FAT12_ATTR_ARCHIVE);
+        snprintf(name, sizeof(name), "long names/a fairly long file name %04d.txt", i);
+        fat12_create_file(name, FAT12_ATTR_ARCHIVE);
+    }
+
+    double start = now_us();
+    for (int i = 0; i < BENCH_LISTINGS; i++) {
+        fat12_read_dir("/", entries, BENCH_LONG_NAMES + 2);
+    }
+    report("list root (cached names)", now_us() - start, BENCH_LISTINGS, "op");
+    start = now_us();
+    for (int i = 0; i < BENCH_LISTINGS; i++) {
+        fat12_read_dir("long names", entries, BENCH_LONG_NAMES + 2);
+    }
+    report("list subdir (decoded)", now_us() - start, BENCH_LISTINGS, "op");
+}
+
+/* Many small files written and closed one after another, split between
+   the root and a subdirectory. Each close is a metadata update; with the
+   journal it costs one log write instead of FAT and directory writes. */
+static void bench_small_writes(int journaled) {
+    char name[32];
+
+    fat12_set_journaling(journaled);
+    mount_fresh();
+    fat12_mkdir("small");
+    uint32_t requests = disk->write_requests;
+    uint32_t sectors = disk->sectors_written;
+    struct blkq_stats queue;
+    blkq_reset_stats();
+    double start = now_us();
+    for (int i = 0; i < BENCH_SMALL_FILES; i++) {
+        snprintf(name, sizeof(name), i % 2 ? "small/s%04d.txt" : "s%04d.txt", i);
+        fat12_write_file(name, data_buffer, 700);
+    }
+    fat12_sync();
+    report(journaled ? "small writes (journal)" : "small writes (direct)", now_us() - start, BENCH_SMALL_FILES,
+           "file");
+    printf("%-28s %u write requests, %u sectors written\n", "", disk->write_requests - requests,
+           disk->sectors_written - sectors);
+    blkq_get_stats(&queue);
+    printf("%-28s %u segments queued, %u merged, %u commands\n", "", queue.submitted, queue.merged,
+           queue.dispatched);
+    fat12_set_journaling(1);
+}
+
+/* The same sequential read as bench_sequential() on a RAM disk, where no
+   cache or device sits between the file system and memory, and then a
+   sweep over the file's sectors mapped in place, which copies nothing at
+   all. The gaps to the file-backed numbers are what the cache and device
+   layers cost. */
+static void bench_ramdisk() {
+    static uint8_t memory[BENCH_SECTORS * SECTOR_SIZE];
+    static struct fat12_dirent entries[4];
+    uint32_t sum = 0;
+
+    bcache_init();
+    if (fat12_init(ramdisk_create(memory, BENCH_SECTORS), BLOCK_MODE_PIO) != 0) {
+        printf("cannot mount the RAM disk\n");
+        return;
+    }
+    memset(data_buffer, 0x5A, sizeof(data_buffer));
+    fat12_write_file("seq.bin", data_buffer, BENCH_FILE_SIZE);
+    double start = now_us();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        int fd = fat12_open("seq.bin", FAT12_O_READ);
+        while (fat12_read(fd, data_buffer, BENCH_CHUNK) > 0) {
+        }
+        fat12_close(fd);
+    }
+    double us = now_us() - start;
+    report("sequential read (RAM disk)", us, BENCH_PASSES * (BENCH_FILE_SIZE / BENCH_CHUNK), "chunk");
+    printf("%-28s %10.2f MB/s\n", "", BENCH_PASSES * (double)BENCH_FILE_SIZE / us);
+
+    struct fat12_boot_sector* bpb = (struct fat12_boot_sector*)memory;
+    uint32_t root_sectors = (bpb->root_entries * 32 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint32_t data = bpb->reserved_sectors + bpb->fat_count * bpb->sectors_per_fat + root_sectors;
+    int count = fat12_read_dir("/", entries, 4);
+    uint16_t first = 0;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].name, "seq.bin") == 0) {
+            first = entries[i].cluster;
+        }
+    }
+    start = now_us();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        for (uint16_t cluster = first; cluster >= 2 && cluster < FAT12_BAD_CLUSTER;
+             cluster = fat12_get_next_cluster(cluster)) {
+            uint32_t sector = data + (cluster - 2) * bpb->sectors_per_cluster;
+            for (uint32_t i = 0; i < bpb->sectors_per_cluster; i++) {
+                const uint32_t* words = (const uint32_t*)fat12_map_sector(sector + i);
+                for (int w = 0; w < SECTOR_SIZE / 4; w++) {
+                    sum += words[w];
+                }
+            }
+        }
+    }
+    us = now_us() - start;
+    report("zero-copy sweep (RAM disk)", us, BENCH_PASSES * (BENCH_FILE_SIZE / BENCH_CHUNK), "chunk");
+    printf("%-28s %10.2f MB/s (checksum %08x)\n", "", BENCH_PASSES * (double)BENCH_FILE_SIZE / us, sum);
+}
+
+/* The memory routines by block size: the byte loop the file system used
+   to carry, rep movsd / rep stosd, rep movsb / rep stosb, and SSE2. */
+static void bench_memory() {
+    static const uint32_t sizes[4] = {64, 512, 4096, 65536};
+    static const char* names[4] = {"bytes", "rep", "erms", "sse"};
+    static uint8_t src[65536] __attribute__((aligned(16)));
+    static uint8_t dest[65536] __attribute__((aligned(16)));
+    char label[32];
+
+    for (int i = 0; i < 4; i++) {
+        for (int v = 0; v < 4; v++) {
+            uint32_t rounds = BENCH_MEM_BYTES / sizes[i];
+            double start = now_us();
+            for (uint32_t r = 0; r < rounds; r++) {
+                if (v == 0) {
+                    memcpy_bytes(dest, src, sizes[i]);
+                } else if (v == 1) {
+                    memcpy_rep(dest, src, sizes[i]);
+                } else if (v == 2) {
+                    memcpy_erms(dest, src, sizes[i]);
+                } else {
+                    memcpy_sse(dest, src, sizes[i]);
+                }
+            }
+            double copy = now_us() - start;
+            start = now_us();
+            for (uint32_t r = 0; r < rounds; r++) {
+                if (v == 0) {
+                    memset_bytes(dest, r, sizes[i]);
+                } else if (v == 1) {
+                    memset_rep(dest, r, sizes[i]);
+                } else if (v == 2) {
+                    memset_erms(dest, r, sizes[i]);
+                } else {
+                    memset_sse(dest, r, sizes[i]);
+                }
+            }
+            double fill = now_us() - start;
+            snprintf(label, sizeof(label), "mem %u bytes (%s)", sizes[i], names[v]);
+            printf("%-28s %10.2f MB/s copy, %8.2f MB/s fill\n", label, BENCH_MEM_BYTES / copy,
+                   BENCH_MEM_BYTES / fill);
+        }
+    }
+}
+
+/* Reads back every file on an existing image, such as one built with
+   mkfs.fat and filled with a real data set. The image is not modified. */
+static void bench_image(const char* path) {
+    static struct fat12_dir_entry entries[512];
+    char name[13];
+    uint32_t bytes = 0;
+    uint32_t files = 0;
+
+    disk = host_disk_open(path);
+    bcache_init();
+    fat12_set_journaling(0);
+    if (disk == NULL || fat12_init(disk, BLOCK_MODE_PIO) != 0) {
+        printf("cannot mount %s\n", path);
+        return;
+    }
+    int count = fat12_list_directory(entries, 512);
+    double start = now_us();
+    for (int i = 0; i < count; i++) {
+        if (entries[i].attributes & (FAT12_ATTR_DIRECTORY | FAT12_ATTR_VOLUME_ID)) {
+            continue;
+        }
+        int n = 0;
+        for (int j = 0; j < 8 && entries[i].filename[j] != ' '; j++) {
+            name[n++] = entries[i].filename[j];
+        }
+        name[n++] = '.';
+        for (int j = 0; j < 3 && entries[i].extension[j] != ' '; j++) {
+            name[n++] = entries[i].extension[j];
+        }
+        name[n] = '\0';
+        int fd = fat12_open(name, FAT12_O_READ);
+        int got;
+        while ((got = fat12_read(fd, data_buffer, BENCH_CHUNK)) > 0) {
+            bytes += got;
+        }
+        fat12_close(fd);
+        files++;
+    }
+    double us = now_us() - start;
+    report("image file read", us, files ? files : 1, "file");
+    printf("%-28s %10.2f MB/s, %u bytes, %u device reads\n", "", bytes / us, bytes, disk->read_requests);
+    host_disk_close(disk);
+}
+
+int main(int argc, char** argv) {
+    if (host_memory_init() != 0) {
+        printf("no memory for the kernel heap\n");
+        return 1;
+    }
+    if (argc > 1) {
+        bench_image(argv[1]);
+        return 0;
+    }
+    bench_lookup();
+    bench_allocation();
+    bench_sequential();
+    bench_random();
+    bench_chain_walk();
+    bench_path_walk();
+    bench_listing();
+    bench_small_writes(0);
+    bench_small_writes(1);
+    bench_ramdisk();
+    bench_memory();
+    fat12_sync();
+    host_disk_close(disk);
+    remove(BENCH_IMAGE);
+    return 0;
+}
@@ -0,0 +1,1492 @@
+/* Libraries */
+#include <stdio.h>
+#include <string.h>
+#include "host_disk.h"
+#include "../kernel/bcache.h"
+#include "../kernel/blkq.h"
+#include "../kernel/ramdisk.h"
+#include "../kernel/mem.h"
+#include "../kernel/frame.h"
+#include "../kernel/heap.h"
+#include "../kernel/timer.h"
+#include "../filesystem/fat12.h"
+#include "../filesystem/lfn.h"
+#include "../filesystem/journal.h"
+
+/* Function Declarations */
+static void mount(const char* path, int fresh);
+static void take_baseline();
+static void write_image(const char* path, long offset, const void* data, uint32_t size);
+static void read_image(const char* path, long offset, void* data, uint32_t size);
+static void make_image(const char* path, uint32_t sectors, uint8_t cluster_sectors, uint16_t root_entries,
+                       uint16_t sectors_per_fat);
+static void unmount();
+static void fill_pattern(uint8_t* data, uint32_t size, uint32_t seed);
+static int check_file(const char* name, const uint8_t* expected, uint32_t size);
+static void entry_name(const struct fat12_dir_entry* entry, char* name);
+static int walk_dir(const char* path, int depth, uint8_t* seen, uint32_t* used);
+static int walk_chains(uint32_t* used);
+static int check_chains();
+static void test_create_write_read_delete();
+static void test_handles();
+static void test_chain_integrity();
+static void test_full_disk();
+static void test_full_directory();
+static void test_remount();
+static void test_readahead();
+static void test_foreign_geometry();
+static void test_fat_copy_recovery();
+static void test_reject_invalid();
+static void test_packed_fat();
+static void test_subdirectories();
+static void test_directory_growth();
+static int find_name(const char* path, const char* name);
+static void root_slot(uint32_t index, uint8_t* raw);
+static void test_long_names();
+static void test_long_name_layout();
+static void test_long_name_churn();
+static void crash();
+static uint32_t journal_start_sector();
+static void test_journal_replay();
+static void test_journal_torn();
+static void test_journal_ordered();
+static void queue_done(void* ctx, int status);
+static void test_request_queue();
+static void test_ramdisk();
+static void test_memory();
+static void test_frame_allocator();
+static void test_heap();
+static void test_timer_wheel();
+
+/* Definitions */
+#define TEST_IMAGE "tests/fat12_test.img"
+#define FOREIGN_IMAGE "tests/fat12_foreign.img"
+#define FOREIGN_SECTORS 8192
+#define TEST_SECTORS 2880
+#define TEST_BUFFER_SIZE (2 * 1024 * 1024)
+#define WALK_DEPTH 8
+#define WALK_ENTRIES 1024
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+/* Global Variables */
+static struct block_device* disk = NULL;
+static uint8_t data_buffer[TEST_BUFFER_SIZE];
+static uint8_t read_buffer[TEST_BUFFER_SIZE];
+static uint32_t baseline_free = 0;
+static uint32_t volume_clusters = 0;
+static int checks = 0;
+static int failures = 0;
+static const char* current_test = "";
+
+static void check(int ok, const char* expr, int line) {
+    checks++;
+    if (!ok) {
+        failures++;
+        printf("FAIL %s: line %d: %s\n", current_test, line, expr);
+    }
+}
+
+static void mount(const char* path, int fresh) {
+    disk = fresh ? host_disk_create(path, TEST_SECTORS) : host_disk_open(path);
+    if (disk == NULL) {
+        printf("cannot open %s\n", path);
+        failures++;
+        return;
+    }
+    bcache_init();
+    CHECK(fat12_init(disk, BLOCK_MODE_PIO) == 0);
+    if (fresh) {
+        take_baseline();
+    }
+}
+
+static void take_baseline() {
+    uint32_t used = 0;
+    CHECK(walk_chains(&used));
+    baseline_free = fat12_free_clusters();
+    volume_clusters = used + baseline_free;
+}
+
+static void write_image(const char* path, long offset, const void* data, uint32_t size) {
+    FILE* file = fopen(path, "r+b");
+    if (file == NULL || fseek(file, offset, SEEK_SET) != 0 || fwrite(data, 1, size, file) != size) {
+        printf("cannot patch %s\n", path);
+        failures++;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+static void read_image(const char* path, long offset, void* data, uint32_t size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL || fseek(file, offset, SEEK_SET) != 0 || fread(data, 1, size, file) != size) {
+        printf("cannot read %s\n", path);
+        failures++;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+/* Builds an empty volume the way mkfs.fat lays one out: four reserved
+   sectors, two FATs and the reserved FAT entries carrying the media byte. */
+static void make_image(const char* path, uint32_t sectors, uint8_t cluster_sectors, uint16_t root_entries,
+                       uint16_t sectors_per_fat) {
+    static const uint8_t fat_head[3] = {0xF8, 0xFF, 0xFF};
+    struct fat12_boot_sector bpb;
+    uint8_t sector[SECTOR_SIZE];
+
+    host_disk_close(host_disk_create(path, sectors));
+    memset(&bpb, 0, sizeof(bpb));
+    memcpy(bpb.jump, "\xEB\x3C\x90", 3);
+    memcpy(bpb.oem_name, "mkfs.fat", 8);
+    bpb.bytes_per_sector = SECTOR_SIZE;
+    bpb.sectors_per_cluster = cluster_sectors;
+    bpb.reserved_sectors = 4;
+    bpb.fat_count = 2;
+    bpb.root_entries = root_entries;
+    bpb.total_sectors = sectors;
+    bpb.media_descriptor = 0xF8;
+    bpb.sectors_per_fat = sectors_per_fat;
+    bpb.sectors_per_track = 32;
+    bpb.heads = 64;
+    bpb.boot_signature = 0x29;
+    memcpy(bpb.volume_label, "FOREIGN    ", 11);
+    memcpy(bpb.fs_type, "FAT12   ", 8);
+    memset(sector, 0, SECTOR_SIZE);
+    memcpy(sector, &bpb, sizeof(bpb));
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+    write_image(path, 0, sector, SECTOR_SIZE);
+    write_image(path, 4 * SECTOR_SIZE, fat_head, 3);
+    write_image(path, (4 + sectors_per_fat) * SECTOR_SIZE, fat_head, 3);
+}
+
+static void unmount() {
+    CHECK(fat12_sync() == 0);
+    host_disk_close(disk);
+    disk = NULL;
+}
+
+static void fill_pattern(uint8_t* data, uint32_t size, uint32_t seed) {
+    for (uint32_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+static int check_file(const char* name, const uint8_t* expected, uint32_t size) {
+    memset(read_buffer, 0, size + 1);
+    int bytes = fat12_read_file(name, read_buffer, size + 1);
+    return bytes == (int)size && memcmp(read_buffer, expected, size) == 0;
+}
+
+static void entry_name(const struct fat12_dir_entry* entry, char* name) {
+    int n = 0;
+    for (int i = 0; i < 8 && entry->filename[i] != ' '; i++) {
+        name[n++] = entry->filename[i];
+    }
+    if (entry->extension[0] != ' ') {
+        name[n++] = '.';
+        for (int i = 0; i < 3 && entry->extension[i] != ' '; i++) {
+            name[n++] = entry->extension[i];
+        }
+    }
+    name[n] = '\0';
+}
+
+/* Every chain must be as long as its file needs, end in an EOF marker and
+   share no cluster with another chain. Subdirectories are walked too. */
+static int walk_dir(const char* path, int depth, uint8_t* seen, uint32_t* used) {
+    static struct fat12_dir_entry entries[WALK_DEPTH][WALK_ENTRIES];
+    char child[FAT12_MAX_PATH];
+    char name[FAT12_NAME_MAX + 1];
+    int ok = 1;
+
+    if (depth >= WALK_DEPTH) {
+        return 0;
+    }
+    int count = fat12_list_path(path, entries[depth], WALK_ENTRIES);
+    for (int i = 0; i < count; i++) {
+        struct fat12_dir_entry* entry = &entries[depth][i];
+        int directory = (entry->attributes & FAT12_ATTR_DIRECTORY) != 0;
+        uint32_t expected = (entry->file_size + fat12_cluster_size() - 1) / fat12_cluster_size();
+        uint32_t length = 0;
+        uint16_t cluster = entry->cluster_low;
+        if (entry->filename[0] == '.') {
+            continue;
+        }
+        if (cluster == 0) {
+            ok &= entry->file_size == 0 && !directory;
+            continue;
+        }
+        while (cluster >= 2 && cluster < FAT12_BAD_CLUSTER) {
+            if (seen[cluster]) {
+                return 0;
+            }
+            seen[cluster] = 1;
+            length++;
+            (*used)++;
+            cluster = fat12_get_next_cluster(cluster);
+        }
+        ok &= cluster >= FAT12_EOF_CLUSTER;
+        if (directory) {
+            entry_name(entry, name);
+            snprintf(child, sizeof(child), "%s/%s", path, name);
+            ok &= walk_dir(child, depth + 1, seen, used);
+        } else {
+            ok &= length == expected || (expected == 0 && length == 1);
+        }
+    }
+    return ok;
+}
+
+static int walk_chains(uint32_t* used) {
+    static uint8_t seen[FAT12_ENTRIES];
+    *used = 0;
+    memset(seen, 0, sizeof(seen));
+    return walk_dir("", 0, seen, used);
+}
+
+/* Chained and free clusters together must account for the whole volume,
+   so a cluster marked used but reachable from no file shows up here. */
+static int check_chains() {
+    uint32_t used;
+    return walk_chains(&used) && used + fat12_free_clusters() == volume_clusters;
+}
+
+static void test_create_write_read_delete() {
+    static const uint32_t sizes[] = {0, 1, 511, 512, 513, 4096, 20000, 123457};
+    char name[16];
+
+    current_test = "create_write_read_delete";
+    mount(TEST_IMAGE, 1);
+    CHECK(baseline_free > 0);
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        snprintf(name, sizeof(name), "file%u.bin", i);
+        fill_pattern(data_buffer, sizes[i], i + 1);
+        CHECK(fat12_write_file(name, data_buffer, sizes[i]) == (int)sizes[i]);
+        CHECK(check_file(name, data_buffer, sizes[i]));
+    }
+    CHECK(fat12_create_file("file0.bin", FAT12_ATTR_ARCHIVE) != 0);
+
+    // overwriting truncates and reuses the chain
+    fill_pattern(data_buffer, 700, 99);
+    CHECK(fat12_write_file("file6.bin", data_buffer, 700) == 700);
+    CHECK(check_file("file6.bin", data_buffer, 700));
+    CHECK(check_chains());
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        snprintf(name, sizeof(name), "file%u.bin", i);
+        CHECK(fat12_delete_file(name) == 0);
+        CHECK(fat12_read_file(name, read_buffer, 1) < 0);
+    }
+    CHECK(fat12_delete_file("missing.bin") != 0);
+    CHECK(fat12_free_clusters() == baseline_free);
+    unmount();
+}
+
+static void test_handles() {
+    current_test = "handles";
+    mount(TEST_IMAGE, 1);
+
+    fill_pattern(data_buffer, 50000, 7);
+    int fd = fat12_open("h.bin", FAT12_O_WRITE | FAT12_O_CREATE);
+    CHECK(fd >= 0);
+    uint32_t pos = 0;
+    for (uint32_t chunk = 1; pos < 50000; chunk = (chunk * 3 + 7) % 1500 + 1) {
+        uint32_t n = pos + chunk > 50000 ? 50000 - pos : chunk;
+        CHECK(fat12_write(fd, data_buffer + pos, n) == (int)n);
+        pos += n;
+    }
+    CHECK(fat12_close(fd) == 0);
+    CHECK(check_file("h.bin", data_buffer, 50000));
+
+    fd = fat12_open("h.bin", FAT12_O_READ | FAT12_O_WRITE);
+    CHECK(fat12_seek(fd, 1000, FAT12_SEEK_SET) == 1000);
+    CHECK(fat12_write(fd, "XYZ", 3) == 3);
+    memcpy(data_buffer + 1000, "XYZ", 3);
+    CHECK(fat12_seek(fd, 30001, FAT12_SEEK_SET) == 30001);
+    CHECK(fat12_read(fd, read_buffer, 777) == 777);
+    CHECK(memcmp(read_buffer, data_buffer + 30001, 777) == 0);
+    CHECK(fat12_seek(fd, 100, FAT12_SEEK_END) == 50100);
+    CHECK(fat12_write(fd, "END", 3) == 3);
+    memset(data_buffer + 50000, 0, 100);
+    memcpy(data_buffer + 50100, "END", 3);
+    CHECK(fat12_close(fd) == 0);
+    CHECK(check_file("h.bin", data_buffer, 50103));
+
+    fd = fat12_open("h.bin", FAT12_O_READ);
+    CHECK(fat12_delete_file("h.bin") != 0);
+    CHECK(fat12_write(fd, "no", 2) < 0);
+    uint32_t got = 0;
+    int bytes;
+    while ((bytes = fat12_read(fd, read_buffer + got, 333)) > 0) {
+        got += bytes;
+    }
+    CHECK(got == 50103 && memcmp(read_buffer, data_buffer, got) == 0);
+
+    // a second reader is fine, but nothing may truncate the chain under them
+    int fd2 = fat12_open("h.bin", FAT12_O_READ);
+    CHECK(fd2 >= 0);
+    uint32_t free_before = fat12_free_clusters();
+    CHECK(fat12_open("h.bin", FAT12_O_WRITE | FAT12_O_TRUNC) < 0);
+    CHECK(fat12_write_file("h.bin", "short", 5) < 0);
+    CHECK(fat12_free_clusters() == free_before);
+    CHECK(fat12_seek(fd2, 0, FAT12_SEEK_SET) == 0 && fat12_read(fd2, read_buffer, 50103) == 50103);
+    CHECK(memcmp(read_buffer, data_buffer, 50103) == 0);
+    CHECK(fat12_close(fd2) == 0);
+    CHECK(fat12_close(fd) == 0);
+    CHECK(fat12_close(fd) != 0);
+    fd = fat12_open("h.bin", FAT12_O_WRITE | FAT12_O_TRUNC);
+    CHECK(fd >= 0 && fat12_open("h.bin", FAT12_O_READ) < 0);
+    CHECK(fat12_write(fd, "short", 5) == 5 && fat12_close(fd) == 0);
+    CHECK(check_file("h.bin", (const uint8_t*)"short", 5));
+    CHECK(fat12_open("absent.bin", FAT12_O_READ) < 0);
+    CHECK(check_chains());
+    unmount();
+}
+
+/* Interleaved creates and deletes leave the free space fragmented, so the
+   final large file has to be stitched together from many runs. */
+static void test_chain_integrity() {
+    char name[16];
+
+    current_test = "chain_integrity";
+    mount(TEST_IMAGE, 1);
+
+    for (int i = 0; i < 60; i++) {
+        snprintf(name, sizeof(name), "frag%02d.bin", i);
+        fill_pattern(data_buffer, 512 * (1 + i % 5), i);
+        CHECK(fat12_write_file(name, data_buffer, 512 * (1 + i % 5)) == 512 * (1 + i % 5));
+    }
+    for (int i = 0; i < 60; i += 2) {
+        snprintf(name, sizeof(name), "frag%02d.bin", i);
+        CHECK(fat12_delete_file(name) == 0);
+    }
+    fill_pattern(data_buffer, 150000, 1234);
+    CHECK(fat12_write_file("big.bin", data_buffer, 150000) == 150000);
+    CHECK(check_file("big.bin", data_buffer, 150000));
+    CHECK(check_chains());
+
+    for (int i = 1; i < 60; i += 2) {
+        snprintf(name, sizeof(name), "frag%02d.bin", i);
+        fill_pattern(data_buffer, 512 * (1 + i % 5), i);
+        CHECK(check_file(name, data_buffer, 512 * (1 + i % 5)));
+        CHECK(fat12_delete_file(name) == 0);
+    }
+    CHECK(fat12_delete_file("big.bin") == 0);
+    CHECK(fat12_free_clusters() == baseline_free);
+    unmount();
+}
+
+/* A write larger than the free space is cut short at the last free
+   cluster, later writes fail, and deleting the file gives it all back. */
+static void test_full_disk() {
+    current_test = "full_disk";
+    mount(TEST_IMAGE, 1);
+
+    uint32_t capacity = baseline_free * fat12_cluster_size();
+    CHECK(capacity < TEST_BUFFER_SIZE);
+    fill_pattern(data_buffer, TEST_BUFFER_SIZE, 42);
+    CHECK(fat12_write_file("fill.bin", data_buffer, TEST_BUFFER_SIZE) == (int)capacity);
+    CHECK(fat12_free_clusters() == 0);
+    CHECK(check_file("fill.bin", data_buffer, capacity));
+    CHECK(fat12_write_file("more.bin", data_buffer, 1) < 0);
+    CHECK(fat12_write_file("empty.bin", data_buffer, 0) == 0);
+    CHECK(check_chains());
+
+    CHECK(fat12_delete_file("fill.bin") == 0);
+    CHECK(fat12_free_clusters() == baseline_free);
+    CHECK(fat12_write_file("more.bin", data_buffer, 1) == 1);
+    unmount();
+}
+
+static void test_full_directory() {
+    char name[16];
+    int created = 0;
+
+    current_test = "full_directory";
+    mount(TEST_IMAGE, 1);
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "d%04d.txt", i);
+        if (fat12_create_file(name, FAT12_ATTR_ARCHIVE) != 0) {
+            break;
+        }
+        created++;
+    }
+    CHECK(created > 0 && created < 1000);
+    CHECK(fat12_create_file("last.txt", FAT12_ATTR_ARCHIVE) != 0);
+    CHECK(fat12_delete_file("d0000.txt") == 0);
+    CHECK(fat12_create_file("last.txt", FAT12_ATTR_ARCHIVE) == 0);
+    unmount();
+}
+
+/* Everything written must still be there after the image is closed and
+   mounted again from disk. */
+static void test_remount() {
+    current_test = "remount";
+    mount(TEST_IMAGE, 1);
+    fill_pattern(data_buffer, 30000, 5);
+    CHECK(fat12_write_file("keep.bin", data_buffer, 30000) == 30000);
+    CHECK(fat12_write_file("gone.bin", data_buffer, 1000) == 1000);
+    CHECK(fat12_delete_file("gone.bin") == 0);
+    unmount();
+
+    mount(TEST_IMAGE, 0);
+    CHECK(check_file("keep.bin", data_buffer, 30000));
+    CHECK(fat12_read_file("gone.bin", read_buffer, 1) < 0);
+    CHECK(check_chains());
+    unmount();
+}
+
+/* A sequential reader pulls the clusters ahead of it into the cache and
+   then reads them from there; a reader that seeks around, or a window of
+   0, prefetches nothing. Each remount starts from a cold cache. */
+static void test_readahead() {
+    static const uint32_t offsets[6] = {40000, 3000, 61000, 17000, 52000, 9000};
+    struct bcache_stats stats;
+
+    current_test = "readahead";
+    CHECK(fat12_get_readahead() == FAT12_READAHEAD_DEFAULT);
+    CHECK(fat12_set_readahead(FAT12_READAHEAD_MAX + 1) != 0);
+    CHECK(fat12_get_readahead() == FAT12_READAHEAD_DEFAULT);
+    mount(TEST_IMAGE, 1);
+    fill_pattern(data_buffer, 65536, 13);
+    CHECK(fat12_write_file("stream.bin", data_buffer, 65536) == 65536);
+    unmount();
+
+    mount(TEST_IMAGE, 0);
+    int fd = fat12_open("stream.bin", FAT12_O_READ);
+    for (uint32_t pos = 0; pos < 65536; pos += SECTOR_SIZE) {
+        CHECK(fat12_read(fd, read_buffer + pos, SECTOR_SIZE) == SECTOR_SIZE);
+    }
+    CHECK(fat12_close(fd) == 0);
+    CHECK(memcmp(read_buffer, data_buffer, 65536) == 0);
+    bcache_get_stats(&stats);
+    CHECK(stats.prefetched > 0 && stats.prefetch_hits == stats.prefetched);
+    CHECK(stats.prefetch_wasted == 0);
+    unmount();
+
+    // a reader that stops early leaves the rest of the window unused
+    mount(TEST_IMAGE, 0);
+    fd = fat12_open("stream.bin", FAT12_O_READ);
+    CHECK(fat12_read(fd, read_buffer, SECTOR_SIZE) == SECTOR_SIZE);
+    CHECK(fat12_read(fd, read_buffer, SECTOR_SIZE) == SECTOR_SIZE);
+    CHECK(fat12_close(fd) == 0);
+    bcache_invalidate(disk);
+    bcache_get_stats(&stats);
+    CHECK(stats.prefetch_hits == 1 && stats.prefetched > 1);
+    CHECK(stats.prefetch_wasted == stats.prefetched - stats.prefetch_hits);
+    unmount();
+
+    mount(TEST_IMAGE, 0);
+    fd = fat12_open("stream.bin", FAT12_O_READ);
+    for (int i = 0; i < 6; i++) {
+        CHECK(fat12_seek(fd, offsets[i], FAT12_SEEK_SET) == (int)offsets[i]);
+        CHECK(fat12_read(fd, read_buffer, 700) == 700);
+        CHECK(memcmp(read_buffer, data_buffer + offsets[i], 700) == 0);
+    }
+    CHECK(fat12_close(fd) == 0);
+    bcache_get_stats(&stats);
+    CHECK(stats.prefetched == 0);
+    unmount();
+
+    CHECK(fat12_set_readahead(0) == 0);
+    mount(TEST_IMAGE, 0);
+    fd = fat12_open("stream.bin", FAT12_O_READ);
+    for (uint32_t pos = 0; pos < 65536; pos += SECTOR_SIZE) {
+        CHECK(fat12_read(fd, read_buffer + pos, SECTOR_SIZE) == SECTOR_SIZE);
+    }
+    CHECK(fat12_close(fd) == 0);
+    CHECK(memcmp(read_buffer, data_buffer, 65536) == 0);
+    bcache_get_stats(&stats);
+    CHECK(stats.prefetched == 0 && stats.prefetch_hits == 0);
+    unmount();
+    CHECK(fat12_set_readahead(FAT12_READAHEAD_MAX) == 0);
+    CHECK(fat12_set_readahead(FAT12_READAHEAD_DEFAULT) == 0);
+}
+
+/* Four-sector clusters and a 512-entry root directory, so file offsets no
+   longer map one-to-one onto clusters. */
+static void test_foreign_geometry() {
+    char name[16];
+
+    current_test = "foreign_geometry";
+    make_image(FOREIGN_IMAGE, FOREIGN_SECTORS, 4, 512, 6);
+    mount(FOREIGN_IMAGE, 0);
+    take_baseline();
+    CHECK(baseline_free == (FOREIGN_SECTORS - 4 - 2 * 6 - 32 - JOURNAL_SECTORS) / 4);
+
+    for (int i = 0; i < 40; i++) {
+        uint32_t size = 97 * i * i + 13;
+        snprintf(name, sizeof(name), "f%02d.dat", i);
+        fill_pattern(data_buffer, size, i);
+        CHECK(fat12_write_file(name, data_buffer, size) == (int)size);
+    }
+    for (int i = 0; i < 40; i += 3) {
+        snprintf(name, sizeof(name), "f%02d.dat", i);
+        CHECK(fat12_delete_file(name) == 0);
+    }
+    fill_pattern(data_buffer, 300000, 77);
+    int fd = fat12_open("big.dat", FAT12_O_WRITE | FAT12_O_CREATE);
+    for (uint32_t pos = 0; pos < 300000; pos += 1000) {
+        CHECK(fat12_write(fd, data_buffer + pos, 1000) == 1000);
+    }
+    CHECK(fat12_seek(fd, 2047, FAT12_SEEK_SET) == 2047);
+    CHECK(fat12_write(fd, "cluster", 7) == 7);
+    memcpy(data_buffer + 2047, "cluster", 7);
+    CHECK(fat12_close(fd) == 0);
+    CHECK(check_chains());
+    unmount();
+
+    mount(FOREIGN_IMAGE, 0);
+    CHECK(check_file("big.dat", data_buffer, 300000));
+    for (int i = 1; i < 40; i++) {
+        uint32_t size = 97 * i * i + 13;
+        snprintf(name, sizeof(name), "f%02d.dat", i);
+        if (i % 3 == 0) {
+            CHECK(fat12_read_file(name, read_buffer, 1) < 0);
+            continue;
+        }
+        fill_pattern(data_buffer, size, i);
+        CHECK(check_file(name, data_buffer, size));
+    }
+    CHECK(check_chains());
+    unmount();
+    remove(FOREIGN_IMAGE);
+}
+
+/* A damaged primary FAT is passed over for the second copy, and the next
+   sync rewrites the primary from it. */
+static void test_fat_copy_recovery() {
+    uint8_t primary[SECTOR_SIZE];
+    uint8_t backup[SECTOR_SIZE];
+    static const uint8_t damage[3] = {0x00, 0x00, 0x00};
+
+    current_test = "fat_copy_recovery";
+    mount(TEST_IMAGE, 1);
+    fill_pattern(data_buffer, 5000, 3);
+    CHECK(fat12_write_file("safe.bin", data_buffer, 5000) == 5000);
+    unmount();
+
+    write_image(TEST_IMAGE, 1 * SECTOR_SIZE, damage, 3);
+    mount(TEST_IMAGE, 0);
+    CHECK(check_file("safe.bin", data_buffer, 5000));
+    unmount();
+    read_image(TEST_IMAGE, 1 * SECTOR_SIZE, primary, SECTOR_SIZE);
+    read_image(TEST_IMAGE, 10 * SECTOR_SIZE, backup, SECTOR_SIZE);
+    CHECK(memcmp(primary, backup, SECTOR_SIZE) == 0);
+}
+
+static void test_reject_invalid() {
+    uint8_t sector[SECTOR_SIZE];
+
+    current_test = "reject_invalid";
+    make_image(FOREIGN_IMAGE, FOREIGN_SECTORS, 4, 512, 6);
+    read_image(FOREIGN_IMAGE, 0, sector, SECTOR_SIZE);
+
+    // a sector size the layer cannot address
+    sector[11] = 0x00;
+    sector[12] = 0x04;
+    write_image(FOREIGN_IMAGE, 0, sector, SECTOR_SIZE);
+    disk = host_disk_open(FOREIGN_IMAGE);
+    CHECK(fat12_init(disk, BLOCK_MODE_PIO) != 0);
+    CHECK(fat12_open("any.txt", FAT12_O_READ | FAT12_O_WRITE | FAT12_O_CREATE) < 0);
+    host_disk_close(disk);
+
+    // more clusters than FAT12 can number
+    sector[11] = 0x00;
+    sector[12] = 0x02;
+    sector[13] = 1;
+    write_image(FOREIGN_IMAGE, 0, sector, SECTOR_SIZE);
+    disk = host_disk_open(FOREIGN_IMAGE);
+    CHECK(fat12_init(disk, BLOCK_MODE_PIO) != 0);
+    host_disk_close(disk);
+
+    // garbage without a boot signature is left alone rather than formatted
+    memset(sector, 0xA5, SECTOR_SIZE);
+    write_image(FOREIGN_IMAGE, 0, sector, SECTOR_SIZE);
+    disk = host_disk_open(FOREIGN_IMAGE);
+    CHECK(fat12_init(disk, BLOCK_MODE_PIO) != 0);
+    host_disk_close(disk);
+    read_image(FOREIGN_IMAGE, 0, sector, SECTOR_SIZE);
+    CHECK(sector[0] == 0xA5 && sector[511] == 0xA5);
+    disk = NULL;
+    remove(FOREIGN_IMAGE);
+}
+
+/* The same workload with the decoded FAT switched off and back on midway
+   must leave identical, consistent chains on disk. */
+static void test_packed_fat() {
+    char name[16];
+
+    current_test = "packed_fat";
+    mount(TEST_IMAGE, 1);
+    fat12_set_decoded_fat(0);
+    for (int i = 0; i < 30; i++) {
+        snprintf(name, sizeof(name), "p%02d.bin", i);
+        fill_pattern(data_buffer, 700 * i + 1, i);
+        CHECK(fat12_write_file(name, data_buffer, 700 * i + 1) == 700 * i + 1);
+    }
+    fat12_set_decoded_fat(1);
+    for (int i = 0; i < 30; i += 2) {
+        snprintf(name, sizeof(name), "p%02d.bin", i);
+        CHECK(fat12_delete_file(name) == 0);
+    }
+    fat12_set_decoded_fat(0);
+    fill_pattern(data_buffer, 90000, 31);
+    CHECK(fat12_write_file("p30.bin", data_buffer, 90000) == 90000);
+    fat12_set_decoded_fat(1);
+    CHECK(check_chains());
+    unmount();
+
+    mount(TEST_IMAGE, 0);
+    CHECK(check_chains());
+    CHECK(check_file("p30.bin", data_buffer, 90000));
+    for (int i = 1; i < 30; i += 2) {
+        snprintf(name, sizeof(name), "p%02d.bin", i);
+        fill_pattern(data_buffer, 700 * i + 1, i);
+        CHECK(check_file(name, data_buffer, 700 * i + 1));
+    }
+    unmount();
+}
+
+/* Nested directories reached by absolute and relative paths, with the
+   current directory tracked through ".." and surviving nothing but its
+   own volume. */
+static void test_subdirectories() {
+    static struct fat12_dir_entry entries[16];
+
+    current_test = "subdirectories";
+    mount(TEST_IMAGE, 1);
+    CHECK(strcmp(fat12_getcwd(), "/") == 0);
+    CHECK(fat12_mkdir("docs") == 0);
+    CHECK(fat12_mkdir("docs") != 0);
+    CHECK(fat12_mkdir("docs/notes") == 0);
+    CHECK(fat12_mkdir("missing/notes") != 0);
+    fill_pattern(data_buffer, 5000, 11);
+    CHECK(fat12_write_file("docs/notes/a.txt", data_buffer, 5000) == 5000);
+    CHECK(check_file("/docs/notes/a.txt", data_buffer, 5000));
+    CHECK(check_file("docs/./notes/../notes/a.txt", data_buffer, 5000));
+    CHECK(fat12_read_file("a.txt", read_buffer, 1) < 0);
+    CHECK(fat12_write_file("docs/notes/a.txt/b", data_buffer, 1) < 0);
+    CHECK(fat12_open("docs", FAT12_O_READ) < 0);
+
+    CHECK(fat12_chdir("docs/notes") == 0);
+    CHECK(strcmp(fat12_getcwd(), "/docs/notes") == 0);
+    CHECK(check_file("a.txt", data_buffer, 5000));
+    CHECK(fat12_list_directory(entries, 16) == 3);
+    CHECK(fat12_chdir("..") == 0);
+    CHECK(strcmp(fat12_getcwd(), "/docs") == 0);
+    CHECK(fat12_chdir("notes/a.txt") != 0);
+    CHECK(fat12_chdir("../..") == 0);
+    CHECK(strcmp(fat12_getcwd(), "/") == 0);
+    CHECK(fat12_chdir("/docs/notes") == 0);
+
+    CHECK(fat12_delete_file("/docs/notes") != 0);
+    CHECK(fat12_delete_file("a.txt") == 0);
+    CHECK(fat12_delete_file("/docs/notes") != 0);
+    CHECK(fat12_chdir("/") == 0);
+    CHECK(fat12_delete_file("docs") != 0);
+    CHECK(fat12_delete_file("docs/notes") == 0);
+    CHECK(fat12_list_path("docs", entries, 16) == 2);
+    CHECK(fat12_write_file("docs/keep.bin", data_buffer, 5000) == 5000);
+    CHECK(check_chains());
+    unmount();
+
+    mount(TEST_IMAGE, 0);
+    CHECK(check_file("docs/keep.bin", data_buffer, 5000));
+    CHECK(fat12_chdir("docs/notes") != 0);
+    CHECK(check_chains());
+    CHECK(fat12_delete_file("docs/keep.bin") == 0);
+    CHECK(fat12_delete_file("docs") == 0);
+    CHECK(fat12_free_clusters() == baseline_free);
+    unmount();
+}
+
+/* A subdirectory has no fixed size and grows a cluster at a time once its
+   slots run out, unlike the root. */
+static void test_directory_growth() {
+    char name[32];
+    int ok = 1;
+
+    current_test = "directory_growth";
+    mount(TEST_IMAGE, 1);
+    CHECK(fat12_mkdir("big") == 0);
+    for (int i = 0; i < 600 && ok; i++) {
+        snprintf(name, sizeof(name), "big/f%04d.txt", i);
+        ok = fat12_write_file(name, data_buffer, i % 3 ? 100 : 0) >= 0;
+    }
+    CHECK(ok);
+    CHECK(check_chains());
+    for (int i = 0; i < 600 && ok; i += 2) {
+        snprintf(name, sizeof(name), "big/f%04d.txt", i);
+        ok = fat12_delete_file(name) == 0;
+    }
+    CHECK(ok);
+    CHECK(fat12_create_file("big/late.txt", FAT12_ATTR_ARCHIVE) == 0);
+    unmount();
+
+    mount(TEST_IMAGE, 0);
+    for (int i = 0; i < 600 && ok; i++) {
+        snprintf(name, sizeof(name), "big/f%04d.txt", i);
+        ok = (fat12_read_file(name, read_buffer, 200) >= 0) == (i % 2 == 1);
+    }
+    CHECK(ok);
+    CHECK(check_chains());
+    unmount();
+}
+
+static int find_name(const char* path, const char* name) {
+    static struct fat12_dirent entries[WALK_ENTRIES];
+    int count = fat12_read_dir(path, entries, WALK_ENTRIES);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Reads one raw root directory slot straight from the image. */
+static void root_slot(uint32_t index, uint8_t* raw) {
+    struct fat12_boot_sector bpb;
+    read_image(TEST_IMAGE, 0, &bpb, sizeof(bpb));
+    uint32_t root = bpb.reserved_sectors + bpb.fat_count * bpb.sectors_per_fat;
+    read_image(TEST_IMAGE, root * SECTOR_SIZE + index * 32, raw, 32);
+}
+
+/* Names outside 8.3 keep their spelling, are found without regard to case
+   or through their alias, and survive a remount. */
+static void test_long_names() {
+    char name[FAT12_NAME_MAX + 2];
+
+    current_test = "long_names";
+    mount(TEST_IMAGE, 1);
+    fill_pattern(data_buffer, 3000, 21);
+    CHECK(fat12_write_file("write_test.txt", data_buffer, 3000) == 3000);
+    CHECK(check_file("WRITE_TEST.TXT", data_buffer, 3000));
+    CHECK(check_file("WRITE_~1.TXT", data_buffer, 3000));
+    CHECK(find_name("/", "write_test.txt") >= 0);
+    CHECK(fat12_create_file("newfile.txt", FAT12_ATTR_ARCHIVE) == 0);
+    CHECK(fat12_create_file("README.TXT", FAT12_ATTR_ARCHIVE) == 0);
+    CHECK(fat12_create_file("Mixed.Txt", FAT12_ATTR_ARCHIVE) == 0);
+    CHECK(fat12_create_file("MIXED.TXT", FAT12_ATTR_ARCHIVE) != 0);
+    CHECK(find_name("/", "newfile.txt") >= 0);
+    CHECK(find_name("/", "README.TXT") >= 0);
+    CHECK(find_name("/", "Mixed.Txt") >= 0);
+    CHECK(fat12_read_file("mixed.txt", read_buffer, 1) == 0);
+
+    for (int i = 0; i < 12; i++) {
+        snprintf(name, sizeof(name), "shared prefix %d.dat", i);
+        fill_pattern(data_buffer, 700, 100 + i);
+        CHECK(fat12_write_file(name, data_buffer, 700) == 700);
+    }
+    for (int i = 0; i < 12; i++) {
+        snprintf(name, sizeof(name), "Shared Prefix %d.DAT", i);
+        fill_pattern(data_buffer, 700, 100 + i);
+        CHECK(check_file(name, data_buffer, 700));
+    }
+
+    memset(name, 'n', FAT12_NAME_MAX);
+    name[FAT12_NAME_MAX] = '\0';
+    CHECK(fat12_write_file(name, data_buffer, 10) == 10);
+    CHECK(check_file(name, data_buffer, 10));
+    name[FAT12_NAME_MAX] = 'n';
+    name[FAT12_NAME_MAX + 1] = '\0';
+    CHECK(fat12_create_file(name, FAT12_ATTR_ARCHIVE) != 0);
+    CHECK(fat12_create_file("a*b.txt", FAT12_ATTR_ARCHIVE) != 0);
+
+    CHECK(fat12_mkdir("My Documents") == 0);
+    fill_pattern(data_buffer, 2000, 22);
+    CHECK(fat12_write_file("my documents/a rather long file name.text", data_buffer, 2000) == 2000);
+    CHECK(fat12_chdir("MY DOCUMENTS") == 0);
+    CHECK(check_file("A Rather Long File Name.text", data_buffer, 2000));
+    CHECK(find_name(".", "a rather long file name.text") >= 0);
+    CHECK(fat12_chdir("/") == 0);
+    CHECK(check_chains());
+    unmount();
+
+    mount(TEST_IMAGE, 0);
+    CHECK(find_name("/", "write_test.txt") >= 0);
+    CHECK(find_name("/", "My Documents") >= 0);
+    CHECK(find_name("/My Documents", "a rather long file name.text") >= 0);
+    CHECK(check_file("my documents/a rather long file name.text", data_buffer, 2000));
+    CHECK(fat12_delete_file("my documents/a rather long file name.text") == 0);
+    CHECK(fat12_delete_file("my documents") == 0);
+    CHECK(fat12_delete_file("write_test.txt") == 0);
+    CHECK(find_name("/", "write_test.txt") < 0);
+    CHECK(check_chains());
+    unmount();
+}
+
+/* The slots on disk follow the VFAT layout other systems expect, and
+   deleting a file frees its LFN slots too. Slot 0 holds the journal. */
+static void test_long_name_layout() {
+    uint8_t raw[3][32];
+
+    current_test = "long_name_layout";
+    mount(TEST_IMAGE, 1);
+    CHECK(fat12_create_file("write_test.txt", FAT12_ATTR_ARCHIVE) == 0);
+    unmount();
+    for (int i = 0; i < 3; i++) {
+        root_slot(i + 1, raw[i]);
+    }
+    CHECK(raw[0][0] == (LFN_LAST_ENTRY | 2) && raw[0][11] == LFN_ATTRIBUTES);
+    CHECK(raw[1][0] == 1 && raw[1][11] == LFN_ATTRIBUTES);
+    CHECK(memcmp(raw[2], "WRITE_~1TXT", 11) == 0);
+    CHECK(raw[0][13] == lfn_checksum(raw[2]) && raw[1][13] == lfn_checksum(raw[2]));
+    CHECK(raw[1][1] == 'w' && raw[1][2] == 0 && raw[1][30] == 'x' && raw[0][1] == 't');
+    CHECK(raw[0][3] == 0 && raw[0][4] == 0 && raw[0][5] == 0xFF && raw[0][6] == 0xFF);
+
+    mount(TEST_IMAGE, 0);
+    CHECK(fat12_delete_file("write_test.txt") == 0);
+    unmount();
+    for (int i = 0; i < 3; i++) {
+        root_slot(i + 1, raw[i]);
+        CHECK(raw[i][0] == 0xE5);
+    }
+}
+
+/* Creating and deleting long names over and over must keep reusing the
+   freed slots and compacting the decoded name pool. */
+static void test_long_name_churn() {
+    char name[64];
+    int ok = 1;
+
+    current_test = "long_name_churn";
+    mount(TEST_IMAGE, 1);
+    CHECK(fat12_write_file("a file that stays put.txt", data_buffer, 100) == 100);
+    for (int i = 0; i < 3000 && ok; i++) {
+        snprintf(name, sizeof(name), "churning long file name number %d.txt", i);
+        ok &= fat12_create_file(name, FAT12_ATTR_ARCHIVE) == 0;
+        if (i >= 40) {
+            snprintf(name, sizeof(name), "churning long file name number %d.txt", i - 40);
+            ok &= fat12_delete_file(name) == 0;
+        }
+    }
+    CHECK(ok);
+    CHECK(fat12_read_file("A FILE THAT STAYS PUT.TXT", read_buffer, 200) == 100);
+    CHECK(find_name("/", "churning long file name number 2999.txt") >= 0);
+    CHECK(find_name("/", "churning long file name number 2959.txt") < 0);
+    CHECK(fat12_read_file("churning long file name number 2960.txt", read_buffer, 1) == 0);
+    unmount();
+}
+
+/* Drops the image without a sync, as if power failed: whatever only the
+   buffer cache or the journal staging held is lost. */
+static void crash() {
+    host_disk_close(disk);
+    disk = NULL;
+}
+
+static uint32_t journal_start_sector() {
+    static struct fat12_dirent entries[WALK_ENTRIES];
+    struct fat12_boot_sector bpb;
+    int index = find_name("/", "JOURNAL.SYS");
+    fat12_read_dir("/", entries, WALK_ENTRIES);
+    read_image(TEST_IMAGE, 0, &bpb, sizeof(bpb));
+    uint32_t root_sectors = (bpb.root_entries * 32 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint32_t data = bpb.reserved_sectors + bpb.fat_count * bpb.sectors_per_fat + root_sectors;
+    return data + (entries[index].cluster - 2) * bpb.sectors_per_cluster;
+}
+
+/* Committed updates only reach the journal; the root and FAT on disk stay
+   stale until a checkpoint, and a crashed volume is brought up to date by
+   replaying the log at mount, as often as it takes. */
+static void test_journal_replay() {
+    uint8_t raw[32];
+
+    current_test = "journal_replay";
+    mount(TEST_IMAGE, 1);
+    CHECK(fat12_journaling());
+    CHECK(find_name("/", "JOURNAL.SYS") >= 0);
+    CHECK(fat12_delete_file("journal.sys") != 0);
+    CHECK(fat12_open("journal.sys", FAT12_O_WRITE) < 0);
+    fill_pattern(data_buffer, 9000, 31);
+    CHECK(fat12_write_file("logged.bin", data_buffer, 9000) == 9000);
+    CHECK(fat12_mkdir("logs") == 0);
+    CHECK(fat12_write_file("logs/entry.txt", data_buffer, 700) == 700);
+    CHECK(fat12_delete_file("logs/entry.txt") == 0);
+    CHECK(fat12_write_file("logs/second entry.txt", data_buffer, 1500) == 1500);
+    crash();
+
+    root_slot(1, raw);
+    CHECK(raw[0] == 0x00);
+    for (int pass = 0; pass < 2; pass++) {
+        mount(TEST_IMAGE, 0);
+        CHECK(check_file("logged.bin", data_buffer, 9000));
+        CHECK(check_file("logs/second entry.txt", data_buffer, 1500));
+        CHECK(fat12_read_file("logs/entry.txt", read_buffer, 1) < 0);
+        CHECK(check_chains());
+        crash();
+    }
+    root_slot(1, raw);
+    CHECK(memcmp(raw, "LOGGED  BIN", 11) == 0);
+
+    // with the log switched off every close writes straight home
+    mount(TEST_IMAGE, 0);
+    CHECK(fat12_set_journaling(0) == 0);
+    CHECK(fat12_write_file("direct.bin", data_buffer, 100) == 100);
+    crash();
+    CHECK(fat12_set_journaling(1) == 0);
+    mount(TEST_IMAGE, 0);
+    CHECK(check_file("direct.bin", data_buffer, 100));
+    unmount();
+}
+
+/* A transaction whose records do not match its checksum, as left by a
+   write cut short, is dropped along with everything after it. */
+static void test_journal_torn() {
+    uint8_t header[SECTOR_SIZE];
+    uint8_t byte;
+
+    current_test = "journal_torn";
+    mount(TEST_IMAGE, 1);
+    uint32_t start = journal_start_sector();
+    fill_pattern(data_buffer, 3000, 41);
+    CHECK(fat12_write_file("first.bin", data_buffer, 3000) == 3000);
+    CHECK(fat12_write_file("second.bin", data_buffer, 3000) == 3000);
+    crash();
+
+    read_image(TEST_IMAGE, (start + 1) * SECTOR_SIZE, header, SECTOR_SIZE);
+    uint32_t second = start + 2 + ((struct journal_header*)header)->count;
+    read_image(TEST_IMAGE, second * SECTOR_SIZE, header, SECTOR_SIZE);
+    CHECK(((struct journal_header*)header)->magic == JOURNAL_TX_MAGIC);
+    read_image(TEST_IMAGE, (second + 1) * SECTOR_SIZE + 100, &byte, 1);
+    byte ^= 0xFF;
+    write_image(TEST_IMAGE, (second + 1) * SECTOR_SIZE + 100, &byte, 1);
+
+    mount(TEST_IMAGE, 0);
+    CHECK(check_file("first.bin", data_buffer, 3000));
+    CHECK(fat12_read_file("second.bin", read_buffer, 1) < 0);
+    CHECK(check_chains());
+    unmount();
+}
+
+/* Clusters a truncate frees stay unused until the update commits, so
+   new data written ahead of the commit record never lands on clusters
+   the committed entry still points at, even on a nearly full volume. */
+static void test_journal_ordered() {
+    current_test = "journal_ordered";
+    mount(TEST_IMAGE, 1);
+    uint32_t size = 100 * fat12_cluster_size();
+    uint8_t* filler = data_buffer + size;
+    uint8_t* rewrite = read_buffer + size;
+    fill_pattern(data_buffer, size, 71);
+    CHECK(fat12_write_file("old.bin", data_buffer, size) == (int)size);
+    uint32_t spare = (fat12_free_clusters() - 20) * fat12_cluster_size();
+    fill_pattern(filler, spare, 72);
+    CHECK(fat12_write_file("filler.bin", filler, spare) == (int)spare);
+    CHECK(fat12_free_clusters() == 20);
+
+    // more than the buffer cache holds, so the data is written home early
+    fill_pattern(rewrite, size, 73);
+    int fd = fat12_open("old.bin", FAT12_O_WRITE | FAT12_O_TRUNC);
+    CHECK(fd >= 0 && fat12_free_clusters() == 20);
+    CHECK(fat12_write(fd, rewrite, size) == (int)(20 * fat12_cluster_size()));
+    crash();
+
+    mount(TEST_IMAGE, 0);
+    CHECK(check_file("old.bin", data_buffer, size));
+    CHECK(check_chains());
+    fd = fat12_open("old.bin", FAT12_O_WRITE | FAT12_O_TRUNC);
+    CHECK(fat12_write(fd, rewrite, 10 * fat12_cluster_size()) == (int)(10 * fat12_cluster_size()));
+    CHECK(fat12_close(fd) == 0);
+    CHECK(fat12_free_clusters() == 110);
+    CHECK(check_file("old.bin", rewrite, 10 * fat12_cluster_size()));
+    CHECK(check_chains());
+    unmount();
+}
+
+static void queue_done(void* ctx, int status) {
+    int* completions = (int*)ctx;
+    if (status == 0) {
+        (*completions)++;
+    }
+}
+
+/* Segments queued out of order are sorted and merged with their
+   neighbours, so adjacent sectors in separate buffers still reach the
+   device as one request, and a flush of adjacent dirty sectors does too. */
+static void test_request_queue() {
+    static const uint32_t order[5] = {12, 40, 10, 13, 11};
+    struct blkq_stats stats;
+    struct bcache_stats cstats;
+    int completions = 0;
+
+    current_test = "request_queue";
+    disk = host_disk_create(TEST_IMAGE, TEST_SECTORS);
+    bcache_init();
+    blkq_reset_stats();
+    fill_pattern(data_buffer, 64 * SECTOR_SIZE, 51);
+
+    uint32_t writes = disk->write_requests;
+    for (int i = 0; i < 5; i++) {
+        CHECK(blkq_submit(disk, order[i], 1, data_buffer + order[i] * SECTOR_SIZE, 1, queue_done, &completions) == 0);
+    }
+    CHECK(disk->write_requests == writes);
+    blkq_drain();
+    CHECK(completions == 5);
+    CHECK(disk->write_requests == writes + 2);
+    blkq_get_stats(&stats);
+    CHECK(stats.submitted == 5);
+    CHECK(stats.merged == 3);
+    CHECK(stats.dispatched == 2);
+    CHECK(stats.completed == 5);
+    CHECK(block_read(disk, 10, 4, read_buffer) == 0);
+    CHECK(memcmp(read_buffer, data_buffer + 10 * SECTOR_SIZE, 4 * SECTOR_SIZE) == 0);
+
+    uint32_t reads = disk->read_requests;
+    memset(read_buffer, 0, 64 * SECTOR_SIZE);
+    for (int i = 4; i >= 0; i--) {
+        CHECK(blkq_submit(disk, order[i], 1, read_buffer + order[i] * SECTOR_SIZE, 0, queue_done, &completions) == 0);
+    }
+    blkq_drain();
+    CHECK(completions == 10);
+    CHECK(disk->read_requests == reads + 2);
+    CHECK(memcmp(read_buffer + 10 * SECTOR_SIZE, data_buffer + 10 * SECTOR_SIZE, 4 * SECTOR_SIZE) == 0);
+    CHECK(memcmp(read_buffer + 40 * SECTOR_SIZE, data_buffer + 40 * SECTOR_SIZE, SECTOR_SIZE) == 0);
+    CHECK(blkq_submit(disk, TEST_SECTORS, 1, read_buffer, 0, queue_done, &completions) != 0);
+    CHECK(blkq_submit(disk, 0, 0, read_buffer, 0, queue_done, &completions) != 0);
+
+    writes = disk->write_requests;
+    for (int i = 15; i >= 0; i--) {
+        CHECK(bcache_write(disk, 100 + i, data_buffer + i * SECTOR_SIZE) == 0);
+    }
+    CHECK(bcache_flush(disk) == 0);
+    CHECK(disk->write_requests == writes + 1);
+    bcache_get_stats(&cstats);
+    CHECK(cstats.dirty == 0);
+    CHECK(cstats.flushes == 16);
+    CHECK(block_read(disk, 100, 16, read_buffer) == 0);
+    CHECK(memcmp(read_buffer, data_buffer, 16 * SECTOR_SIZE) == 0);
+    host_disk_close(disk);
+    disk = NULL;
+}
+
+/* A volume on a RAM disk bypasses the block cache, and its sectors can be
+   read in place through fat12_map_sector(). */
+static void test_ramdisk() {
+    static uint8_t memory[TEST_SECTORS * SECTOR_SIZE];
+    struct bcache_stats before, after;
+    struct fat12_dirent entries[4];
+
+    current_test = "ramdisk";
+    memset(memory, 0, sizeof(memory));
+    struct block_device* ram = ramdisk_create(memory, TEST_SECTORS);
+    CHECK(ram != NULL);
+    CHECK(ramdisk_create(NULL, TEST_SECTORS) == NULL);
+    CHECK(block_map(ram, TEST_SECTORS - 1, 1) == memory + (TEST_SECTORS - 1) * SECTOR_SIZE);
+    CHECK(block_map(ram, TEST_SECTORS - 1, 2) == NULL);
+    bcache_init();
+    CHECK(fat12_init(ram, BLOCK_MODE_PIO) == 0);
+
+    bcache_get_stats(&before);
+    fill_pattern(data_buffer, 20000, 61);
+    CHECK(fat12_mkdir("scratch") == 0);
+    CHECK(fat12_write_file("scratch/ram.bin", data_buffer, 20000) == 20000);
+    CHECK(check_file("scratch/ram.bin", data_buffer, 20000));
+    bcache_get_stats(&after);
+    CHECK(after.hits == before.hits && after.misses == before.misses && after.dirty == 0);
+
+    CHECK(fat12_read_dir("scratch", entries, 4) == 3);
+    int index = entries[0].name[0] == '.' ? (entries[1].name[0] == '.' ? 2 : 1) : 0;
+    struct fat12_boot_sector* bpb = (struct fat12_boot_sector*)memory;
+    uint32_t root_sectors = (bpb->root_entries * 32 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint32_t data = bpb->reserved_sectors + bpb->fat_count * bpb->sectors_per_fat + root_sectors;
+    uint32_t sector = data + (entries[index].cluster - 2) * bpb->sectors_per_cluster;
+    const uint8_t* mapped = (const uint8_t*)fat12_map_sector(sector);
+    CHECK(mapped == memory + sector * SECTOR_SIZE);
+    CHECK(mapped != NULL && memcmp(mapped, data_buffer, SECTOR_SIZE) == 0);
+    CHECK(fat12_map_sector(bpb->reserved_sectors) != NULL);
+
+    // a FAT sector maps with changes not yet committed
+    CHECK(fat12_mkdir("fatmap") == 0 && fat12_write_file("fatmap/g.bin", data_buffer, 1) == 1);
+    CHECK(fat12_read_dir("fatmap", entries, 4) == 3);
+    index = entries[0].name[0] == '.' ? (entries[1].name[0] == '.' ? 2 : 1) : 0;
+    uint16_t cluster = entries[index].cluster;
+    int fd = fat12_open("fatmap/g.bin", FAT12_O_WRITE);
+    CHECK(fd >= 0 && fat12_write(fd, data_buffer, 5000) == 5000);
+    uint32_t offset = cluster + cluster / 2;
+    const uint8_t* fat = (const uint8_t*)fat12_map_sector(bpb->reserved_sectors + offset / SECTOR_SIZE);
+    const uint8_t* fat_next = (const uint8_t*)fat12_map_sector(bpb->reserved_sectors + (offset + 1) / SECTOR_SIZE);
+    CHECK(fat != NULL && fat_next != NULL);
+    if (fat != NULL && fat_next != NULL) {
+        uint16_t raw = fat[offset % SECTOR_SIZE] | (fat_next[(offset + 1) % SECTOR_SIZE] << 8);
+        uint16_t next = cluster & 1 ? raw >> 4 : raw & 0xFFF;
+        CHECK(next == fat12_get_next_cluster(cluster) && next < 0xFF8);
+    }
+    CHECK(fat12_close(fd) == 0);
+    CHECK(fat12_map_sector(bpb->total_sectors) == NULL);
+
+    // everything lives in the memory, so a remount finds it again
+    CHECK(fat12_sync() == 0);
+    bcache_init();
+    CHECK(fat12_init(ramdisk_create(memory, TEST_SECTORS), BLOCK_MODE_PIO) == 0);
+    CHECK(check_file("scratch/ram.bin", data_buffer, 20000));
+    CHECK(check_chains());
+    CHECK(fat12_sync() == 0);
+
+    // a file-backed volume has nothing to map
+    mount(TEST_IMAGE, 1);
+    CHECK(fat12_map_sector(data) == NULL);
+    unmount();
+}
+
+/* Every variant against a byte loop, over sizes around the rep and SSE
+   block boundaries and every alignment of both ends, with guard bytes on
+   either side. memmove is checked with overlap in both directions. */
+static void test_memory() {
+    static void* (*copies[4])(void*, const void*, size_t) = {memcpy, memcpy_rep, memcpy_erms, memcpy_sse};
+    static void* (*fills[4])(void*, int, size_t) = {memset, memset_rep, memset_erms, memset_sse};
+    static const uint32_t sizes[10] = {0, 1, 3, 4, 15, 63, 64, 255, 1000, 4099};
+    uint8_t* src = data_buffer;
+    uint8_t* dest = read_buffer;
+    int ok = 1;
+
+    current_test = "memory";
+    fill_pattern(src, 8192, 71);
+    for (int v = 0; v < 4; v++) {
+        for (int k = 0; k < 10; k++) {
+            for (uint32_t align = 0; align < 16; align += 5) {
+                uint32_t n = sizes[k];
+                memset_bytes(dest, 0xEE, 8192);
+                copies[v](dest + 16 + align, src + align * 3, n);
+                ok &= memcmp(dest + 16 + align, src + align * 3, n) == 0;
+                ok &= dest[15 + align] == 0xEE && dest[16 + align + n] == 0xEE;
+                fills[v](dest + 16 + align, 0x5A + k, n);
+                for (uint32_t i = 0; i < n; i++) {
+                    ok &= dest[16 + align + i] == (uint8_t)(0x5A + k);
+                }
+                ok &= dest[15 + align] == 0xEE && dest[16 + align + n] == 0xEE;
+            }
+        }
+    }
+    CHECK(ok);
+
+    for (int shift = -37; shift <= 37; shift += 74) {
+        memcpy_bytes(dest, src, 4096);
+        memmove(dest + 100 + shift, dest + 100, 3001);
+        CHECK(memcmp(dest + 100 + shift, src + 100, 3001) == 0);
+    }
+    uint16_t cells[9];
+    memsetw(cells, 0x0720, 8);
+    cells[8] = 0;
+    CHECK(cells[0] == 0x0720 && cells[7] == 0x0720 && cells[8] == 0);
+    memcpy_bytes(dest, src, 64);
+    CHECK(memcmp(dest, src, 64) == 0);
+    dest[41] ^= 1;
+    CHECK(memcmp(dest, src, 64) != 0 && memcmp(dest, src, 41) == 0);
+    CHECK((memcmp(dest, src, 64) < 0) == (dest[41] < src[41]));
+}
+
+/* A fake BIOS map over a 4 MiB aligned arena: usable memory split by a
+   BIOS hole, an unaligned end, and entries that must be ignored. */
+static void test_frame_allocator() {
+    static uint8_t arena[8 << 20] __attribute__((aligned(4 << 20)));
+    static size_t blocks[2048];
+    static uint8_t owner[2048];
+    size_t base = (size_t)arena;
+    struct e820_map map;
+    struct frame_range reserved[1] = {{base, 0x10000}};
+    struct frame_stats before;
+    struct frame_stats stats;
+    int count = 0;
+    int ok = 1;
+
+    current_test = "frame allocator";
+    // the state array must not land on firmware memory inside a usable entry
+    map.count = 2;
+    map.entries[0] = (struct e820_entry){base, 0x300000, E820_USABLE, E820_ATTR_VALID};
+    map.entries[1] = (struct e820_entry){base + 0x10000, 0x1000, 3, E820_ATTR_VALID};
+    memset(arena + 0x10000, 0x5A, 0x1000);
+    CHECK(frame_init(&map, reserved, 1) == 0);
+    frame_get_stats(&stats);
+    CHECK(stats.total_frames == 768 - 16 - 1 - 1);
+    for (int i = 0; i < 0x1000; i++) {
+        ok &= arena[0x10000 + i] == 0x5A;
+    }
+    CHECK(ok);
+
+    map.count = 5;
+    map.entries[0] = (struct e820_entry){base, 0x300000, E820_USABLE, E820_ATTR_VALID};
+    map.entries[1] = (struct e820_entry){base + 0x300000, 0x10000, 2, E820_ATTR_VALID};
+    map.entries[2] = (struct e820_entry){base + 0x310000, 0x4F0000 - 100, E820_USABLE, E820_ATTR_VALID};
+    map.entries[3] = (struct e820_entry){base + 0x200000, 0, E820_USABLE, E820_ATTR_VALID};
+    map.entries[4] = (struct e820_entry){base + 0x100000, 0x100000, E820_USABLE, 0};
+    CHECK(frame_init(&map, reserved, 1) == 0);
+    frame_get_stats(&before);
+    // 768 frames less 16 reserved and 1 for the state array, then 1263
+    CHECK(before.total_frames == 2014 && before.free_frames == 2014);
+
+    CHECK(frame_alloc(FRAME_MAX_ORDER) == 0);
+    size_t big = frame_alloc(9);
+    CHECK(big != 0 && (big & 0x1FFFFF) == 0);
+    CHECK(frame_free(big) == 0);
+    CHECK(frame_free(big) != 0);
+    CHECK(frame_free(base + 0x300000 + 3) != 0);
+
+    memset(owner, 0, sizeof(owner));
+    while (count < 2048) {
+        size_t addr = frame_alloc(0);
+        if (addr == 0) {
+            break;
+        }
+        size_t index = (addr - base) >> FRAME_SHIFT;
+        ok &= addr >= base && index < 2048 && !owner[index] && (addr & (FRAME_SIZE - 1)) == 0;
+        ok &= addr >= base + 0x10000 && (addr < base + 0x300000 || addr >= base + 0x310000);
+        if (index < 2048) {
+            owner[index] = 1;
+        }
+        memset((void*)addr, 0xA5, FRAME_SIZE);
+        blocks[count++] = addr;
+    }
+    CHECK(ok);
+    CHECK(count == 2014);
+    frame_get_stats(&stats);
+    CHECK(stats.free_frames == 0 && stats.failures == 2);
+
+    // freed out of order, every buddy pair must still merge back
+    for (int i = 0; i < count; i += 2) {
+        ok &= frame_free(blocks[i]) == 0;
+    }
+    for (int i = 1; i < count; i += 2) {
+        ok &= frame_free(blocks[i]) == 0;
+    }
+    CHECK(ok);
+    frame_get_stats(&stats);
+    CHECK(stats.free_frames == before.free_frames);
+    CHECK(memcmp(stats.free_blocks, before.free_blocks, sizeof(stats.free_blocks)) == 0);
+}
+
+static void test_heap() {
+    static void* objects[600];
+    struct kmem_cache_stats cs;
+    struct heap_stats hs;
+    struct frame_stats before;
+    struct frame_stats after;
+    int ok = 1;
+
+    current_test = "heap";
+    struct kmem_cache* cache = kmem_cache_create("test-48", 48, 16);
+    CHECK(cache != NULL);
+    CHECK(kmem_cache_create("too-big", FRAME_SIZE, 16) == NULL);
+    frame_get_stats(&before);
+    for (int i = 0; i < 600; i++) {
+        objects[i] = kmem_cache_alloc(cache);
+        ok &= objects[i] != NULL && ((size_t)objects[i] & 15) == 0 && ((size_t)objects[i] & (FRAME_SIZE - 1)) != 0;
+        if (objects[i] != NULL) {
+            memset(objects[i], i, 48);
+        }
+    }
+    CHECK(ok);
+    for (int i = 0; i < 600; i++) {
+        const uint8_t* bytes = objects[i];
+        ok &= bytes[0] == (uint8_t)i && bytes[47] == (uint8_t)i;
+    }
+    CHECK(ok);
+    int index = 0;
+    while (kmem_cache_get_stats(index, &cs) == 0 && cs.name != cache->name) {
+        index++;
+    }
+    CHECK(cs.active == 600 && cs.per_slab == (FRAME_SIZE - 32) / 48);
+    CHECK(cs.slabs == (600 + cs.per_slab - 1) / cs.per_slab && cs.total >= 600);
+    for (int i = 0; i < 600; i += 2) {
+        kmem_cache_free(cache, objects[i]);
+    }
+    for (int i = 1; i < 600; i += 2) {
+        kmem_cache_free(cache, objects[i]);
+    }
+    kmem_cache_get_stats(index, &cs);
+    CHECK(cs.active == 0 && cs.slabs == 1);
+    frame_get_stats(&after);
+    CHECK(after.free_frames == before.free_frames - 1);
+
+    // size classes, and whole frames past the largest
+    static const uint32_t sizes[6] = {1, 16, 17, 500, 1024, 1025};
+    void* blocks[6];
+    for (int i = 0; i < 6; i++) {
+        blocks[i] = kmalloc(sizes[i]);
+        ok &= blocks[i] != NULL;
+        if (blocks[i] != NULL) {
+            memset(blocks[i], 0x3C, sizes[i]);
+        }
+    }
+    CHECK(ok);
+    CHECK(((size_t)blocks[5] & (FRAME_SIZE - 1)) == 0 && ((size_t)blocks[4] & (FRAME_SIZE - 1)) != 0);
+    CHECK(kmalloc(0) == NULL);
+    CHECK(kmalloc(((size_t)FRAME_SIZE << FRAME_MAX_ORDER) + 1) == NULL && kmalloc((size_t)-1) == NULL);
+    heap_get_stats(&hs);
+    for (int i = 0; i < 6; i++) {
+        kfree(blocks[i]);
+    }
+    kfree(NULL);
+    struct heap_stats hs_after;
+    heap_get_stats(&hs_after);
+    CHECK(hs_after.large_frees == hs.large_frees + 1);
+}
+
+static uint64_t timer_tick;
+static struct timer periodic;
+static int periodic_left;
+
+static void record_tick(void* ctx) {
+    *(uint64_t*)ctx = timer_tick;
+}
+
+static void rearm(void* ctx) {
+    *(uint64_t*)ctx = timer_tick;
+    if (--periodic_left > 0) {
+        timer_add(&periodic, timer_tick + 10);
+    }
+}
+
+/* Every timer must fire on exactly its tick, whichever level of the wheel
+   it started on and however many cascades moved it down. */
+static void test_timer_wheel() {
+    static const uint64_t delays[10] = {0, 1, 2, 63, 64, 65, 4095, 4096, 262145, 17000000};
+    static struct timer timers[10];
+    static uint64_t fired[10];
+    struct timer late;
+    struct timer cancelled;
+    struct timer moved;
+    struct timer_stats stats;
+    uint64_t late_fired = 0;
+    uint64_t cancelled_fired = 0;
+    uint64_t moved_fired = 0;
+    uint64_t periodic_fired = 0;
+    int ok = 1;
+
+    current_test = "timer wheel";
+    timer_wheel_init(100);
+    for (int i = 0; i < 10; i++) {
+        fired[i] = 0;
+        timer_setup(&timers[i], record_tick, &fired[i]);
+        CHECK(timer_add(&timers[i], 100 + delays[i]) == 0);
+    }
+    timer_setup(&late, record_tick, &late_fired);
+    timer_add(&late, 40);
+    timer_setup(&cancelled, record_tick, &cancelled_fired);
+    timer_add(&cancelled, 5000);
+    timer_setup(&moved, record_tick, &moved_fired);
+    timer_add(&moved, 200000);
+    timer_add(&moved, 170);
+    timer_setup(&periodic, rearm, &periodic_fired);
+    periodic_left = 3;
+    timer_add(&periodic, 150);
+    struct timer unarmed;
+    timer_setup(&unarmed, NULL, NULL);
+    CHECK(timer_add(&unarmed, 200) != 0);
+    CHECK(timer_pending(&cancelled) && timer_cancel(&cancelled) == 0);
+    CHECK(!timer_pending(&cancelled) && timer_cancel(&cancelled) != 0);
+    timer_get_stats(&stats);
+    CHECK(stats.pending == 13);
+
+    for (timer_tick = 100; timer_tick <= 100 + 17000000; timer_tick++) {
+        timer_run(timer_tick);
+    }
+    for (int i = 0; i < 10; i++) {
+        ok &= fired[i] == 100 + delays[i];
+    }
+    CHECK(ok);
+    CHECK(late_fired == 100 && moved_fired == 170 && cancelled_fired == 0);
+    CHECK(periodic_fired == 170 && periodic_left == 0);
+    timer_get_stats(&stats);
+    CHECK(stats.pending == 0 && stats.fired == 15 && stats.cascaded > 0);
+
+    // a run that falls behind catches up on the next call
+    fired[0] = 0;
+    timer_add(&timers[0], timer_tick + 500);
+    timer_tick += 1000;
+    timer_run(timer_tick);
+    CHECK(fired[0] == timer_tick && !timer_pending(&timers[0]));
+
+    // the next wakeup, whichever level the earliest timer waits on
+    uint64_t next = 0;
+    uint64_t base = timer_tick;
+    CHECK(timer_next(&next) != 0);
+    timer_add(&timers[0], base + 100);
+    timer_add(&timers[1], base + 5000);
+    CHECK(timer_next(&next) == 0 && next == base + 100);
+    timer_add(&timers[2], base + 30);
+    CHECK(timer_next(&next) == 0 && next == base + 30);
+    for (timer_tick = base + 1; timer_tick <= base + 90; timer_tick++) {
+        timer_run(timer_tick);
+    }
+    timer_add(&timers[3], base + 140);
+    CHECK(fired[2] == base + 30 && timer_next(&next) == 0 && next == base + 100);
+    timer_cancel(&timers[0]);
+    CHECK(timer_next(&next) == 0 && next == base + 140);
+    timer_cancel(&timers[1]);
+    timer_cancel(&timers[3]);
+    CHECK(timer_next(&next) != 0);
+
+    // the earliest timer leaving its level, by cancel or cascade, exposes the next
+    static const uint64_t spread[4] = {2000, 70, 9000, 3000};
+    base = timer_tick;
+    for (int i = 0; i < 4; i++) {
+        fired[i] = 0;
+        timer_add(&timers[i], base + spread[i]);
+    }
+    timer_add(&timers[4], base + 1500);
+    CHECK(timer_next(&next) == 0 && next == base + 70);
+    timer_cancel(&timers[1]);
+    CHECK(timer_next(&next) == 0 && next == base + 1500);
+    timer_cancel(&timers[4]);
+    CHECK(timer_next(&next) == 0 && next == base + 2000);
+    timer_add(&timers[1], base + 70);
+    for (timer_tick = base + 1; timer_tick <= base + 9000; timer_tick++) {
+        timer_run(timer_tick);
+        uint64_t expected = ~0ULL;
+        for (int i = 0; i < 4; i++) {
+            if (base + spread[i] > timer_tick && base + spread[i] < expected) {
+                expected = base + spread[i];
+            }
+        }
+        if (expected == ~0ULL) {
+            ok &= timer_next(&next) != 0;
+        } else {
+            ok &= timer_next(&next) == 0 && next == expected;
+        }
+    }
+    CHECK(ok);
+    CHECK(fired[0] == base + 2000 && fired[1] == base + 70 && fired[2] == base + 9000 && fired[3] == base + 3000);
+}
+
+int main() {
+    // runs on an arena of its own, before the shared one is set up
+    test_frame_allocator();
+    current_test = "host memory";
+    CHECK(host_memory_init() == 0);
+    test_create_write_read_delete();
+    test_handles();
+    test_chain_integrity();
+    test_full_disk();
+    test_full_directory();
+    test_remount();
+    test_readahead();
+    test_foreign_geometry();
+    test_fat_copy_recovery();
+    test_reject_invalid();
+    test_packed_fat();
+    test_subdirectories();
+    test_directory_growth();
+    test_long_names();
+    test_long_name_layout();
+    test_long_name_churn();
+    test_journal_replay();
+    test_journal_torn();
+    test_journal_ordered();
+    test_request_queue();
+    test_ramdisk();
+    test_memory();
+    test_heap();
+    test_timer_wheel();
+    remove(TEST_IMAGE);
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
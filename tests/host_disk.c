@@ -0,0 +1,119 @@
+/* Libraries */
+#include <stdio.h>
+#include "host_disk.h"
+#include "../kernel/frame.h"
+#include "../kernel/heap.h"
+
+/* Function Declarations */
+static int host_disk_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer);
+static int host_disk_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer);
+static int host_disk_flush(struct block_device* dev);
+static struct block_device* host_disk_attach(FILE* file, uint32_t sector_count);
+
+/* Definitions */
+#define HOST_DISK_MAX_TRANSFER 256
+#define HOST_MEMORY_SIZE (16 << 20)
+
+/* Global Variables */
+static struct block_device host_device;
+static uint8_t host_memory[HOST_MEMORY_SIZE] __attribute__((aligned(4 << 20)));
+
+/* A disk image on the host file system standing in for the ATA drive. Only
+   one image is attached at a time, mirroring the single slave the kernel
+   drives. */
+static struct block_device* host_disk_attach(FILE* file, uint32_t sector_count) {
+    host_device.name = "host";
+    host_device.sector_count = sector_count;
+    host_device.max_transfer = HOST_DISK_MAX_TRANSFER;
+    host_device.read = host_disk_read;
+    host_device.write = host_disk_write;
+    host_device.flush = host_disk_flush;
+    host_device.set_mode = NULL;
+    host_device.read_async = NULL;
+    host_device.write_async = NULL;
+    host_device.poll = NULL;
+    host_device.map = NULL;
+    host_device.mode = BLOCK_MODE_PIO;
+    host_device.data = file;
+    host_device.read_requests = 0;
+    host_device.write_requests = 0;
+    host_device.sectors_read = 0;
+    host_device.sectors_written = 0;
+    host_device.errors = 0;
+    return &host_device;
+}
+
+struct block_device* host_disk_create(const char* path, uint32_t sector_count) {
+    static const uint8_t zero[BLOCK_SECTOR_SIZE];
+    FILE* file = fopen(path, "w+b");
+    if (file == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < sector_count; i++) {
+        if (fwrite(zero, BLOCK_SECTOR_SIZE, 1, file) != 1) {
+            fclose(file);
+            return NULL;
+        }
+    }
+    fflush(file);
+    return host_disk_attach(file, sector_count);
+}
+
+struct block_device* host_disk_open(const char* path) {
+    FILE* file = fopen(path, "r+b");
+    if (file == NULL) {
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        return NULL;
+    }
+    long size = ftell(file);
+    if (size < BLOCK_SECTOR_SIZE) {
+        fclose(file);
+        return NULL;
+    }
+    return host_disk_attach(file, size / BLOCK_SECTOR_SIZE);
+}
+
+void host_disk_close(struct block_device* dev) {
+    if (dev != NULL && dev->data != NULL) {
+        fclose((FILE*)dev->data);
+        dev->data = NULL;
+    }
+}
+
+/* Stands in for the BIOS memory map and the boot-time frame allocator and
+   heap setup, handing the kernel allocators one block of host memory. */
+int host_memory_init() {
+    struct e820_map map;
+    map.count = 1;
+    map.entries[0].base = (size_t)host_memory;
+    map.entries[0].length = HOST_MEMORY_SIZE;
+    map.entries[0].type = E820_USABLE;
+    map.entries[0].attributes = E820_ATTR_VALID;
+    if (frame_init(&map, NULL, 0) != 0) {
+        return -1;
+    }
+    return heap_init();
+}
+
+static int host_disk_read(struct block_device* dev, uint32_t lba, uint32_t count, void* buffer) {
+    FILE* file = (FILE*)dev->data;
+    if (fseek(file, (long)lba * BLOCK_SECTOR_SIZE, SEEK_SET) != 0) {
+        return -1;
+    }
+    return fread(buffer, BLOCK_SECTOR_SIZE, count, file) == count ? 0 : -1;
+}
+
+static int host_disk_write(struct block_device* dev, uint32_t lba, uint32_t count, const void* buffer) {
+    FILE* file = (FILE*)dev->data;
+    if (fseek(file, (long)lba * BLOCK_SECTOR_SIZE, SEEK_SET) != 0) {
+        return -1;
+    }
+    return fwrite(buffer, BLOCK_SECTOR_SIZE, count, file) == count ? 0 : -1;
+}
+
+static int host_disk_flush(struct block_device* dev) {
+    return fflush((FILE*)dev->data) == 0 ? 0 : -1;
+}
@@ -0,0 +1,12 @@
+#ifndef HOST_DISK_H
+#define HOST_DISK_H
+
+#include "../kernel/block.h"
+
+/* Function Declarations */
+struct block_device* host_disk_create(const char* path, uint32_t sector_count);
+struct block_device* host_disk_open(const char* path);
+void host_disk_close(struct block_device* dev);
+int host_memory_init();
+
+#endif